@@ -0,0 +1,298 @@
+#include "BitAdjacency.h"
+#include <algorithm>
+
+#if !defined(CRS_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CRS_BIT_SIMD 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Word-wide operations behind the searches, one set per instruction set
+struct BitKernels {
+    const char* name;
+    // next |= row & mask
+    void (*expand)(uint64_t* next, const uint64_t* row, const uint64_t* mask, size_t words);
+    // mask &= ~bits, returns true if bits had any bit set
+    bool (*remove)(uint64_t* mask, const uint64_t* bits, size_t words);
+    // Number of set bits
+    size_t (*count)(const uint64_t* bits, size_t words);
+    // Number of bits set in both a and b
+    size_t (*countBoth)(const uint64_t* a, const uint64_t* b, size_t words);
+};
+
+// Portable bodies; always inlined so the popcnt variants below compile them with popcnt enabled
+__attribute__((always_inline)) static inline void expandWords(uint64_t* next, const uint64_t* row, const uint64_t* mask, size_t words) {
+    for (size_t w = 0; w < words; ++w) next[w] |= row[w] & mask[w];
+}
+
+__attribute__((always_inline)) static inline bool removeWords(uint64_t* mask, const uint64_t* bits, size_t words) {
+    uint64_t any = 0;
+    for (size_t w = 0; w < words; ++w) {
+        mask[w] &= ~bits[w];
+        any |= bits[w];
+    }
+    return any != 0;
+}
+
+__attribute__((always_inline)) static inline size_t countWords(const uint64_t* bits, size_t words) {
+    size_t total = 0;
+    for (size_t w = 0; w < words; ++w) total += static_cast<size_t>(__builtin_popcountll(bits[w]));
+    return total;
+}
+
+__attribute__((always_inline)) static inline size_t countBothWords(const uint64_t* a, const uint64_t* b, size_t words) {
+    size_t total = 0;
+    for (size_t w = 0; w < words; ++w) total += static_cast<size_t>(__builtin_popcountll(a[w] & b[w]));
+    return total;
+}
+
+static void expandScalar(uint64_t* next, const uint64_t* row, const uint64_t* mask, size_t words) {
+    expandWords(next, row, mask, words);
+}
+static bool removeScalar(uint64_t* mask, const uint64_t* bits, size_t words) {
+    return removeWords(mask, bits, words);
+}
+static size_t countScalar(const uint64_t* bits, size_t words) {
+    return countWords(bits, words);
+}
+static size_t countBothScalar(const uint64_t* a, const uint64_t* b, size_t words) {
+    return countBothWords(a, b, words);
+}
+
+static const BitKernels SCALAR_KERNELS = {"scalar", expandScalar, removeScalar, countScalar, countBothScalar};
+
+#ifdef CRS_BIT_SIMD
+
+// Same loops with the popcnt instruction instead of the bit-twiddling fallback
+__attribute__((target("popcnt"))) static size_t countPopcnt(const uint64_t* bits, size_t words) {
+    return countWords(bits, words);
+}
+__attribute__((target("popcnt"))) static size_t countBothPopcnt(const uint64_t* a, const uint64_t* b, size_t words) {
+    return countBothWords(a, b, words);
+}
+
+static const BitKernels POPCNT_KERNELS = {"popcnt", expandScalar, removeScalar, countPopcnt, countBothPopcnt};
+
+// 256 bits at a time; rows are padded to a multiple of four words, so there is no tail
+__attribute__((target("avx2"))) static void expandAvx2(uint64_t* next, const uint64_t* row, const uint64_t* mask, size_t words) {
+    for (size_t w = 0; w < words; w += 4) {
+        __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + w));
+        __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mask + w));
+        __m256i n = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(next + w));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(next + w), _mm256_or_si256(n, _mm256_and_si256(r, m)));
+    }
+}
+
+__attribute__((target("avx2"))) static bool removeAvx2(uint64_t* mask, const uint64_t* bits, size_t words) {
+    __m256i any = _mm256_setzero_si256();
+    for (size_t w = 0; w < words; w += 4) {
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bits + w));
+        __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mask + w));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(mask + w), _mm256_andnot_si256(b, m));
+        any = _mm256_or_si256(any, b);
+    }
+    return !_mm256_testz_si256(any, any);
+}
+
+// Per-byte popcount through a 16-entry nibble table (vpshufb), summed into four 64-bit lanes
+__attribute__((target("avx2"))) static inline __m256i popcountAvx2(__m256i v) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+    __m256i low = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low_nibbles));
+    __m256i high = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles));
+    return _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256());
+}
+
+// Add up the four 64-bit lanes
+__attribute__((target("avx2"))) static inline size_t laneSum(__m256i v) {
+    return static_cast<size_t>(_mm256_extract_epi64(v, 0) + _mm256_extract_epi64(v, 1) +
+                               _mm256_extract_epi64(v, 2) + _mm256_extract_epi64(v, 3));
+}
+
+__attribute__((target("avx2"))) static size_t countAvx2(const uint64_t* bits, size_t words) {
+    __m256i total = _mm256_setzero_si256();
+    for (size_t w = 0; w < words; w += 4) {
+        total = _mm256_add_epi64(total, popcountAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bits + w))));
+    }
+    return laneSum(total);
+}
+
+__attribute__((target("avx2"))) static size_t countBothAvx2(const uint64_t* a, const uint64_t* b, size_t words) {
+    __m256i total = _mm256_setzero_si256();
+    for (size_t w = 0; w < words; w += 4) {
+        __m256i both = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + w)),
+                                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + w)));
+        total = _mm256_add_epi64(total, popcountAvx2(both));
+    }
+    return laneSum(total);
+}
+
+static const BitKernels AVX2_KERNELS = {"avx2", expandAvx2, removeAvx2, countAvx2, countBothAvx2};
+
+#endif
+
+// Best kernels this CPU supports, chosen on first use
+static const BitKernels& kernels() {
+    static const BitKernels& chosen = [] () -> const BitKernels& {
+#ifdef CRS_BIT_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return AVX2_KERNELS;
+        if (__builtin_cpu_supports("popcnt")) return POPCNT_KERNELS;
+#endif
+        return SCALAR_KERNELS;
+    }();
+    return chosen;
+}
+
+// Call fn(row) for every set bit, in increasing order
+template <typename Fn>
+static void forEachBit(const uint64_t* bits, size_t words, Fn fn) {
+    for (size_t w = 0; w < words; ++w) {
+        for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+            fn(static_cast<int>(w * 64 + static_cast<size_t>(__builtin_ctzll(word))));
+        }
+    }
+}
+
+// Set bit i
+static inline void setBit(uint64_t* bits, size_t i) {
+    bits[i / 64] |= uint64_t(1) << (i % 64);
+}
+
+// Clear bit i
+static inline void clearBit(uint64_t* bits, size_t i) {
+    bits[i / 64] &= ~(uint64_t(1) << (i % 64));
+}
+
+const char* BitAdjacency::kernelName() {
+    return kernels().name;
+}
+
+// Rows padded to whole 256-bit blocks
+bool BitAdjacency::allocate(size_t n) {
+    clear();
+    size_t padded = ((n + 63) / 64 + 3) & ~size_t(3);
+    if (n > 0 && padded * sizeof(uint64_t) > MAX_BYTES / n) return false;
+    rows = n;
+    stride = padded;
+    bits.assign(rows * stride, 0);
+    return true;
+}
+
+// Every road sets two bits, one in each endpoint's row
+bool BitAdjacency::build(const RoadStore& roads) {
+    if (!allocate(roads.cityCount())) return false;
+    for (size_t i = 0; i < rows; ++i) {
+        uint64_t* row = bits.data() + i * stride;
+        for (const Road& road : roads.row(static_cast<int>(i))) setBit(row, static_cast<size_t>(road.to));
+    }
+    ready = true;
+    return true;
+}
+
+// Number the region's cities first, then keep only the roads between two of them
+bool BitAdjacency::build(const RoadStore& roads, const vector<int>& region) {
+    vector<int> row_of(roads.cityCount(), -1);
+    vector<int> cities;
+    cities.reserve(region.size());
+    for (int city : region) {
+        if (city < 0 || static_cast<size_t>(city) >= row_of.size() || row_of[city] != -1) continue;
+        row_of[city] = static_cast<int>(cities.size());
+        cities.push_back(city);
+    }
+    if (!allocate(cities.size())) return false;
+    for (size_t i = 0; i < rows; ++i) {
+        uint64_t* row = bits.data() + i * stride;
+        for (const Road& road : roads.row(cities[i])) {
+            if (row_of[road.to] != -1) setBit(row, static_cast<size_t>(row_of[road.to]));
+        }
+    }
+    region_cities = move(cities);
+    region_rows = move(row_of);
+    ready = true;
+    return true;
+}
+
+// Drop the matrix and free its memory
+void BitAdjacency::clear() {
+    ready = false;
+    rows = 0;
+    stride = 0;
+    vector<uint64_t>().swap(bits);
+    region_cities.clear();
+    region_rows.clear();
+}
+
+// Identity for a whole-network matrix
+int BitAdjacency::rowOf(int city) const {
+    if (city < 0) return -1;
+    if (region_cities.empty()) return static_cast<size_t>(city) < rows ? city : -1;
+    return static_cast<size_t>(city) < region_rows.size() ? region_rows[city] : -1;
+}
+
+// Bit-parallel BFS from the lowest unvisited row: each level ORs the frontier's rows masked by
+// the unvisited set, then removes the result from it. Every row is expanded once, so the
+// whole labelling costs rows * words() word operations.
+size_t BitAdjacency::components(vector<int>& component) const {
+    const BitKernels& k = kernels();
+    component.assign(rows, -1);
+    vector<uint64_t> unvisited(stride, 0), frontier(stride), next(stride);
+    for (size_t i = 0; i < rows; ++i) setBit(unvisited.data(), i);
+    size_t count = 0;
+    for (size_t w = 0; w < stride; ++w) {
+        while (unvisited[w] != 0) {
+            size_t start = w * 64 + static_cast<size_t>(__builtin_ctzll(unvisited[w]));
+            fill(frontier.begin(), frontier.end(), 0);
+            setBit(frontier.data(), start);
+            clearBit(unvisited.data(), start);
+            while (true) {
+                fill(next.begin(), next.end(), 0);
+                forEachBit(frontier.data(), stride, [&](int row) {
+                    component[row] = static_cast<int>(count);
+                    k.expand(next.data(), rowBits(row), unvisited.data(), stride);
+                });
+                if (!k.remove(unvisited.data(), next.data(), stride)) break;
+                frontier.swap(next);
+            }
+            ++count;
+        }
+    }
+    return count;
+}
+
+// Same level-by-level expansion, stopped after hops levels
+size_t BitAdjacency::reachableWithin(int row, int hops, vector<uint64_t>& reached) const {
+    const BitKernels& k = kernels();
+    vector<uint64_t> unvisited(stride, 0), frontier(stride, 0), next(stride);
+    for (size_t i = 0; i < rows; ++i) setBit(unvisited.data(), i);
+    setBit(frontier.data(), static_cast<size_t>(row));
+    clearBit(unvisited.data(), static_cast<size_t>(row));
+    for (int level = 0; level < hops; ++level) {
+        fill(next.begin(), next.end(), 0);
+        forEachBit(frontier.data(), stride, [&](int v) { k.expand(next.data(), rowBits(v), unvisited.data(), stride); });
+        if (!k.remove(unvisited.data(), next.data(), stride)) break;
+        frontier.swap(next);
+    }
+    // Reached = valid rows that are no longer unvisited
+    reached.assign(stride, 0);
+    for (size_t i = 0; i < rows / 64; ++i) reached[i] = ~unvisited[i];
+    if (rows % 64 != 0) reached[rows / 64] = ~unvisited[rows / 64] & ((uint64_t(1) << (rows % 64)) - 1);
+    return rows - k.count(unvisited.data(), stride);
+}
+
+// One AND + popcount over the two rows
+size_t BitAdjacency::commonNeighbors(int row1, int row2, vector<int>* neighbours) const {
+    const uint64_t* a = rowBits(row1);
+    const uint64_t* b = rowBits(row2);
+    if (neighbours) {
+        neighbours->clear();
+        for (size_t w = 0; w < stride; ++w) {
+            for (uint64_t word = a[w] & b[w]; word != 0; word &= word - 1) {
+                neighbours->push_back(static_cast<int>(w * 64 + static_cast<size_t>(__builtin_ctzll(word))));
+            }
+        }
+    }
+    return kernels().countBoth(a, b, stride);
+}
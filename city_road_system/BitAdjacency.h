@@ -0,0 +1,70 @@
+#ifndef BIT_ADJACENCY_H
+#define BIT_ADJACENCY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "RoadStore.h"
+
+// Bit-packed adjacency matrix over the whole network or a region of it: one row of 64-bit
+// words per city, bit j of row i set when cities i and j share a road. That is one bit per
+// pair instead of a 4-byte int, 32 times less than an int matrix, and it turns
+// breadth-first search into word-wide bit operations: a BFS level ORs the rows of the
+// frontier cities masked by the not-yet-visited set, so dense regions are searched 64
+// (or 256, with AVX2) cities at a time.
+// The kernels are picked once at runtime: AVX2 with a nibble-table popcount, hardware
+// popcnt on 64-bit words, or portable scalar code. Build with -DCRS_NO_SIMD to keep only
+// the portable kernels.
+// Rows are indexed 0..size()-1 in region order; cityAt/rowOf map them to city indices.
+class BitAdjacency {
+public:
+    // Largest matrix build will make (rows are size() bits each, so this bounds the city count)
+    static const size_t MAX_BYTES = size_t(512) << 20;
+
+    // Build the matrix over every city, returns false if it would exceed MAX_BYTES
+    bool build(const RoadStore& roads);
+    // Build the matrix over the given cities only (roads leaving the region are left out),
+    // returns false if it would exceed MAX_BYTES. Repeated cities are kept once.
+    bool build(const RoadStore& roads, const std::vector<int>& region);
+    // Drop the matrix
+    void clear();
+    // Check if the matrix has been built
+    bool isReady() const { return ready; }
+
+    // Number of rows (cities in the region)
+    size_t size() const { return rows; }
+    // Bytes used by the packed rows
+    size_t memoryBytes() const { return bits.size() * sizeof(uint64_t); }
+    // City index of a row
+    int cityAt(int row) const { return region_cities.empty() ? row : region_cities[row]; }
+    // Row of a city, -1 if it is outside the region
+    int rowOf(int city) const;
+
+    // Label every row with its connected component (numbered in order of their lowest row),
+    // returns the number of components
+    size_t components(std::vector<int>& component) const;
+    // Rows at most hops roads away from a row (itself included) as a bitset of words(), returns their number
+    size_t reachableWithin(int row, int hops, std::vector<uint64_t>& reached) const;
+    // Number of rows adjacent to both rows; if neighbours is given, they are listed in it
+    size_t commonNeighbors(int row1, int row2, std::vector<int>* neighbours = nullptr) const;
+    // Words per row (a multiple of four, so AVX2 loops need no tail)
+    size_t words() const { return stride; }
+
+    // Name of the kernels chosen for this CPU: "avx2", "popcnt" or "scalar"
+    static const char* kernelName();
+
+private:
+    bool ready = false;
+    size_t rows = 0;
+    size_t stride = 0;                // Words per row
+    std::vector<uint64_t> bits;       // rows * stride words, unused bits zero
+    std::vector<int> region_cities;   // City of each row, empty when the region is every city
+    std::vector<int> region_rows;     // Row of each city (-1 outside), empty when the region is every city
+
+    // Allocate zeroed rows for n cities, returns false if too large
+    bool allocate(size_t n);
+    // Pointer to the first word of a row
+    const uint64_t* rowBits(int row) const { return bits.data() + static_cast<size_t>(row) * stride; }
+};
+
+#endif
@@ -1,134 +1,870 @@
 #include "CityRoadSystem.h"
+#include "MappedFile.h"
+#include "Metrics.h"
+#include "NetworkCentrality.h"
+#include "NetworkPlanner.h"
+#include "NetworkRenderer.h"
+#include "Snapshot.h"
+#include "UnionFind.h"
 #include <iostream>
-#include <sstream>
+#include <limits>
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
-// Constructor: Calls loadData to initialize the system from files
+size_t CityRoadSystem::load_threads = 0;
+size_t CityRoadSystem::region_memory_limit = 0;
+
+// Smallest roads.txt chunk worth handing to another thread
+static const size_t PARSE_CHUNK_MIN_BYTES = size_t(64) << 10;
+// Seed of the sampled centrality sources, so that a sampled run repeats
+static const uint64_t CENTRALITY_SEED = 20250117;
+
+// Constructor: Calls loadData to initialize the system from files, then opens the journal for new changes.
+// A journal older than the data files was left by a compaction that could not restart it. If
+// records were written to it after the fold, they were replayed and live only there, so they are
+// folded in now; otherwise it only holds folded records and is emptied.
+// A journal that cannot be matched to the data files is kept aside, neither replayed nor emptied.
 CityRoadSystem::CityRoadSystem() {
     loadData();
+    if (!journal_matched) {
+        string kept = journal_file + ".unmatched";
+        cout << "Warning: " << journal_file << " is older than the data files and cannot be matched to them; it was not replayed";
+        if (rename(journal_file.c_str(), kept.c_str()) != 0) {
+            cout << ". Changes cannot be saved until it is moved away.\n";
+            return; // The journal stays closed, so every change reports that it was not saved
+        }
+        cout << " and is kept as " << kept << ".\n";
+    }
+    journal.open(journal_file);
+    if (journal.generation() < data_generation) {
+        bool restarted = replayed_records > 0 ? foldJournal() : journal.restart(data_generation);
+        if (!restarted) cout << "Warning: could not restart " << journal_file << "; it is replayed again at the next start.\n";
+    }
 }
 
-// Load existing data from cities.txt and roads.txt at startup
+// Take the next line from a file buffer (without its '\n'), like getline on a stream
+static bool nextLine(string_view text, size_t& pos, string_view& line) {
+    if (pos >= text.size()) return false;
+    const char* start = text.data() + pos;
+    const char* newline = static_cast<const char*>(memchr(start, '\n', text.size() - pos));
+    size_t length = newline ? static_cast<size_t>(newline - start) : text.size() - pos;
+    line = string_view(start, length);
+    pos += length + 1;
+    return true;
+}
+
+// Take the field up to the next comma, like getline(ss, field, ',') (empty once the line is used up)
+static string_view nextField(string_view& rest) {
+    size_t comma = rest.find(',');
+    string_view field = rest.substr(0, comma);
+    rest = comma == string_view::npos ? string_view() : rest.substr(comma + 1);
+    return field;
+}
+
+// Parse a budget the way stod does: skip leading whitespace, read the longest numeric prefix
+static bool parseBudget(string_view text, double& value) {
+    const char* first = text.data();
+    const char* last = first + text.size();
+    while (first != last && isspace(static_cast<unsigned char>(*first))) ++first;
+    if (first != last && *first == '+') ++first; // from_chars does not accept a leading '+'
+    auto result = from_chars(first, last, value);
+    return result.ec == errc();
+}
+
+// Load existing data at startup: from the binary snapshot when it mirrors the current
+// cities.txt/roads.txt, otherwise from the CSV files. Then replay the journal.
 void CityRoadSystem::loadData() {
-    // Load cities from cities.txt
-    ifstream city_file(cities_file);
-    if (city_file.is_open()) {
-        string line;
-        getline(city_file, line); // Skip header line "Index,CityName"
-        while (getline(city_file, line)) {
-            stringstream ss(line);
-            string index_str, city_name;
-            getline(ss, index_str, ','); // Read index (not used for loading)
-            getline(ss, city_name, ','); // Read city name
-            cities.push_back(city_name); // Add city to the vector
-        }
-        city_file.close();
-    }
-
-    // Initialize adjacency matrices based on the number of cities
-    size_t n = cities.size();
-    road_matrix.resize(n, vector<int>(n, 0));    // Initialize road matrix with zeros
-    budget_matrix.resize(n, vector<double>(n, 0.0)); // Initialize budget matrix with zeros in billions RWF
+    OperationTimer timer(Operation::loadData);
+    if (!recoverGeneration()) cout << "Warning: could not finish the interrupted compaction of the data files.\n";
+    string error;
+    vector<RoadEdge> boundary;
+    SnapshotSummary summary;
+    struct stat st;
+    shards_enabled = stat((shards_dir + "/manifest.txt").c_str(), &st) == 0; // Stale shards are rewritten at the next compaction
+    if (shards_enabled) loadCityFile(false);
+    if (shards_enabled && regions.open(shards_dir, csvStamp(), cities.size(), boundary, error)) {
+        // Only the boundary roads for now: regions are loaded when their cities are first used
+        roads.build(cities.size(), boundary);
+        snapshot_enabled = stat(snapshot_file.c_str(), &st) == 0;
+    } else {
+        cities = CityTable();
+        regions = RegionShards();
+        snapshot_enabled = loadSnapshot(snapshot_file, csvStamp(), false, cities, roads, error, &summary);
+        if (snapshot_enabled) {
+            loadCityFile(true); // The snapshot has no regions
+        } else {
+            snapshot_enabled = error != "no snapshot file"; // A stale snapshot is rewritten at the next compaction
+            loadCsvFiles();
+        }
+    }
+
+    // Tombstones in the files are the free city slots; aggregates are kept up to date from here on.
+    // From a snapshot they start from its stored sums, so startup does not read every road.
+    for (size_t i = 0; i < cities.size(); ++i) {
+        if (cities.isDeleted(i)) free_city_slots.insert(static_cast<int>(i));
+    }
+    if (summary.budget_sums) {
+        aggregates.restore(roads, summary.budget_sums, summary.total_budget);
+        for (int index : free_city_slots) aggregates.markDeleted(index);
+    } else {
+        rebuildAggregates();
+    }
+
+    // Replay changes made since the data files were last written
+    auto apply = [this](string_view record) { applyJournalRecord(record); };
+    journal_matched = Journal::replay(journal_file, data_generation, apply, replayed_records);
+
+    // A saved routing index is only used if it was built for exactly these roads and budgets; the
+    // snapshot's fingerprint still holds if no record was replayed over it
+    if (stat(route_index_file.c_str(), &st) == 0) {
+        bool unchanged = summary.budget_sums && replayed_records == 0;
+        route_index.load(route_index_file, unchanged ? summary.roads_fingerprint : ContractionHierarchy::fingerprint(roads));
+    }
+}
+
+// Combine size and modification time of both CSV files; a snapshot is only used if this matches
+uint64_t CityRoadSystem::csvStamp() const {
+    uint64_t stamp = 1469598103934665603ULL;
+    for (const string* path : {&cities_file, &roads_file}) {
+        struct stat st;
+        uint64_t parts[3] = {0, 0, 0};
+        if (stat(path->c_str(), &st) == 0) {
+            parts[0] = static_cast<uint64_t>(st.st_size);
+            parts[1] = static_cast<uint64_t>(st.st_mtim.tv_sec);
+            parts[2] = static_cast<uint64_t>(st.st_mtim.tv_nsec);
+        }
+        for (uint64_t part : parts) {
+            stamp = (stamp ^ part) * 1099511628211ULL;
+        }
+    }
+    return stamp;
+}
+
+// Load cities.txt, memory-mapped and parsed in place. A third column names the region of each
+// city; with regions_only, only that column is read (the cities came from the snapshot).
+void CityRoadSystem::loadCityFile(bool regions_only) {
+    MappedFile city_file;
+    if (!city_file.open(cities_file)) return;
+    string_view text = city_file.view();
+    size_t pos = 0;
+    string_view line;
+    nextLine(text, pos, line); // Header line "Index,CityName" or "Index,CityName,Region"
+    bool has_regions = line.find(",Region") != string_view::npos;
+    if (regions_only && !has_regions) return;
+    if (!regions_only) cities.reserve(count(text.begin(), text.end(), '\n') + 1, text.size());
+    int index = 0;
+    while (nextLine(text, pos, line)) {
+        nextField(line); // Read index (not used for loading)
+        string_view city_name = nextField(line); // Read city name
+        if (!regions_only) cities.add(city_name); // Add city to the table and index its name
+        if (has_regions) regions.setRegion(index, nextField(line));
+        ++index;
+    }
+}
+
+// Load cities.txt and roads.txt.
+// Both files are memory-mapped and parsed in place: names and budgets are read
+// from views into the mapping, so no strings are allocated per line.
+void CityRoadSystem::loadCsvFiles() {
+    loadCityFile(false);
 
     // Load roads and budgets from roads.txt
-    ifstream road_file(roads_file);
-    if (road_file.is_open()) {
-        string line;
-        getline(road_file, line); // Skip header line "Road,Budget"
-        while (getline(road_file, line)) {
-            stringstream ss(line);
-            string road, budget_str;
-            getline(ss, road, ',');      // Read road (e.g., "Kigali-Huye")
-            getline(ss, budget_str, ','); // Read budget in billions RWF
-            double budget = stod(budget_str); // Convert budget to double
-
-            // Parse road string to extract city names
-            size_t dash_pos = road.find('-');
-            string city1 = road.substr(0, dash_pos);
-            string city2 = road.substr(dash_pos + 1);
-
-            // Find indices of the cities
-            int idx1 = getCityIndex(city1);
-            int idx2 = getCityIndex(city2);
-            if (idx1 != -1 && idx2 != -1) {
-                // Update matrices (symmetric because roads are bidirectional)
-                road_matrix[idx1][idx2] = road_matrix[idx2][idx1] = 1;
-                budget_matrix[idx1][idx2] = budget_matrix[idx2][idx1] = budget;
+    vector<RoadEdge> edges;
+    vector<RoadLineError> errors;
+    MappedFile road_file;
+    if (road_file.open(roads_file)) {
+        size_t threads = load_threads > 0 ? load_threads : max(1u, thread::hardware_concurrency());
+        parseRoadsText(road_file.view(), threads, edges, errors);
+    }
+    for (size_t i = 0; i < min<size_t>(errors.size(), 10); ++i) {
+        cout << roads_file << " line " << errors[i].line << ": " << errors[i].message << ", skipped.\n";
+    }
+    if (errors.size() > 10) cout << "... and " << (errors.size() - 10) << " more lines of " << roads_file << " skipped.\n";
+    roads.build(cities.size(), edges); // Build the sparse road store in one pass
+}
+
+// Evicting frees nothing while saved versions or concurrent readers still share the rows
+bool CityRoadSystem::evictionAllowed() const {
+    return region_memory_limit > 0 && saved_versions.empty() && !concurrent_readers;
+}
+
+// Room is made for the wanted regions first, evicting the least recently used unpinned others,
+// then each one that is not loaded yet is read from its shard
+void CityRoadSystem::loadRegionsOf(const vector<int>& city_list, bool pin) const {
+    if (!regions.isActive()) return;
+    vector<uint32_t> wanted;
+    for (int city : city_list) {
+        uint32_t region = regions.regionOf(city);
+        if (region != RegionShards::NO_REGION) wanted.push_back(region);
+    }
+    sort(wanted.begin(), wanted.end());
+    wanted.erase(unique(wanted.begin(), wanted.end()), wanted.end());
+    size_t incoming = 0;
+    for (uint32_t region : wanted) {
+        if (!regions.isLoaded(region)) incoming += regions.regionBytes(region);
+    }
+    if (incoming > 0 && evictionAllowed()) {
+        while (regions.loadedBytes() + incoming > region_memory_limit) {
+            uint32_t victim = regions.evictionCandidate(wanted);
+            if (victim == RegionShards::NO_REGION) break; // Everything else is pinned: go over the limit
+            evictRegion(victim);
+        }
+    }
+    for (uint32_t region : wanted) {
+        if (!regions.isLoaded(region)) loadRegion(region);
+        if (!regions.isActive()) return; // A shard was unreadable and roads.txt filled in every region
+        regions.touch(region);
+        if (pin) regions.pin(region);
+    }
+}
+
+// Rows past the last city have no region
+void CityRoadSystem::loadRegionsOfRows(size_t first_row, size_t last_row) const {
+    if (!regions.isActive()) return;
+    vector<int> rows;
+    for (size_t i = first_row; i <= last_row && i < cities.size(); ++i) rows.push_back(static_cast<int>(i));
+    loadRegionsOf(rows, false);
+}
+
+// The store is rebuilt once from the roads in memory and every missing shard, instead of
+// inserting region by region. Nothing shares the rows yet (versions and readers load
+// everything first), so the rebuild is safe. A routing index saved for the whole network can
+// only be matched now.
+void CityRoadSystem::loadAllRegions() const {
+    if (!regions.isActive()) return;
+    vector<uint32_t> missing;
+    size_t incoming = 0;
+    for (uint32_t region = 0; region < regions.regionCount(); ++region) {
+        if (regions.isLoaded(region)) continue;
+        missing.push_back(region);
+        incoming += regions.regionRoads(region);
+    }
+    if (missing.empty()) return;
+    OperationTimer timer(Operation::loadRegion);
+    vector<RoadEdge> edges;
+    edges.reserve(roads.roadCount() + incoming);
+    roads.forEachRoad([&](int i, int j, double budget) { edges.push_back({i, j, budget}); });
+    vector<RoadEdge> region_edges;
+    for (uint32_t region : missing) {
+        if (!regions.readRegion(region, region_edges)) {
+            cout << "Region shard " << regions.regionName(region) << " is unreadable, reading " << roads_file << " instead.\n";
+            loadRegionsFromCsv();
+            break;
+        }
+        edges.insert(edges.end(), region_edges.begin(), region_edges.end());
+    }
+    if (regions.isActive()) {
+        roads.build(cities.size(), edges);
+        rebuildAggregates();
+        for (uint32_t region : missing) regions.setLoaded(region, true);
+    }
+    struct stat st;
+    if (!route_index.isReady() && stat(route_index_file.c_str(), &st) == 0) {
+        route_index.load(route_index_file, ContractionHierarchy::fingerprint(roads));
+    }
+}
+
+// A region is small next to the network, so its roads are inserted one by one
+void CityRoadSystem::loadRegion(uint32_t region) const {
+    OperationTimer timer(Operation::loadRegion);
+    vector<RoadEdge> edges;
+    if (!regions.readRegion(region, edges)) {
+        cout << "Region shard " << regions.regionName(region) << " is unreadable, reading " << roads_file << " instead.\n";
+        loadRegionsFromCsv();
+        return;
+    }
+    for (const RoadEdge& edge : edges) {
+        if (roads.insert(edge.city1, edge.city2, edge.budget)) aggregates.addRoad(edge.city1, edge.city2, edge.budget);
+    }
+    regions.setLoaded(region, true);
+}
+
+// Only roads with both ends in the region leave; boundary roads stay in memory
+void CityRoadSystem::evictRegion(uint32_t region) const {
+    vector<RoadEdge> internal;
+    for (int city : regions.regionCities(region)) {
+        if (regions.regionOf(city) != region) continue; // Deleted or reused since the shards were written
+        for (const Road& road : roads.row(city)) {
+            if (road.to > city && regions.regionOf(road.to) == region) internal.push_back({city, road.to, road.budget});
+        }
+    }
+    for (const RoadEdge& edge : internal) {
+        aggregates.removeRoad(edge.city1, edge.city2, edge.budget);
+        roads.erase(edge.city1, edge.city2);
+    }
+    regions.setLoaded(region, false);
+}
+
+// roads.txt matches the shards (both carry the same stamp), and regions changed since are
+// pinned and loaded, so it supplies exactly the internal roads of the regions not loaded
+void CityRoadSystem::loadRegionsFromCsv() const {
+    vector<RoadEdge> edges;
+    vector<RoadLineError> errors;
+    MappedFile road_file;
+    if (road_file.open(roads_file)) {
+        size_t threads = load_threads > 0 ? load_threads : max(1u, thread::hardware_concurrency());
+        parseRoadsText(road_file.view(), threads, edges, errors);
+    }
+    for (const RoadEdge& edge : edges) {
+        uint32_t region = regions.regionOf(edge.city1);
+        if (region == RegionShards::NO_REGION || region != regions.regionOf(edge.city2) || regions.isLoaded(region)) continue;
+        if (roads.insert(edge.city1, edge.city2, edge.budget)) aggregates.addRoad(edge.city1, edge.city2, edge.budget);
+    }
+    regions.deactivate(); // The next compaction writes fresh shards
+}
+
+// Parse the lines of one chunk of roads.txt; error line numbers count from 0 at the chunk start
+static void parseRoadChunk(string_view text, const CityTable& cities, vector<RoadEdge>& edges,
+                           vector<RoadLineError>& errors, size_t& lines) {
+    edges.reserve(count(text.begin(), text.end(), '\n') + 1);
+    size_t pos = 0;
+    string_view line;
+    for (lines = 0; nextLine(text, pos, line); ++lines) {
+        string_view rest = line;
+        string_view road = nextField(rest);       // Read road (e.g., "Kigali-Huye")
+        string_view budget_str = nextField(rest); // Read budget in billions RWF
+        double budget;
+        if (!parseBudget(budget_str, budget)) {
+            // Blank lines are skipped quietly
+            if (!all_of(line.begin(), line.end(), [](char c) { return isspace(static_cast<unsigned char>(c)); })) {
+                errors.push_back({lines, "no numeric budget"});
             }
+            continue;
+        }
+
+        // Parse road string to extract city names
+        size_t dash_pos = road.find('-');
+        if (dash_pos == string_view::npos) {
+            errors.push_back({lines, "no '-' between the city names"});
+            continue;
+        }
+        string_view city1 = road.substr(0, dash_pos);
+        string_view city2 = road.substr(dash_pos + 1);
+
+        // Find indices of the cities
+        int idx1 = cities.find(city1);
+        int idx2 = cities.find(city2);
+        if (idx1 == -1 || idx2 == -1) {
+            errors.push_back({lines, "unknown city " + string(idx1 == -1 ? city1 : city2)});
+        } else if (idx1 == idx2) {
+            errors.push_back({lines, "road from " + string(city1) + " to itself"});
+        } else {
+            edges.push_back({idx1, idx2, budget}); // Roads are bidirectional, the store keeps both directions
         }
-        road_file.close();
     }
 }
 
-// Check if a city already exists in the cities vector
-bool CityRoadSystem::cityExists(const string& city_name) const {
-    return find(cities.begin(), cities.end(), city_name) != cities.end();
+// Chunks are claimed from a shared counter, so a slow chunk does not hold up the others; about
+// four chunks per thread keeps the threads busy until the end
+void CityRoadSystem::parseRoadsText(string_view text, size_t threads, vector<RoadEdge>& edges,
+                                    vector<RoadLineError>& errors) const {
+    edges.clear();
+    errors.clear();
+    size_t pos = 0;
+    string_view line;
+    nextLine(text, pos, line); // Skip header line "Road,Budget"
+    text.remove_prefix(min(pos, text.size()));
+
+    // Cut at the first newline after each even split point
+    size_t chunk_count = max<size_t>(1, min(threads * 4, text.size() / PARSE_CHUNK_MIN_BYTES));
+    vector<size_t> bounds{0};
+    for (size_t c = 1; c < chunk_count; ++c) {
+        size_t cut = text.find('\n', max(bounds.back(), text.size() / chunk_count * c));
+        if (cut == string_view::npos) break;
+        if (cut + 1 > bounds.back()) bounds.push_back(cut + 1);
+    }
+    bounds.push_back(text.size());
+    chunk_count = bounds.size() - 1;
+
+    vector<vector<RoadEdge>> chunk_edges(chunk_count);
+    vector<vector<RoadLineError>> chunk_errors(chunk_count);
+    vector<size_t> chunk_lines(chunk_count, 0);
+    atomic<size_t> next_chunk{0};
+    auto work = [&]() {
+        for (size_t c; (c = next_chunk.fetch_add(1, memory_order_relaxed)) < chunk_count;) {
+            parseRoadChunk(text.substr(bounds[c], bounds[c + 1] - bounds[c]), cities, chunk_edges[c], chunk_errors[c], chunk_lines[c]);
+        }
+    };
+    vector<thread> workers;
+    for (size_t t = 1; t < min(threads, chunk_count); ++t) workers.emplace_back(work);
+    work(); // This thread parses chunks too
+    for (thread& worker : workers) worker.join();
+
+    // Join the buffers in chunk order, turning chunk line numbers into file line numbers
+    size_t total = 0;
+    for (const vector<RoadEdge>& part : chunk_edges) total += part.size();
+    edges.reserve(total);
+    size_t first_line = 2; // Line 1 is the header
+    for (size_t c = 0; c < chunk_count; ++c) {
+        edges.insert(edges.end(), chunk_edges[c].begin(), chunk_edges[c].end());
+        vector<RoadEdge>().swap(chunk_edges[c]); // Free each buffer once it is copied
+        for (RoadLineError& error : chunk_errors[c]) {
+            error.line += first_line;
+            errors.push_back(move(error));
+        }
+        first_line += chunk_lines[c];
+    }
 }
 
-// Get the index of a city in the cities vector, return -1 if not found
-int CityRoadSystem::getCityIndex(const string& city_name) const {
-    auto it = find(cities.begin(), cities.end(), city_name);
-    if (it == cities.end()) return -1;
-    return distance(cities.begin(), it);
+// Format a budget with the shortest text that reads back to the same value
+static string formatBudget(double budget) {
+    char buffer[32];
+    auto result = to_chars(buffer, buffer + sizeof(buffer), budget);
+    return string(buffer, result.ptr);
 }
 
-// Save the list of cities to cities.txt
-void CityRoadSystem::saveCitiesToFile() const {
-    ofstream file(cities_file);
-    file << "Index,CityName\n"; // Write header
-    for (size_t i = 0; i < cities.size(); ++i) {
-        file << i << "," << cities[i] << "\n"; // Write each city with its index
+// Journal records are tab-separated lines:
+//   C <name>                       add city
+//   N <index> <name>               rename city
+//   R <budget> <city1> <city2>     add road
+//   B <budget> <city1> <city2>     set road budget (0 when the budget is deleted)
+//   D <city1> <city2>              delete road
+//   X <index>                      delete city (and its roads)
+//   F <generation>                 fold marker, nothing to apply
+// Records are not idempotent: X and N name a slot, and slots are reused by later cities. A journal
+// is therefore only replayed over the generation of data files it is stamped with (see Journal).
+bool CityRoadSystem::applyJournalRecord(string_view record) {
+    if (record.size() < 2 || record[1] != '\t') return false;
+    char op = record[0];
+    string_view rest = record.substr(2);
+    size_t tab = rest.find('\t');
+
+    if (op == 'C') {
+        if (rest.empty() || cityExists(rest)) return false;
+        placeCity(rest);
+        return true;
+    }
+    if (op == 'X') {
+        int index;
+        auto result = from_chars(rest.data(), rest.data() + rest.size(), index);
+        if (result.ec != errc() || index < 0 || index >= static_cast<int>(cities.size()) || cities.isDeleted(index)) return false;
+        loadRegionsOf({index}, true);
+        removeCityAt(index);
+        return true;
+    }
+    if (tab == string_view::npos) return false;
+    string_view first = rest.substr(0, tab);
+    rest = rest.substr(tab + 1);
+
+    if (op == 'N') {
+        int index;
+        auto result = from_chars(first.data(), first.data() + first.size(), index);
+        if (result.ec != errc() || index < 0 || index >= static_cast<int>(cities.size())) return false;
+        if (rest.empty() || cityExists(rest)) return false;
+        loadRegionsOf({index}, true); // roads.txt would no longer name this city's roads
+        if (cities.isDeleted(index)) {
+            reviveCity(index, rest); // Written by undo and restore
+        } else {
+            cities.rename(index, rest);
+        }
+        return true;
+    }
+    if (op == 'D') {
+        int idx1 = getCityIndex(first);
+        int idx2 = getCityIndex(rest);
+        if (idx1 == -1 || idx2 == -1) return false;
+        loadRegionsOf({idx1, idx2}, true);
+        if (!roads.hasRoad(idx1, idx2)) return false;
+        removeRoadAt(idx1, idx2);
+        return true;
+    }
+
+    double budget;
+    tab = rest.find('\t');
+    if (tab == string_view::npos || !parseBudget(first, budget)) return false;
+    int idx1 = getCityIndex(rest.substr(0, tab));
+    int idx2 = getCityIndex(rest.substr(tab + 1));
+    if (idx1 == -1 || idx2 == -1) return false;
+    loadRegionsOf({idx1, idx2}, true);
+    if (op == 'R') {
+        if (!roads.insert(idx1, idx2, budget)) return false;
+        aggregates.addRoad(idx1, idx2, budget);
+        return true;
+    }
+    if (op == 'B') {
+        const Road* road = roads.find(idx1, idx2);
+        if (road == nullptr) return false;
+        aggregates.changeBudget(idx1, idx2, road->budget, budget);
+        return roads.setBudget(idx1, idx2, budget);
+    }
+    return false;
+}
+
+// Append the record (durable once the journal commits it) and compact once the journal
+// holds more records than the CSV files have lines, which keeps the rewrite cost amortized O(1).
+// Returns false, after telling the user, if the journal could not be written; the record stays
+// buffered and goes out with the next commit that succeeds.
+bool CityRoadSystem::journalMutation(const string& record) {
+    bool saved = journal.append(record);
+    if (record[0] == 'C' || record[0] == 'N' || record[0] == 'X') cities_changed = true;
+    bit_adjacency.clear();
+    publishVersion();
+    if (!saved) {
+        cout << "Warning: the change could not be written to " << journal_file << " and is not saved yet.\n";
+        return false;
+    }
+    if (journal.recordCount() >= max<size_t>(4096, cities.size() + roads.roadCount())) {
+        foldJournal();
+    }
+    return true;
+}
+
+// Same as journalMutation for a whole batch: one group commit, one published version
+bool CityRoadSystem::journalMutations(const vector<string>& records) {
+    if (records.empty()) return true;
+    bool saved = journal.appendAll(records);
+    bit_adjacency.clear();
+    for (const string& record : records) {
+        if (record[0] == 'C' || record[0] == 'N' || record[0] == 'X') cities_changed = true;
+    }
+    publishVersion();
+    if (!saved) {
+        cout << "Warning: the changes could not be written to " << journal_file << " and are not saved yet.\n";
+        return false;
+    }
+    if (journal.recordCount() >= max<size_t>(4096, cities.size() + roads.roadCount())) {
+        foldJournal();
+    }
+    return true;
+}
+
+// File holding the given generation of a data file until it is moved into place
+static string generationPath(const string& path, uint64_t generation) {
+    return path + "." + to_string(generation);
+}
+
+// Write both CSV files of the next generation next to the current ones, commit them together by
+// replacing city_roads.gen, and restart the journal at once: from the commit on, records must go
+// into a journal stamped with the new generation. Then move the files into place and write the
+// snapshot and the region shards stamped with them. A crash before the commit leaves the old pair
+// in use; after it, the next start finishes the moves (recoverGeneration) and skips the journal,
+// whose stamp is older than the files. The snapshot and the shards only speed up loading, so
+// failing to write them turns them off instead of failing the fold; a stale one is ignored.
+bool CityRoadSystem::foldJournal() {
+    uint64_t generation = max(data_generation, journal.generation()) + 1; // Newer than any journal stamp
+    if (!journal.markFold(generation)) return false;
+    loadAllRegions(); // The CSV files hold every road
+    regions.placeUnassigned(cities, roads);
+    if (!saveCitiesToFile(generationPath(cities_file, generation)) ||
+        !saveRoadsToFile(generationPath(roads_file, generation))) {
+        return false;
     }
+    string temp_file = generation_file + ".tmp";
+    ofstream file(temp_file);
+    file << generation << "\n";
     file.close();
+    if (file.fail() || !durableReplace(temp_file, generation_file)) return false;
+    data_generation = generation;
+    bool restarted = journal.restart(data_generation);
+    if (!recoverGeneration()) return false;
+    if (snapshot_enabled && !writeSnapshot(snapshot_file, cities, roads, csvStamp())) {
+        snapshot_enabled = false;
+        cout << "Warning: could not write " << snapshot_file << "; the data files are loaded without it.\n";
+    }
+    if (shards_enabled && !regions.write(shards_dir, cities, roads, csvStamp())) {
+        regions.deactivate(); // Everything is loaded; keep it that way rather than trust half-written shards
+        shards_enabled = false;
+        cout << "Warning: could not write " << shards_dir << "; the data files are loaded without the shards.\n";
+    }
+    return restarted;
 }
 
-// Save roads and their budgets to roads.txt
-void CityRoadSystem::saveRoadsToFile() const {
-    ofstream file(roads_file);
-    file << "Road,Budget\n"; // Write header
+// Fold the journal into cities.txt and roads.txt
+void CityRoadSystem::compactData() {
+    OperationTimer timer(Operation::compactData);
+    size_t records = journal.recordCount();
+    size_t deleted = saved_versions.empty() ? free_city_slots.size() : 0;
+    if (!(deleted > 0 ? compactCities() : foldJournal())) {
+        cout << "Failed to compact data files.\n";
+        return;
+    }
+    if (deleted > 0) cout << deleted << " deleted city slots removed, remaining cities renumbered.\n";
+    if (!free_city_slots.empty() && !saved_versions.empty()) cout << "Deleted city slots are kept while saved versions exist.\n";
+    cout << "Data files compacted: " << records << " journal records folded into " << cities_file << " and " << roads_file << ".\n";
+}
+
+// Convert the current data to the binary snapshot, then map it back and compare with memory
+void CityRoadSystem::saveSnapshot() {
+    OperationTimer timer(Operation::saveSnapshot);
+    snapshot_enabled = true;
+    if (!foldJournal() || !snapshot_enabled) {
+        cout << "Failed to write binary snapshot " << snapshot_file << ".\n";
+        return;
+    }
+    CityTable check_cities;
+    RoadStore check_roads;
+    string error;
+    if (!loadSnapshot(snapshot_file, csvStamp(), true, check_cities, check_roads, error)) {
+        cout << "Binary snapshot " << snapshot_file << " could not be read back: " << error << ".\n";
+        return;
+    }
+    if (!sameNetwork(cities, roads, check_cities, check_roads)) {
+        cout << "Binary snapshot " << snapshot_file << " does not match the loaded data.\n";
+        return;
+    }
+    cout << "Binary snapshot saved to " << snapshot_file << " (" << (cities.size() - free_city_slots.size()) << " cities, "
+         << roads.roadCount() << " roads) and verified.\n";
+}
+
+// Check if a city already exists using the hash index
+bool CityRoadSystem::cityExists(string_view city_name) const {
+    return cities.contains(city_name);
+}
+
+// Get the index of a city from the hash index, return -1 if not found
+int CityRoadSystem::getCityIndex(string_view city_name) const {
+    return cities.find(city_name);
+}
+
+// The generation in city_roads.gen (0 before the first compaction) decides which files count:
+// data files named with it were committed and are moved over cities.txt/roads.txt, data files of
+// the next generation belong to a compaction that crashed before committing and are removed
+bool CityRoadSystem::recoverGeneration() {
+    ifstream file(generation_file);
+    if (file && !(file >> data_generation)) data_generation = 0;
+    bool moved = true;
+    for (const string* path : {&cities_file, &roads_file}) {
+        string committed = generationPath(*path, data_generation);
+        if (access(committed.c_str(), F_OK) == 0 && !durableReplace(committed, *path)) moved = false;
+        unlink(generationPath(*path, data_generation + 1).c_str());
+    }
+    return moved;
+}
+
+// Save the list of cities (written to a temporary file, then renamed over path)
+bool CityRoadSystem::saveCitiesToFile(const string& path) const {
+    OperationTimer timer(Operation::saveCitiesToFile);
+    string temp_file = path + ".tmp";
+    ofstream file(temp_file);
+    bool with_regions = regions.hasRegions();
+    file << (with_regions ? "Index,CityName,Region\n" : "Index,CityName\n"); // Write header
     for (size_t i = 0; i < cities.size(); ++i) {
-        for (size_t j = i + 1; j < cities.size(); ++j) {
-            if (road_matrix[i][j] == 1) {
-                // Write road and budget in billions RWF (e.g., "Kigali-Huye,5")
-                file << cities[i] << "-" << cities[j] << "," << budget_matrix[i][j] << "\n";
-            }
+        file << i << "," << cities[i]; // Write each city with its index
+        if (with_regions) {
+            uint32_t region = regions.regionOf(static_cast<int>(i));
+            file << "," << (region == RegionShards::NO_REGION ? "" : regions.regionName(region));
         }
+        file << "\n";
     }
+    recordBytesWritten(static_cast<size_t>(max<streamoff>(0, file.tellp())));
+    file.close();
+    return !file.fail() && durableReplace(temp_file, path);
+}
+
+// Save roads and their budgets (written to a temporary file, then renamed over path)
+bool CityRoadSystem::saveRoadsToFile(const string& path) const {
+    OperationTimer timer(Operation::saveRoadsToFile);
+    string temp_file = path + ".tmp";
+    ofstream file(temp_file);
+    file << "Road,Budget\n"; // Write header
+    roads.forEachRoad([&](int i, int j, double budget) {
+        // Write road and budget in billions RWF (e.g., "Kigali-Huye,5")
+        file << cities[i] << "-" << cities[j] << "," << budget << "\n";
+    });
+    recordBytesWritten(static_cast<size_t>(max<streamoff>(0, file.tellp())));
     file.close();
+    return !file.fail() && durableReplace(temp_file, path);
 }
 
-// Add a specified number of cities to the system
+// Add a specified number of cities to the system. The names are collected first and then
+// added as one batch, so the storage grows once and the journal commits once.
 void CityRoadSystem::addCities(int num_cities) {
+    OperationTimer timer(Operation::addCities);
+    vector<string> entered;
+    unordered_set<string> seen;
     for (int i = 0; i < num_cities; ++i) {
         string city_name;
         cout << "Enter city " << (i + 1) << " name: ";
         getline(cin, city_name);
-        if (cityExists(city_name)) {
+        if (city_name.empty()) {
+            cout << "City name cannot be empty.\n";
+            --i; // Retry this iteration
+            continue;
+        }
+        if (city_name.find('\t') != string::npos) {
+            cout << "City name cannot contain a tab.\n"; // Tabs separate the fields of journal records
+            --i; // Retry this iteration
+            continue;
+        }
+        if (cityExists(city_name) || seen.count(city_name)) {
             cout << "City " << city_name << " already exists.\n";
             --i; // Retry this iteration
             continue;
         }
-        cities.push_back(city_name); // Add the new city
+        seen.insert(city_name);
+        entered.push_back(move(city_name));
+    }
+    if (!appendCities(vector<string_view>(entered.begin(), entered.end()))) return;
+    cout << num_cities << " cities added successfully.\n";
+}
+
+// Reserve the final sizes up front, add the names, then journal them as one batch
+bool CityRoadSystem::appendCities(const vector<string_view>& new_names) {
+    if (new_names.empty()) return true;
+    size_t name_bytes = cities.layout().arena_size;
+    for (string_view name : new_names) name_bytes += name.size();
+    cities.reserve(cities.size() + new_names.size(), name_bytes);
+    vector<string> records;
+    records.reserve(new_names.size());
+    saveUndoStep();
+    for (string_view name : new_names) {
+        recordCityUndo(placeCity(name), "");
+        records.push_back("C\t");
+        records.back().append(name);
+    }
+    return journalMutations(records);
+}
 
-        // Resize adjacency matrices to accommodate the new city
-        size_t n = cities.size();
-        road_matrix.resize(n);
-        budget_matrix.resize(n);
-        for (size_t j = 0; j < n; ++j) {
-            road_matrix[j].resize(n, 0);
-            budget_matrix[j].resize(n, 0.0);
+// Reuse the lowest free slot first: replay adds cities in the same order, so it reuses the same slots
+int CityRoadSystem::placeCity(string_view name) {
+    if (!free_city_slots.empty()) {
+        int index = *free_city_slots.begin();
+        free_city_slots.erase(free_city_slots.begin());
+        cities.rename(index, name); // Naming a tombstone revives it
+        aggregates.markRevived(index);
+        regions.clearRegion(index); // A new city joins a region when the shards are next written
+        return index;
+    }
+    int index = cities.add(name);
+    roads.resize(cities.size()); // New cities start with no roads
+    aggregates.resize(cities.size());
+    return index;
+}
+
+// Erase both directions of the road and take its budget out of the aggregates
+void CityRoadSystem::removeRoadAt(int idx1, int idx2) {
+    const Road* road = roads.find(idx1, idx2);
+    if (road == nullptr) return;
+    aggregates.removeRoad(idx1, idx2, road->budget);
+    roads.erase(idx1, idx2);
+}
+
+// The row is copied first because erasing changes it
+void CityRoadSystem::removeCityAt(int index) {
+    RoadStore::RowView row = roads.row(index);
+    vector<int> neighbours;
+    neighbours.reserve(row.size());
+    for (const Road& road : row) neighbours.push_back(road.to);
+    for (int neighbour : neighbours) removeRoadAt(index, neighbour);
+    cities.remove(index);
+    aggregates.markDeleted(index);
+    free_city_slots.insert(index);
+}
+
+// Tombstones are isolated singletons to the union-find; markDeleted takes them out of the counts
+void CityRoadSystem::rebuildAggregates() const {
+    aggregates.rebuild(roads);
+    for (int index : free_city_slots) aggregates.markDeleted(index);
+}
+
+// Persist under the old numbering, renumber in memory, then persist again: the journal is
+// empty at both points, so no record ever refers to indices from before the compaction
+bool CityRoadSystem::compactCities() {
+    if (!foldJournal()) return false;
+    vector<int> new_index(cities.size(), -1);
+    CityTable packed;
+    packed.reserve(cities.size() - free_city_slots.size(), cities.layout().arena_size);
+    for (size_t i = 0; i < cities.size(); ++i) {
+        if (!cities.isDeleted(i)) new_index[i] = packed.add(cities[i]);
+    }
+    vector<RoadEdge> edges;
+    edges.reserve(roads.roadCount());
+    roads.forEachRoad([&](int i, int j, double budget) {
+        edges.push_back({new_index[i], new_index[j], budget});
+    });
+    cities = packed;
+    roads.build(cities.size(), edges);
+    regions.renumber(new_index, cities.size());
+    free_city_slots.clear();
+    undo_steps.clear(); // Their city indices no longer mean the same cities
+    rebuildAggregates();
+    bit_adjacency.clear();
+    invalidateRouteIndex();
+    cities_changed = true;
+    publishVersion();
+    return foldJournal();
+}
+
+// Dedup against the existing cities and within the list through one hash set
+size_t CityRoadSystem::importCities(const vector<string_view>& names) {
+    OperationTimer timer(Operation::importCities);
+    vector<string_view> new_names;
+    new_names.reserve(names.size());
+    unordered_set<string_view> seen;
+    seen.reserve(names.size());
+    for (string_view name : names) {
+        if (!name.empty() && name.find('\t') == string_view::npos && !cityExists(name) && seen.insert(name).second) {
+            new_names.push_back(name);
         }
-        road_matrix[n-1].resize(n, 0);
-        budget_matrix[n-1].resize(n, 0.0);
     }
-    saveCitiesToFile(); // Save the updated city list
-    cout << num_cities << " cities added successfully.\n";
+    if (!appendCities(new_names)) return new_names.size();
+    cout << new_names.size() << " cities imported (" << names.size() - new_names.size()
+         << " skipped: empty, containing a tab, duplicate or already present).\n";
+    return new_names.size();
+}
+
+// Names are views into the mapped file, so nothing is copied until the cities are added
+void CityRoadSystem::importCitiesFromFile(const string& file_name) {
+    OperationTimer timer(Operation::importCitiesFromFile);
+    MappedFile file;
+    if (!file.open(file_name)) {
+        cout << "Could not open city file " << file_name << ".\n";
+        return;
+    }
+    string_view text = file.view();
+    vector<string_view> names;
+    names.reserve(count(text.begin(), text.end(), '\n') + 1);
+    size_t pos = 0;
+    string_view line;
+    while (nextLine(text, pos, line)) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1); // Windows line endings
+        names.push_back(line);
+    }
+    importCities(names);
+}
+
+// Add a single city (used by batch scripts, which have no prompt to retry a name)
+bool CityRoadSystem::addCity(const string& city_name) {
+    OperationTimer timer(Operation::addCity);
+    if (city_name.empty()) {
+        cout << "City name cannot be empty.\n";
+        return false;
+    }
+    if (city_name.find('\t') != string::npos) {
+        cout << "City name cannot contain a tab.\n"; // Tabs separate the fields of journal records
+        return false;
+    }
+    if (cityExists(city_name)) {
+        cout << "City " << city_name << " already exists.\n";
+        return false;
+    }
+    saveUndoStep();
+    recordCityUndo(placeCity(city_name), "");
+    if (journalMutation("C\t" + city_name)) { // Record the new city
+        cout << "City " << city_name << " added successfully.\n";
+    }
+    return true;
 }
 
 // Add a road between two cities with an initial budget in billions RWF (Create operation)
 void CityRoadSystem::addRoad(const string& city1, const string& city2, double budget) {
+    OperationTimer timer(Operation::addRoad);
     if (city1 == city2) {
         cout << "Cannot add a road between the same city.\n";
         return;
@@ -139,7 +875,8 @@ void CityRoadSystem::addRoad(const string& city1, const string& city2, double bu
         cout << "One or both cities not found.\n";
         return;
     }
-    if (road_matrix[idx1][idx2] == 1) {
+    loadRegionsOf({idx1, idx2}, true);
+    if (roads.hasRoad(idx1, idx2)) {
         cout << "Road between " << city1 << " and " << city2 << " already exists.\n";
         return;
     }
@@ -147,37 +884,48 @@ void CityRoadSystem::addRoad(const string& city1, const string& city2, double bu
         cout << "Budget must be positive in billions RWF.\n";
         return;
     }
-    // Set road existence and budget in the matrices (symmetric for bidirectional roads)
-    road_matrix[idx1][idx2] = road_matrix[idx2][idx1] = 1;
-    budget_matrix[idx1][idx2] = budget_matrix[idx2][idx1] = budget;
-    saveRoadsToFile(); // Save the updated road data
+    // Store the road with its budget (both directions for bidirectional roads)
+    saveUndoStep();
+    recordRowUndo(idx1);
+    recordRowUndo(idx2);
+    roads.insert(idx1, idx2, budget);
+    aggregates.addRoad(idx1, idx2, budget);
+    invalidateRouteIndex();
+    if (!journalMutation("R\t" + formatBudget(budget) + "\t" + city1 + "\t" + city2)) return; // Record the new road
     cout << "Road added successfully with budget " << budget << " billion RWF.\n";
 }
 
 // Read the budget for a road between two cities (Read operation)
 void CityRoadSystem::readBudget(const string& city1, const string& city2) const {
+    OperationTimer timer(Operation::readBudget);
     int idx1 = getCityIndex(city1);
     int idx2 = getCityIndex(city2);
     if (idx1 == -1 || idx2 == -1) {
         cout << "One or both cities not found.\n";
         return;
     }
-    if (road_matrix[idx1][idx2] == 0) {
+    // A road between two regions is a boundary road, always loaded, so only a region's own road needs its shard
+    if (regions.regionOf(idx1) == regions.regionOf(idx2)) loadRegionsOf({idx1}, false);
+    const Road* road = roads.find(idx1, idx2);
+    if (road == nullptr) {
         cout << "No road exists between " << city1 << " and " << city2 << ".\n";
         return;
     }
-    cout << "Budget for road " << city1 << " <-> " << city2 << ": " << budget_matrix[idx1][idx2] << " billion RWF\n";
+    cout << "Budget for road " << city1 << " <-> " << city2 << ": " << road->budget << " billion RWF\n";
 }
 
 // Update the budget for an existing road (Update operation)
 void CityRoadSystem::updateBudget(const string& city1, const string& city2, double new_budget) {
+    OperationTimer timer(Operation::updateBudget);
     int idx1 = getCityIndex(city1);
     int idx2 = getCityIndex(city2);
     if (idx1 == -1 || idx2 == -1) {
         cout << "One or both cities not found.\n";
         return;
     }
-    if (road_matrix[idx1][idx2] == 0) {
+    loadRegionsOf({idx1, idx2}, true);
+    const Road* road = roads.find(idx1, idx2);
+    if (road == nullptr) {
         cout << "No road exists between " << city1 << " and " << city2 << " to update budget.\n";
         return;
     }
@@ -185,123 +933,260 @@ void CityRoadSystem::updateBudget(const string& city1, const string& city2, doub
         cout << "Budget must be positive in billions RWF.\n";
         return;
     }
-    // Update the budget in the matrix (symmetric)
-    budget_matrix[idx1][idx2] = budget_matrix[idx2][idx1] = new_budget;
-    saveRoadsToFile(); // Save the updated budget
+    // Update the budget in the road store (symmetric)
+    saveUndoStep();
+    recordRowUndo(idx1);
+    recordRowUndo(idx2);
+    aggregates.changeBudget(idx1, idx2, road->budget, new_budget);
+    roads.setBudget(idx1, idx2, new_budget);
+    invalidateRouteIndex();
+    if (!journalMutation("B\t" + formatBudget(new_budget) + "\t" + city1 + "\t" + city2)) return; // Record the new budget
     cout << "Budget updated successfully to " << new_budget << " billion RWF.\n";
 }
 
 // Delete the budget for a road by setting it to 0 (Delete operation)
 void CityRoadSystem::deleteBudget(const string& city1, const string& city2) {
+    OperationTimer timer(Operation::deleteBudget);
     int idx1 = getCityIndex(city1);
     int idx2 = getCityIndex(city2);
     if (idx1 == -1 || idx2 == -1) {
         cout << "One or both cities not found.\n";
         return;
     }
-    if (road_matrix[idx1][idx2] == 0) {
+    loadRegionsOf({idx1, idx2}, true);
+    const Road* road = roads.find(idx1, idx2);
+    if (road == nullptr) {
         cout << "No road exists between " << city1 << " and " << city2 << " to delete budget.\n";
         return;
     }
     // Reset the budget to 0 (symmetric)
-    budget_matrix[idx1][idx2] = budget_matrix[idx2][idx1] = 0.0;
-    saveRoadsToFile(); // Save the updated budget
+    saveUndoStep();
+    recordRowUndo(idx1);
+    recordRowUndo(idx2);
+    aggregates.changeBudget(idx1, idx2, road->budget, 0.0);
+    roads.setBudget(idx1, idx2, 0.0);
+    invalidateRouteIndex();
+    if (!journalMutation("B\t0\t" + city1 + "\t" + city2)) return; // Record the deleted budget
     cout << "Budget deleted successfully for road " << city1 << " <-> " << city2 << ".\n";
 }
 
+// Delete the road between two cities
+void CityRoadSystem::deleteRoad(const string& city1, const string& city2) {
+    OperationTimer timer(Operation::deleteRoad);
+    int idx1 = getCityIndex(city1);
+    int idx2 = getCityIndex(city2);
+    if (idx1 == -1 || idx2 == -1) {
+        cout << "One or both cities not found.\n";
+        return;
+    }
+    loadRegionsOf({idx1, idx2}, true);
+    if (!roads.hasRoad(idx1, idx2)) {
+        cout << "No road exists between " << city1 << " and " << city2 << " to delete.\n";
+        return;
+    }
+    saveUndoStep();
+    recordRowUndo(idx1);
+    recordRowUndo(idx2);
+    removeRoadAt(idx1, idx2);
+    invalidateRouteIndex();
+    if (!journalMutation("D\t" + city1 + "\t" + city2)) return; // Record the deleted road
+    cout << "Road " << city1 << " <-> " << city2 << " deleted successfully.\n";
+}
+
+// Delete a city and its roads, leaving a tombstone in its slot; compact the table once
+// a quarter of the slots are tombstones
+void CityRoadSystem::deleteCity(int index) {
+    OperationTimer timer(Operation::deleteCity);
+    if (index < 0 || index >= static_cast<int>(cities.size())) {
+        cout << "Invalid index: " << index << ". Must be between 0 and " << (cities.size() - 1) << ".\n";
+        return;
+    }
+    if (cities.isDeleted(index)) {
+        cout << "City at index " << index << " was already deleted.\n";
+        return;
+    }
+    // Its own region first, to know the neighbours; then theirs, whose rows the undo step keeps
+    loadRegionsOf({index}, true);
+    vector<int> touched{index};
+    for (const Road& road : roads.row(index)) touched.push_back(road.to);
+    loadRegionsOf(touched, true);
+    string city_name(cities[index]);
+    size_t road_count = touched.size() - 1;
+    saveUndoStep();
+    recordCityUndo(index, city_name);
+    for (int city : touched) recordRowUndo(city);
+    removeCityAt(index);
+    invalidateRouteIndex();
+    if (!journalMutation("X\t" + to_string(index))) return; // Record the deleted city
+    cout << "City " << city_name << " at index " << index << " deleted along with " << road_count << " roads.\n";
+
+    // Saved versions number cities like the table does now, so the slots are kept while any exist
+    size_t deleted = free_city_slots.size();
+    if (deleted >= 64 && deleted * 4 >= cities.size() && saved_versions.empty()) {
+        if (!compactCities()) {
+            cout << "Failed to compact the city table.\n";
+            return;
+        }
+        cout << "City table compacted: " << deleted << " deleted slots removed, remaining cities renumbered"
+             << " (changes before this point can no longer be undone).\n";
+    }
+}
+
 // Update the name of an existing city using its index
 void CityRoadSystem::updateCityName(int index, const string& new_name) {
+    OperationTimer timer(Operation::updateCityName);
     if (index < 0 || index >= static_cast<int>(cities.size())) {
         cout << "Invalid index: " << index << ". Must be between 0 and " << (cities.size() - 1) << ".\n";
         return;
     }
+    if (cities.isDeleted(index)) {
+        cout << "City at index " << index << " was deleted.\n";
+        return;
+    }
+    if (new_name.empty()) {
+        cout << "City name cannot be empty.\n";
+        return;
+    }
+    if (new_name.find('\t') != string::npos) {
+        cout << "City name cannot contain a tab.\n"; // Tabs separate the fields of journal records
+        return;
+    }
     if (cityExists(new_name)) {
         cout << "City name " << new_name << " already exists.\n";
         return;
     }
-    cities[index] = new_name; // Update the city name at the given index
-    saveCitiesToFile(); // Save the updated city list
-    saveRoadsToFile(); // Update roads file to reflect new city name
+    loadRegionsOf({index}, true); // roads.txt would no longer name this city's roads
+    saveUndoStep();
+    recordCityUndo(index, cities[index]);
+    cities.rename(index, new_name); // Update the city name at the given index and re-index it
+    if (!journalMutation("N\t" + to_string(index) + "\t" + new_name)) return; // Record the rename
     cout << "City name at index " << index << " updated successfully to " << new_name << ".\n";
 }
 
 // Search for a city by its index
 bool CityRoadSystem::searchCity(int index) const {
+    OperationTimer timer(Operation::searchCity);
     if (index < 0 || index >= static_cast<int>(cities.size())) {
         cout << "Invalid index: " << index << ". Must be between 0 and " << (cities.size() - 1) << ".\n";
         return false;
     }
+    if (cities.isDeleted(index)) {
+        cout << "City at index " << index << " was deleted.\n";
+        return false;
+    }
     cout << "City found at index " << index << ": " << cities[index] << "\n";
     return true;
 }
 
 // Display the list of all cities
 void CityRoadSystem::displayCities() const {
+    OperationTimer timer(Operation::displayCities);
     if (cities.empty()) {
         cout << "No cities recorded.\n";
         return;
     }
-    cout << "\nList of Cities:\n";
-    for (size_t i = 0; i < cities.size(); ++i) {
-        cout << "Index: " << i << ", City: " << cities[i] << "\n";
-    }
+    OutputBuffer out(cout);
+    out << "\nList of Cities:\n";
+    NetworkRenderer(cities, roads).cityList(out);
 }
 
 // Display all roads and their budgets
 void CityRoadSystem::displayRoads() const {
-    bool has_roads = false;
-    cout << "\nList of Roads:\n";
-    for (size_t i = 0; i < cities.size(); ++i) {
-        for (size_t j = i + 1; j < cities.size(); ++j) {
-            if (road_matrix[i][j] == 1) {
-                cout << cities[i] << " <-> " << cities[j] << ": Budget = " << budget_matrix[i][j] << " billion RWF\n";
-                has_roads = true;
-            }
-        }
+    OperationTimer timer(Operation::displayRoads);
+    loadAllRegions();
+    OutputBuffer out(cout);
+    out << "\nList of Roads:\n";
+    if (NetworkRenderer(cities, roads).roadList(out) == 0) {
+        out << "No roads recorded.\n";
     }
-    if (!has_roads) {
-        cout << "No roads recorded.\n";
+}
+
+// Display one page of the road list, returns true if more pages follow
+bool CityRoadSystem::displayRoadsPage(int page, int page_size) const {
+    OperationTimer timer(Operation::displayRoadsPage);
+    loadAllRegions();
+    if (page < 1 || page_size < 1) {
+        cout << "Page and page size must be at least 1.\n";
+        return false;
     }
+    size_t total = roads.roadCount();
+    size_t pages = (total + page_size - 1) / page_size;
+    size_t first = static_cast<size_t>(page - 1) * page_size;
+    if (first >= total) {
+        cout << (total == 0 ? "No roads recorded.\n" : "There are only " + to_string(pages) + " pages.\n");
+        return false;
+    }
+    OutputBuffer out(cout);
+    size_t listed = NetworkRenderer(cities, roads).roadList(out, first, page_size);
+    out << "Roads " << first + 1 << "-" << first + listed << " of " << total << " (page " << page << " of " << pages << ")\n";
+    return static_cast<size_t>(page) < pages;
 }
 
 // Display the road and budget adjacency matrices
 void CityRoadSystem::displayAdjacencyMatrices() const {
+    OperationTimer timer(Operation::displayAdjacencyMatrices);
+    loadAllRegions();
     if (cities.empty()) {
         cout << "No cities to display matrices for.\n";
         return;
     }
+    OutputBuffer out(cout);
+    NetworkRenderer renderer(cities, roads);
+    out << "\nRoad Adjacency Matrix:\n";
+    renderer.matrix(out, MatrixWindow(), false);
+    out << "\nBudget Adjacency Matrix:\n";
+    renderer.matrix(out, MatrixWindow(), true);
+}
 
-    // Display road matrix
-    cout << "\nRoad Adjacency Matrix:\n  ";
-    for (const auto& city : cities) {
-        cout << city.substr(0, 3) << " "; // Show first 3 letters of city name for brevity
+// Check a window of city indices, saying what is wrong with it if it is not usable
+static bool makeWindow(int first_row, int last_row, int first_column, int last_column, MatrixWindow& window) {
+    if (first_row < 0 || last_row < 0 || first_column < 0 || last_column < 0) {
+        cout << "City indices cannot be negative.\n";
+        return false;
     }
-    cout << "\n";
-    for (size_t i = 0; i < cities.size(); ++i) {
-        cout << cities[i].substr(0, 3) << " ";
-        for (size_t j = 0; j < cities.size(); ++j) {
-            cout << road_matrix[i][j] << "  ";
-        }
-        cout << "\n";
+    if (first_row > last_row || first_column > last_column) {
+        cout << "The first index of a range cannot come after the last.\n";
+        return false;
     }
+    window = {static_cast<size_t>(first_row), static_cast<size_t>(last_row), static_cast<size_t>(first_column),
+              static_cast<size_t>(last_column)};
+    return true;
+}
 
-    // Display budget matrix
-    cout << "\nBudget Adjacency Matrix:\n  ";
-    for (const auto& city : cities) {
-        cout << city.substr(0, 3) << " ";
-    }
-    cout << "\n";
-    for (size_t i = 0; i < cities.size(); ++i) {
-        cout << cities[i].substr(0, 3) << " ";
-        for (size_t j = 0; j < cities.size(); ++j) {
-            cout << (budget_matrix[i][j] == 0.0 ? "0" : to_string(static_cast<int>(budget_matrix[i][j]))) << (budget_matrix[i][j] == 0.0 ? "  " : " ");
-        }
-        cout << "\n";
+// Display the cells of a window of the road or budget matrix
+void CityRoadSystem::displayMatrixWindow(int first_row, int last_row, int first_column, int last_column,
+                                         bool budgets) const {
+    OperationTimer timer(Operation::displayMatrixWindow);
+    MatrixWindow window;
+    if (!makeWindow(first_row, last_row, first_column, last_column, window)) return;
+    if (static_cast<size_t>(first_row) >= cities.size() || static_cast<size_t>(first_column) >= cities.size()) {
+        cout << "The window starts past the last city (" << cities.size() << " cities).\n";
+        return;
     }
+    loadRegionsOfRows(window.first_row, window.last_row);
+    OutputBuffer out(cout);
+    out << (budgets ? "\nBudget" : "\nRoad") << " Adjacency Matrix, rows " << first_row << "-"
+        << min<size_t>(last_row, cities.size() - 1) << ", columns " << first_column << "-"
+        << min<size_t>(last_column, cities.size() - 1) << ":\n";
+    NetworkRenderer(cities, roads).matrix(out, window, budgets);
+}
+
+// List the roads inside a window of the matrix instead of printing every zero cell
+void CityRoadSystem::displaySparseMatrix(int first_row, int last_row, int first_column, int last_column) const {
+    OperationTimer timer(Operation::displaySparseMatrix);
+    MatrixWindow window;
+    if (!makeWindow(first_row, last_row, first_column, last_column, window)) return;
+    loadRegionsOfRows(window.first_row, window.last_row);
+    OutputBuffer out(cout);
+    out << "\nNon-zero cells, rows " << first_row << "-" << last_row << ", columns " << first_column << "-"
+        << last_column << ":\n";
+    size_t cells = NetworkRenderer(cities, roads).sparseCells(out, window);
+    out << cells << (cells == 1 ? " cell.\n" : " cells.\n");
 }
 
 // Display all recorded data together (cities, roads, road matrix, budget matrix)
 void CityRoadSystem::displayAllData() const {
+    OperationTimer timer(Operation::displayAllData);
     cout << "\n--- All Recorded Data ---\n";
     displayCities(); // Show cities
     displayRoads();  // Show roads and budgets
@@ -310,6 +1195,8 @@ void CityRoadSystem::displayAllData() const {
 
 // Display cities and road adjacency matrix together
 void CityRoadSystem::displayCitiesAndRoadMatrix() const {
+    OperationTimer timer(Operation::displayCitiesAndRoadMatrix);
+    loadAllRegions();
     if (cities.empty()) {
         cout << "No cities recorded.\n";
         return;
@@ -317,43 +1204,1017 @@ void CityRoadSystem::displayCitiesAndRoadMatrix() const {
     cout << "\n--- Cities and Road Adjacency Matrix ---\n";
     displayCities(); // Show cities
     // Show road matrix
-    cout << "\nRoad Adjacency Matrix:\n  ";
-    for (const auto& city : cities) {
-        cout << city.substr(0, 3) << " ";
+    OutputBuffer out(cout);
+    out << "\nRoad Adjacency Matrix:\n";
+    NetworkRenderer(cities, roads).matrix(out, MatrixWindow(), false);
+}
+
+// Generate a Graphviz DOT file for visualization, optionally marking a planned set of roads
+void CityRoadSystem::generateDotFile(const vector<RoadEdge>& planned_roads) const {
+    OperationTimer timer(Operation::generateDotFile);
+    loadAllRegions();
+    ofstream dot_file("city_roads.dot", ios::binary);
+    OutputBuffer out(dot_file);
+    NetworkRenderer(cities, roads).dot(out, planned_roads);
+    out.flush();
+    recordBytesWritten(out.bytesWritten());
+}
+
+// Stream the network to a file in GraphML or as a binary edge list
+void CityRoadSystem::exportNetwork(const string& file_name, bool binary_edges) const {
+    OperationTimer timer(Operation::exportNetwork);
+    loadAllRegions();
+    ofstream file(file_name, ios::binary);
+    if (!file.is_open()) {
+        cout << "Could not open " << file_name << " for writing.\n";
+        return;
+    }
+    OutputBuffer out(file);
+    NetworkRenderer renderer(cities, roads);
+    if (binary_edges) {
+        renderer.edgeList(out);
+    } else {
+        renderer.graphML(out);
     }
-    cout << "\n";
+    bool written = out.flush();
+    recordBytesWritten(out.bytesWritten());
+    file.close();
+    if (!written || file.fail()) {
+        cout << "Could not write " << file_name << ".\n";
+        return;
+    }
+    cout << "Exported " << roads.roadCount() << " roads to " << file_name
+         << (binary_edges ? " as a binary edge list" : " as GraphML") << " (" << out.bytesWritten() << " bytes).\n";
+}
+
+// Generate the Graphviz DOT file and provide instructions to create an image
+void CityRoadSystem::generateGraphImage() const {
+    OperationTimer timer(Operation::generateGraphImage);
+    generateDotFile();
+    cout << "Graphviz DOT file generated as city_roads.dot. Run 'dot -Tpng city_roads.dot -o city_roads.png' to visualize.\n";
+}
+
+// Query the contraction hierarchy if it is ready, otherwise run Dijkstra
+bool CityRoadSystem::routeBetween(int idx1, int idx2, double& cost, vector<int>& path) const {
+    if (route_index.isReady()) return route_index.shortestPath(idx1, idx2, cost, path);
+    return path_engine.shortestPath(roads, idx1, idx2, cost, path);
+}
+
+// Remove the index from memory and disk so a stale one is never loaded
+void CityRoadSystem::invalidateRouteIndex() {
+    if (!route_index.isReady()) return;
+    route_index.clear();
+    unlink(route_index_file.c_str());
+}
+
+// Find the cheapest route between two cities (routing index or Dijkstra over road budgets)
+void CityRoadSystem::findShortestPath(const string& city1, const string& city2) const {
+    OperationTimer timer(Operation::findShortestPath);
+    loadAllRegions();
+    int idx1 = getCityIndex(city1);
+    int idx2 = getCityIndex(city2);
+    if (idx1 == -1 || idx2 == -1) {
+        cout << "One or both cities not found.\n";
+        return;
+    }
+    double cost;
+    vector<int> path;
+    if (!routeBetween(idx1, idx2, cost, path)) {
+        cout << "No route exists between " << city1 << " and " << city2 << ".\n";
+        return;
+    }
+    cout << "Cheapest route: ";
+    for (size_t i = 0; i < path.size(); ++i) {
+        cout << (i > 0 ? " -> " : "") << cities[path[i]];
+    }
+    cout << "\nTotal budget: " << cost << " billion RWF over " << (path.size() - 1) << " roads\n";
+}
+
+// List the cities closest to a city by total road budget
+void CityRoadSystem::findNearestCities(const string& city, int k) const {
+    OperationTimer timer(Operation::findNearestCities);
+    loadAllRegions();
+    int idx = getCityIndex(city);
+    if (idx == -1) {
+        cout << "City " << city << " not found.\n";
+        return;
+    }
+    vector<pair<int, double>> result;
+    path_engine.nearest(roads, idx, k < 0 ? 0 : static_cast<size_t>(k), result);
+    if (result.empty()) {
+        cout << "No cities can be reached from " << city << ".\n";
+        return;
+    }
+    cout << "\nCities nearest to " << city << " by total budget:\n";
+    for (const auto& entry : result) {
+        cout << cities[entry.first] << ": " << entry.second << " billion RWF\n";
+    }
+}
+
+// Answer a file of route queries with one reused engine and a single buffered write
+void CityRoadSystem::answerRouteQueries(const string& query_file, const string& output_file) const {
+    OperationTimer timer(Operation::answerRouteQueries);
+    loadAllRegions();
+    MappedFile queries;
+    if (!queries.open(query_file)) {
+        cout << "Could not open query file " << query_file << ".\n";
+        return;
+    }
+    string out = "From,To,Cost,Route\n";
+    string_view text = queries.view();
+    size_t pos = 0;
+    size_t answered = 0;
+    size_t routed = 0;
+    string_view line;
+    vector<int> path;
+    nextLine(text, pos, line); // Skip header line "From,To"
+    while (nextLine(text, pos, line)) {
+        string_view from = nextField(line);
+        string_view to = nextField(line);
+        if (from.empty() && to.empty()) continue; // Blank line
+        out.append(from).append(",").append(to).append(",");
+        int idx1 = getCityIndex(from);
+        int idx2 = getCityIndex(to);
+        double cost;
+        if (idx1 != -1 && idx2 != -1 && routeBetween(idx1, idx2, cost, path)) {
+            out.append(formatBudget(cost)).append(",");
+            for (size_t i = 0; i < path.size(); ++i) {
+                if (i > 0) out += '-';
+                out.append(cities[path[i]]);
+            }
+            ++routed;
+        } else {
+            out.append("-1,"); // Unknown city or no route
+        }
+        out += '\n';
+        ++answered;
+    }
+    ofstream file(output_file, ios::binary);
+    file.write(out.data(), static_cast<streamsize>(out.size()));
+    file.close();
+    recordBytesWritten(out.size());
+    if (file.fail()) {
+        cout << "Could not write answers to " << output_file << ".\n";
+        return;
+    }
+    cout << answered << " route queries answered (" << routed << " with a route) and written to " << output_file << ".\n";
+}
+
+// Preprocess the roads into a contraction hierarchy and save it next to the data files
+void CityRoadSystem::buildRouteIndex() {
+    OperationTimer timer(Operation::buildRouteIndex);
+    loadAllRegions();
+    route_index.build(roads);
+    if (!route_index.save(route_index_file)) {
+        cout << "Routing index built (" << route_index.shortcutCount() << " shortcuts) but could not be saved to "
+             << route_index_file << ".\n";
+        return;
+    }
+    cout << "Routing index built with " << route_index.shortcutCount() << " shortcuts and saved to " << route_index_file << ".\n";
+}
+
+// Minimum spanning forest over every city, or an approximate Steiner tree over the named cities
+void CityRoadSystem::planMinimumNetwork(const vector<string>& city_names) const {
+    OperationTimer timer(Operation::planMinimumNetwork);
+    loadAllRegions();
+    vector<int> terminals;
+    for (const string& name : city_names) {
+        int idx = getCityIndex(name);
+        if (idx == -1) {
+            cout << "City " << name << " not found.\n";
+            return;
+        }
+        terminals.push_back(idx);
+    }
+    NetworkPlanner planner;
+    vector<RoadEdge> selected;
+    double total = terminals.empty() ? planner.spanningForest(roads, selected) : planner.steinerTree(roads, terminals, selected);
+
+    string report = "\nMinimum-cost road network (" + to_string(selected.size()) + " roads):\n";
+    for (const RoadEdge& road : selected) {
+        report.append(cities[road.city1]).append(" <-> ").append(cities[road.city2]).append(": ");
+        report.append(formatBudget(road.budget)).append(" billion RWF\n");
+    }
+    cout << report;
+    cout << "Total budget: " << total << " billion RWF\n";
+    // Cities that no roads can join stay in separate parts of the plan
+    UnionFind parts(cities.size());
+    for (const RoadEdge& road : selected) parts.unite(road.city1, road.city2);
+    size_t part_count = parts.count();
+    if (!terminals.empty()) {
+        vector<char> seen(cities.size(), 0);
+        part_count = 0;
+        for (int city : terminals) {
+            int part = parts.find(city);
+            if (!seen[part]) ++part_count;
+            seen[part] = 1;
+        }
+    }
+    if (part_count > 1) {
+        cout << "Not all of these cities can be connected by roads: the plan has " << part_count << " separate parts.\n";
+    }
+    generateDotFile(selected);
+    cout << "Planned roads exported to city_roads.dot (bold roads are in the plan).\n";
+}
+
+// Sizes of the bit-packed matrix and of the int matrix it replaces
+static string formatBytes(double bytes) {
+    const char* units[] = {"bytes", "KB", "MB", "GB", "TB"};
+    int unit = 0;
+    while (bytes >= 1024.0 && unit < 4) {
+        bytes /= 1024.0;
+        ++unit;
+    }
+    ostringstream text;
+    text << setprecision(unit == 0 ? 6 : 3) << bytes << " " << units[unit];
+    return text.str();
+}
+
+// Packed rows cost n * n / 8 bytes, so very large networks are refused rather than built
+bool CityRoadSystem::bitAdjacencyReady() const {
+    if (bit_adjacency.isReady()) return true;
+    if (!bit_adjacency.build(roads)) {
+        cout << "The network has " << cities.size() << " cities; the bit-packed adjacency is limited to "
+             << formatBytes(static_cast<double>(BitAdjacency::MAX_BYTES)) << ". Name a region of cities instead.\n";
+        return false;
+    }
+    return true;
+}
+
+// Components from bit-parallel BFS; the largest ten are listed with their first cities
+void CityRoadSystem::findConnectedComponents(const vector<string>& city_names) const {
+    OperationTimer timer(Operation::findConnectedComponents);
+    BitAdjacency region_adjacency;
+    const BitAdjacency* adjacency = &bit_adjacency;
+    if (city_names.empty()) {
+        loadAllRegions();
+        if (!bitAdjacencyReady()) return;
+    } else {
+        vector<int> region;
+        for (const string& name : city_names) {
+            int idx = getCityIndex(name);
+            if (idx == -1) {
+                cout << "City " << name << " not found.\n";
+                return;
+            }
+            region.push_back(idx);
+        }
+        loadRegionsOf(region, false); // Roads leaving the named cities are ignored anyway
+        if (!region_adjacency.build(roads, region)) {
+            cout << "Too many cities for the bit-packed adjacency.\n";
+            return;
+        }
+        adjacency = &region_adjacency;
+    }
+    vector<int> component;
+    vector<vector<int>> members(adjacency->components(component));
+    size_t n = 0;
+    for (size_t row = 0; row < adjacency->size(); ++row) {
+        int city = adjacency->cityAt(static_cast<int>(row));
+        if (cities.isDeleted(city)) continue; // Deleted slots are empty rows, not components
+        members[component[row]].push_back(city);
+        ++n;
+    }
+    members.erase(remove_if(members.begin(), members.end(), [](const vector<int>& m) { return m.empty(); }), members.end());
+    size_t count = members.size();
+    stable_sort(members.begin(), members.end(), [](const vector<int>& a, const vector<int>& b) { return a.size() > b.size(); });
+
+    cout << "\n" << count << " connected component" << (count == 1 ? "" : "s") << " among " << n << " cities.\n";
+    for (size_t c = 0; c < min<size_t>(count, 10); ++c) {
+        cout << "Component " << (c + 1) << ": " << members[c].size() << " cities (";
+        for (size_t i = 0; i < min<size_t>(members[c].size(), 10); ++i) {
+            cout << (i > 0 ? ", " : "") << cities[members[c][i]];
+        }
+        cout << (members[c].size() > 10 ? ", ...)\n" : ")\n");
+    }
+    if (count > 10) cout << "... and " << (count - 10) << " smaller components.\n";
+    cout << "Bit-packed adjacency: " << formatBytes(static_cast<double>(adjacency->memoryBytes())) << " (an int matrix would need "
+         << formatBytes(static_cast<double>(adjacency->size()) * static_cast<double>(adjacency->size()) * sizeof(int)) << "), " << BitAdjacency::kernelName()
+         << " kernels.\n";
+}
+
+// Level-by-level bit-parallel BFS over the whole network
+void CityRoadSystem::findCitiesWithinHops(const string& city, int hops) const {
+    OperationTimer timer(Operation::findCitiesWithinHops);
+    loadAllRegions();
+    int idx = getCityIndex(city);
+    if (idx == -1) {
+        cout << "City " << city << " not found.\n";
+        return;
+    }
+    if (!bitAdjacencyReady()) return;
+    vector<uint64_t> reached;
+    size_t count = bit_adjacency.reachableWithin(bit_adjacency.rowOf(idx), max(hops, 0), reached) - 1;
+    if (count == 0) {
+        cout << "No cities are within " << hops << " roads of " << city << ".\n";
+        return;
+    }
+    string report = "\n" + to_string(count) + " cities within " + to_string(hops) + (hops == 1 ? " road of " : " roads of ") + city + ":\n";
+    for (size_t w = 0; w < reached.size(); ++w) {
+        for (uint64_t word = reached[w]; word != 0; word &= word - 1) {
+            int other = bit_adjacency.cityAt(static_cast<int>(w * 64 + static_cast<size_t>(__builtin_ctzll(word))));
+            if (other != idx) report.append(cities[other]).append("\n");
+        }
+    }
+    cout << report;
+}
+
+// AND of the two packed rows
+void CityRoadSystem::findCommonNeighbors(const string& city1, const string& city2) const {
+    OperationTimer timer(Operation::findCommonNeighbors);
+    int idx1 = getCityIndex(city1);
+    int idx2 = getCityIndex(city2);
+    if (idx1 == -1 || idx2 == -1) {
+        cout << "One or both cities not found.\n";
+        return;
+    }
+    vector<int> shared;
+    if (regions.isActive()) {
+        // Only the two rows are needed, so only their regions are loaded; merge the sorted rows
+        loadRegionsOf({idx1, idx2}, false);
+        RoadStore::RowView row1 = roads.row(idx1);
+        RoadStore::RowView row2 = roads.row(idx2);
+        const Road* a = row1.begin();
+        const Road* b = row2.begin();
+        while (a != row1.end() && b != row2.end()) {
+            if (a->to < b->to) {
+                ++a;
+            } else if (b->to < a->to) {
+                ++b;
+            } else {
+                shared.push_back(a->to);
+                ++a;
+                ++b;
+            }
+        }
+    } else {
+        if (!bitAdjacencyReady()) return;
+        bit_adjacency.commonNeighbors(bit_adjacency.rowOf(idx1), bit_adjacency.rowOf(idx2), &shared);
+        for (int& row : shared) row = bit_adjacency.cityAt(row);
+    }
+    size_t count = shared.size();
+    cout << city1 << " and " << city2 << " have " << count << " common neighbour" << (count == 1 ? "" : "s");
+    for (size_t i = 0; i < shared.size(); ++i) {
+        cout << (i == 0 ? ": " : ", ") << cities[shared[i]];
+    }
+    cout << ".\n";
+}
+
+// Everything here is read from the maintained aggregates, so nothing scans the roads
+void CityRoadSystem::displayNetworkSummary() const {
+    OperationTimer timer(Operation::displayNetworkSummary);
+    loadAllRegions();
+    cout << "\nNetwork summary:\n";
+    cout << "Cities: " << (cities.size() - free_city_slots.size()) << " (" << aggregates.isolatedCount() << " without any road)\n";
+    cout << "Roads: " << aggregates.roadCount() << " with a total budget of " << aggregates.totalBudget() << " billion RWF\n";
+    cout << "Connected components: " << aggregates.componentCount(roads) << " (largest has " << aggregates.largestComponent(roads)
+         << " cities)\n";
+}
+
+// Degree and budget sum of one city
+void CityRoadSystem::displayCityTotals(const string& city) const {
+    OperationTimer timer(Operation::displayCityTotals);
+    int idx = getCityIndex(city);
+    if (idx == -1) {
+        cout << "City " << city << " not found.\n";
+        return;
+    }
+    loadRegionsOf({idx}, false); // Its row is complete once its region is loaded
+    cout << city << ": " << aggregates.degree(idx) << " roads with a total budget of " << aggregates.budgetAt(idx)
+         << " billion RWF\n";
+}
+
+// Most expensive roads first, read from the front of the budget index
+void CityRoadSystem::displayTopRoads(int k) const {
+    OperationTimer timer(Operation::displayTopRoads);
+    loadAllRegions();
+    vector<RoadEdge> top;
+    aggregates.topRoads(roads, k < 0 ? 0 : static_cast<size_t>(k), top);
+    if (top.empty()) {
+        cout << "No roads recorded.\n";
+        return;
+    }
+    string report = "\nTop " + to_string(top.size()) + " roads by budget:\n";
+    for (const RoadEdge& road : top) {
+        report.append(cities[road.city1]).append(" <-> ").append(cities[road.city2]).append(": ");
+        report.append(formatBudget(road.budget)).append(" billion RWF\n");
+    }
+    cout << report;
+}
+
+// One search in the budget index, then a walk over the matching roads
+void CityRoadSystem::displayRoadsInBudgetRange(double low, double high) const {
+    OperationTimer timer(Operation::displayRoadsInBudgetRange);
+    loadAllRegions();
+    vector<RoadEdge> found;
+    aggregates.roadsInRange(roads, low, high, found);
+    if (found.empty()) {
+        cout << "No roads have a budget between " << low << " and " << high << " billion RWF.\n";
+        return;
+    }
+    string report = "\n" + to_string(found.size()) + " roads with a budget between " + formatBudget(low) + " and " +
+                    formatBudget(high) + " billion RWF:\n";
+    for (const RoadEdge& road : found) {
+        report.append(cities[road.city1]).append(" <-> ").append(cities[road.city2]).append(": ");
+        report.append(formatBudget(road.budget)).append(" billion RWF\n");
+    }
+    cout << report;
+}
+
+// Regions are connected when a city of one shares a component with a city of the other
+void CityRoadSystem::checkConnected(const vector<string>& region_a, const vector<string>& region_b) const {
+    OperationTimer timer(Operation::checkConnected);
+    loadAllRegions();
+    auto resolve = [this](const vector<string>& names, vector<int>& indices) {
+        for (const string& name : names) {
+            int idx = getCityIndex(name);
+            if (idx == -1) {
+                cout << "City " << name << " not found.\n";
+                return false;
+            }
+            indices.push_back(idx);
+        }
+        return true;
+    };
+    vector<int> cities_a, cities_b;
+    if (!resolve(region_a, cities_a) || !resolve(region_b, cities_b)) return;
+    if (cities_a.empty() || cities_b.empty()) {
+        cout << "Both regions need at least one city.\n";
+        return;
+    }
+    unordered_map<int, int> component_city; // Component of a city in region A -> that city
+    for (int city : cities_a) component_city.emplace(aggregates.componentOf(roads, city), city);
+    for (int city : cities_b) {
+        auto it = component_city.find(aggregates.componentOf(roads, city));
+        if (it != component_city.end()) {
+            cout << "Connected: " << cities[it->second] << " and " << cities[city] << " are joined by roads.\n";
+            return;
+        }
+    }
+    cout << "Not connected: no road route joins " << (region_a.size() == 1 ? region_a[0] : "the first region")
+         << " to " << (region_b.size() == 1 ? region_b[0] : "the second region") << ".\n";
+}
+
+// Every live city is a source, or a sample of them drawn with a fixed seed. Both CSV files are
+// keyed by city index; betweenness and closeness are written with every digit they have.
+void CityRoadSystem::analyzeCentrality(const string& city_file, int samples, const string& road_file,
+                                       unsigned threads) const {
+    OperationTimer timer(Operation::analyzeCentrality);
+    if (samples < 0) {
+        cout << "The number of sampled cities cannot be negative.\n";
+        return;
+    }
+    loadAllRegions();
+    vector<int> sources;
     for (size_t i = 0; i < cities.size(); ++i) {
-        cout << cities[i].substr(0, 3) << " ";
-        for (size_t j = 0; j < cities.size(); ++j) {
-            cout << road_matrix[i][j] << "  ";
+        if (!cities.isDeleted(i)) sources.push_back(static_cast<int>(i));
+    }
+    size_t population = sources.size();
+    bool sampled = samples > 0 && static_cast<size_t>(samples) < population;
+    if (sampled) {
+        // Partial Fisher-Yates shuffle; sorted again so that each thread's blocks are nearby cities
+        mt19937_64 rng(CENTRALITY_SEED);
+        for (size_t k = 0; k < static_cast<size_t>(samples); ++k) {
+            swap(sources[k], sources[k + rng() % (population - k)]);
         }
-        cout << "\n";
+        sources.resize(static_cast<size_t>(samples));
+        sort(sources.begin(), sources.end());
+    }
+
+    auto start = chrono::steady_clock::now();
+    NetworkCentrality centrality(threads);
+    CentralityScores scores;
+    centrality.compute(roads, sources, population, scores);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    ofstream file(city_file, ios::binary);
+    {
+        OutputBuffer out(file);
+        out << "Index,CityName,Betweenness,Closeness,Reached\n";
+        for (size_t i = 0; i < cities.size(); ++i) {
+            if (cities.isDeleted(i)) continue;
+            double closeness = scores.reached_by[i] == 0 ? 0.0 : scores.reached_by[i] / scores.distance_sum[i];
+            out << i << ',' << cities[i] << ',';
+            out.exact(scores.betweenness[i]) << ',';
+            out.exact(closeness) << ',' << scores.reached_by[i] << '\n';
+        }
+        out.flush();
+        recordBytesWritten(out.bytesWritten());
+    }
+    file.close();
+    if (file.fail()) {
+        cout << "Could not write " << city_file << ".\n";
+        return;
+    }
+    if (!road_file.empty()) {
+        ofstream road_out(road_file, ios::binary);
+        {
+            OutputBuffer out(road_out);
+            out << "Index1,Index2,Budget,Betweenness\n";
+            for (size_t k = 0; k < scores.roads.size(); ++k) {
+                out << scores.roads[k].city1 << ',' << scores.roads[k].city2 << ',';
+                out.exact(scores.roads[k].budget) << ',';
+                out.exact(scores.road_betweenness[k]) << '\n';
+            }
+            out.flush();
+            recordBytesWritten(out.bytesWritten());
+        }
+        road_out.close();
+        if (road_out.fail()) {
+            cout << "Could not write " << road_file << ".\n";
+            return;
+        }
+    }
+
+    cout << "\nCentrality of " << population << " cities from " << sources.size()
+         << (sampled ? " sampled" : "") << " source" << (sources.size() == 1 ? "" : "s") << " in " << seconds << " s on "
+         << centrality.threadCount() << " thread" << (centrality.threadCount() == 1 ? "" : "s") << " ("
+         << scores.steals << " blocks of sources stolen), written to " << city_file
+         << (road_file.empty() ? "" : " and " + road_file) << ".\n";
+    if (sampled) cout << "Betweenness is estimated from the sample and scaled to all cities.\n";
+    // The most central cities and roads
+    vector<size_t> top_cities;
+    for (size_t i = 0; i < cities.size(); ++i) {
+        if (!cities.isDeleted(i) && scores.betweenness[i] > 0.0) top_cities.push_back(i);
+    }
+    size_t shown = min<size_t>(top_cities.size(), 5);
+    partial_sort(top_cities.begin(), top_cities.begin() + shown, top_cities.end(), [&](size_t a, size_t b) {
+        return scores.betweenness[a] > scores.betweenness[b] || (scores.betweenness[a] == scores.betweenness[b] && a < b);
+    });
+    for (size_t k = 0; k < shown; ++k) {
+        cout << "City " << cities[top_cities[k]] << ": betweenness " << scores.betweenness[top_cities[k]] << "\n";
+    }
+    vector<size_t> top_roads(scores.roads.size());
+    iota(top_roads.begin(), top_roads.end(), size_t(0));
+    shown = min<size_t>(top_roads.size(), 5);
+    partial_sort(top_roads.begin(), top_roads.begin() + shown, top_roads.end(), [&](size_t a, size_t b) {
+        return scores.road_betweenness[a] > scores.road_betweenness[b] ||
+               (scores.road_betweenness[a] == scores.road_betweenness[b] && a < b);
+    });
+    for (size_t k = 0; k < shown && scores.road_betweenness[top_roads[k]] > 0.0; ++k) {
+        const RoadEdge& road = scores.roads[top_roads[k]];
+        cout << "Road " << cities[road.city1] << " <-> " << cities[road.city2] << ": betweenness "
+             << scores.road_betweenness[top_roads[k]] << "\n";
+    }
+}
+
+// Deferred: the journal only syncs at checkpoints (or when it is folded into the data files)
+void CityRoadSystem::setDeferredSync(bool deferred) {
+    journal.setSyncEvery(deferred ? numeric_limits<size_t>::max() : 1);
+}
+
+// Write and fsync everything the journal has buffered
+bool CityRoadSystem::checkpoint() {
+    OperationTimer timer(Operation::checkpoint);
+    return journal.commit();
+}
+
+// Copy the city table only when a city changed since the last copy
+shared_ptr<const CityTable> CityRoadSystem::sharedCities() {
+    if (cities_changed || !published_cities) {
+        published_cities = make_shared<const CityTable>(cities);
+        cities_changed = false;
+    }
+    return published_cities;
+}
+
+// The road store copy shares everything that has not been written since
+void CityRoadSystem::publishVersion() {
+    if (!concurrent_readers) return;
+    auto version = make_unique<NetworkVersion>();
+    version->number = ++version_number;
+    version->cities = sharedCities();
+    version->roads = roads;
+    versions.publish(move(version));
+}
+
+// Publish the data as it is now; every later change publishes a new version
+void CityRoadSystem::enableConcurrentReaders() {
+    if (concurrent_readers) return;
+    loadAllRegions(); // Readers see whole versions, so no region is evicted from here on
+    concurrent_readers = true;
+    publishVersion();
+}
+
+// Pin whatever version is current
+NetworkVersions::Reader CityRoadSystem::readSnapshot() const {
+    return NetworkVersions::Reader(versions);
+}
+
+// Budgets are rounded to whole numbers on the private copy, so the total of every version is
+// exact whatever order a reader adds the roads in. The writer records each version's total
+// before publishing it; readers check that totals, road counts and both directions of a road
+// agree with the version they pinned, and that reading it twice gives the same answer.
+void CityRoadSystem::stressTestReaders(int reader_threads, int updates) const {
+    OperationTimer timer(Operation::stressTestReaders);
+    loadAllRegions();
+    if (reader_threads < 1 || updates < 1) {
+        cout << "Reader threads and updates must both be at least 1.\n";
+        return;
+    }
+    vector<RoadEdge> edges;
+    edges.reserve(roads.roadCount());
+    roads.forEachRoad([&edges](int i, int j, double budget) { edges.push_back({i, j, round(budget)}); });
+    if (edges.empty()) {
+        cout << "Add at least one road before running the stress test.\n";
+        return;
+    }
+    RoadStore work;
+    work.build(roads.cityCount(), edges);
+    double total = 0.0;
+    for (const RoadEdge& e : edges) total += e.budget;
+    vector<double> expected_total(static_cast<size_t>(updates) + 1);
+    expected_total[0] = total;
+
+    NetworkVersions test_versions;
+    auto test_cities = make_shared<const CityTable>(cities);
+    auto publish = [&](uint64_t number) {
+        auto version = make_unique<NetworkVersion>();
+        version->number = number;
+        version->cities = test_cities;
+        version->roads = work;
+        test_versions.publish(move(version));
+    };
+    publish(0);
+
+    atomic<bool> done{false};
+    atomic<uint64_t> reads{0}, scans{0}, torn{0}, last_seen{0};
+    vector<thread> readers;
+    for (int t = 0; t < reader_threads; ++t) {
+        readers.emplace_back([&, t] {
+            mt19937 rng(static_cast<unsigned>(t) + 1);
+            uint64_t my_reads = 0, my_scans = 0, my_torn = 0, previous = 0;
+            while (!done.load(memory_order_relaxed)) {
+                NetworkVersions::Reader reader(test_versions);
+                uint64_t number = reader.versionNumber();
+                if (number < previous) ++my_torn; // Versions must never go backwards
+                previous = number;
+                const RoadStore& view = reader.roads();
+                if (my_reads % 64 == 0) {
+                    double sum = 0.0;
+                    size_t count = 0;
+                    view.forEachRoad([&](int, int, double budget) {
+                        sum += budget;
+                        ++count;
+                    });
+                    if (sum != expected_total[number] || count != edges.size()) ++my_torn;
+                    ++my_scans;
+                } else {
+                    const RoadEdge& e = edges[rng() % edges.size()];
+                    const Road* forward = view.find(e.city1, e.city2);
+                    const Road* backward = view.find(e.city2, e.city1);
+                    if (!forward || !backward || forward->budget != backward->budget) {
+                        ++my_torn;
+                    } else {
+                        double first = forward->budget;
+                        const RoadEdge& other = edges[rng() % edges.size()];
+                        view.find(other.city1, other.city2); // Give the writer time to move on
+                        const Road* again = view.find(e.city1, e.city2);
+                        if (!again || again->budget != first) ++my_torn;
+                    }
+                }
+                ++my_reads;
+            }
+            reads += my_reads;
+            scans += my_scans;
+            torn += my_torn;
+            uint64_t seen = last_seen.load();
+            while (previous > seen && !last_seen.compare_exchange_weak(seen, previous)) {}
+        });
+    }
+
+    // Writer: random roads get random whole budgets, one published version per change
+    auto start = chrono::steady_clock::now();
+    mt19937 rng(12345);
+    vector<double> budgets(edges.size());
+    for (size_t k = 0; k < edges.size(); ++k) budgets[k] = edges[k].budget;
+    for (int u = 1; u <= updates; ++u) {
+        size_t k = rng() % edges.size();
+        double budget = static_cast<double>(1 + rng() % 1000);
+        total += budget - budgets[k];
+        budgets[k] = budget;
+        work.setBudget(edges[k].city1, edges[k].city2, budget);
+        expected_total[u] = total;
+        publish(static_cast<uint64_t>(u));
+    }
+    done = true;
+    for (thread& reader : readers) reader.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Stress test: " << reader_threads << " reader threads made " << reads << " reads ("
+         << scans << " full scans) while " << updates << " versions were published in " << seconds << " s ("
+         << static_cast<uint64_t>(reads / max(seconds, 1e-9)) << " reads/s, newest version seen " << last_seen << ").\n";
+    if (torn == 0) {
+        cout << "No torn reads: every reader saw exactly one consistent version at a time.\n";
+    } else {
+        cout << torn << " inconsistent reads found.\n";
+    }
+}
+
+// The step fills up as the change records its rows and city names
+void CityRoadSystem::saveUndoStep() {
+    undo_steps.emplace_back();
+    if (undo_steps.size() > UNDO_LIMIT) undo_steps.pop_front();
+}
+
+// Rows are captured before the change writes them, so the store copies them from here on
+void CityRoadSystem::recordRowUndo(int city) {
+    if (!undo_steps.empty()) undo_steps.back().rows.emplace_back(city, roads.sharedRow(city));
+}
+
+// Slots are listed in the order the change touched them
+void CityRoadSystem::recordCityUndo(int index, string_view old_name) {
+    if (!undo_steps.empty()) undo_steps.back().city_names.emplace_back(index, string(old_name));
+}
+
+// The slot has no roads, so only the name and the counts change
+void CityRoadSystem::reviveCity(int index, string_view name) {
+    cities.rename(index, name);
+    free_city_slots.erase(index);
+    aggregates.markRevived(index);
+}
+
+// City slots first: a slot is renamed in place when its old name is free, otherwise it is
+// tombstoned and named again once every slot has let go of its current name. Then the roads:
+// the store diff lists only what differs, and the target store is adopted whole, so the
+// restored network keeps sharing its chunks with the version it came from. Every step goes
+// to the journal as an ordinary record, so replay ends in the same state.
+size_t CityRoadSystem::restoreState(const RoadStore& target_roads, const vector<pair<int, string>>& city_names,
+                                    bool record_undo, size_t& city_changes) {
+    vector<string> records;
+    vector<pair<int, string_view>> revive;
+    vector<RoadChange> changes;
+    if (record_undo) {
+        // Only rows that differ between now and the target change for good
+        RoadStore::diff(roads, target_roads, changes);
+        unordered_set<int> touched;
+        for (const RoadChange& change : changes) {
+            for (int city : {change.city1, change.city2}) {
+                if (touched.insert(city).second) recordRowUndo(city);
+            }
+        }
+    }
+    city_changes = 0;
+    for (const auto& [index, name] : city_names) {
+        if (cities[index] == name) continue;
+        ++city_changes;
+        if (record_undo) recordCityUndo(index, cities[index]);
+        if (!cities.isDeleted(index) && !name.empty() && !cityExists(name)) {
+            cities.rename(index, name);
+            records.push_back("N\t" + to_string(index) + "\t" + name);
+            continue;
+        }
+        if (!cities.isDeleted(index)) {
+            removeCityAt(index);
+            records.push_back("X\t" + to_string(index));
+        }
+        if (!name.empty()) revive.emplace_back(index, name);
+    }
+    for (const auto& [index, name] : revive) {
+        reviveCity(index, name);
+        records.push_back("N\t" + to_string(index) + "\t" + string(name));
+    }
+
+    RoadStore::diff(roads, target_roads, changes);
+    for (const RoadChange& change : changes) {
+        string names = string(cities[change.city1]) + "\t" + string(cities[change.city2]);
+        if (change.before && change.after) {
+            aggregates.changeBudget(change.city1, change.city2, *change.before, *change.after);
+            records.push_back("B\t" + formatBudget(*change.after) + "\t" + names);
+        } else if (change.before) {
+            aggregates.removeRoad(change.city1, change.city2, *change.before);
+            records.push_back("D\t" + names);
+        } else {
+            aggregates.addRoad(change.city1, change.city2, *change.after);
+            records.push_back("R\t" + formatBudget(*change.after) + "\t" + names);
+        }
+    }
+    roads = target_roads;
+    roads.resize(cities.size()); // Slots added since are tombstones by now
+    if (!changes.empty()) invalidateRouteIndex();
+    journalMutations(records);
+    return changes.size();
+}
+
+// Save the current network under a name
+void CityRoadSystem::saveVersion(const string& name) {
+    OperationTimer timer(Operation::saveVersion);
+    loadAllRegions();
+    if (name.empty() || name == "current") {
+        cout << "Version name cannot be empty or \"current\".\n";
+        return;
+    }
+    bool replaced = saved_versions.count(name) > 0;
+    saved_versions[name] = SavedVersion{sharedCities(), roads};
+    cout << "Version " << name << (replaced ? " replaced" : " saved") << " (" << (cities.size() - free_city_slots.size())
+         << " cities, " << roads.roadCount() << " roads).\n";
+}
+
+// Compare every slot only when the city table changed since the version was saved
+void CityRoadSystem::restoreVersion(const string& name) {
+    OperationTimer timer(Operation::restoreVersion);
+    loadAllRegions();
+    auto it = saved_versions.find(name);
+    if (it == saved_versions.end()) {
+        cout << "No saved version named " << name << ".\n";
+        return;
+    }
+    const SavedVersion& version = it->second;
+    vector<pair<int, string>> city_names;
+    if (cities_changed || version.cities != published_cities) {
+        for (size_t i = 0; i < cities.size(); ++i) {
+            string_view target = i < version.cities->size() ? (*version.cities)[i] : string_view();
+            if (cities[i] != target) city_names.emplace_back(static_cast<int>(i), string(target));
+        }
+    }
+    saveUndoStep();
+    size_t city_changes;
+    size_t road_changes = restoreState(version.roads, city_names, true, city_changes);
+    cout << "Version " << name << " restored: " << road_changes << " roads and " << city_changes << " cities changed.\n";
+}
+
+// Only the delta chunks that differ between the two road stores are compared
+void CityRoadSystem::diffVersions(const string& from, const string& to) const {
+    OperationTimer timer(Operation::diffVersions);
+    loadAllRegions();
+    const CityTable* tables[2] = {&cities, &cities};
+    const RoadStore* stores[2] = {&roads, &roads};
+    const string* names[2] = {&from, &to};
+    for (int k = 0; k < 2; ++k) {
+        if (*names[k] == "current") continue;
+        auto it = saved_versions.find(*names[k]);
+        if (it == saved_versions.end()) {
+            cout << "No saved version named " << *names[k] << ".\n";
+            return;
+        }
+        tables[k] = it->second.cities.get();
+        stores[k] = &it->second.roads;
+    }
+    vector<RoadChange> changes;
+    RoadStore::diff(*stores[0], *stores[1], changes);
+    size_t added = 0, removed = 0, changed = 0;
+    cout << "\nRoad changes from " << from << " to " << to << ":\n";
+    for (const RoadChange& change : changes) {
+        const CityTable& names_from = change.before ? *tables[0] : *tables[1]; // Removed cities keep their old names
+        cout << (change.before && change.after ? "  ~ " : change.before ? "  - " : "  + ") << names_from[change.city1]
+             << " <-> " << names_from[change.city2] << ": ";
+        if (change.before && change.after) {
+            cout << *change.before << " -> " << *change.after << " billion RWF\n";
+            ++changed;
+        } else if (change.before) {
+            cout << *change.before << " billion RWF\n";
+            ++removed;
+        } else {
+            cout << *change.after << " billion RWF\n";
+            ++added;
+        }
+    }
+    cout << added << " roads added, " << removed << " removed, " << changed << " budgets changed.\n";
+}
+
+// Drop a saved version; chunks no other version shares are freed
+void CityRoadSystem::deleteVersion(const string& name) {
+    OperationTimer timer(Operation::deleteVersion);
+    if (saved_versions.erase(name) == 0) {
+        cout << "No saved version named " << name << ".\n";
+        return;
+    }
+    cout << "Version " << name << " deleted.\n";
+}
+
+// List the saved versions and how many changes can be undone
+void CityRoadSystem::listVersions() const {
+    OperationTimer timer(Operation::listVersions);
+    if (saved_versions.empty()) cout << "No saved versions.\n";
+    for (const auto& [name, version] : saved_versions) {
+        size_t live = 0;
+        for (size_t i = 0; i < version.cities->size(); ++i) live += version.cities->isDeleted(i) ? 0 : 1;
+        cout << "Version " << name << ": " << live << " cities, " << version.roads.roadCount() << " roads\n";
     }
+    cout << undo_steps.size() << " changes can be undone.\n";
 }
 
-// Generate a Graphviz DOT file for visualization
-void CityRoadSystem::generateDotFile() const {
-    ofstream dot_file("city_roads.dot");
-    dot_file << "digraph city_roads {\n";
-    dot_file << "    rankdir=LR;\n"; // Set layout direction to left-to-right
-    // Add nodes (cities)
+// Restore the state before the last change, journaling the way back
+void CityRoadSystem::undoLastChange() {
+    OperationTimer timer(Operation::undoLastChange);
+    if (undo_steps.empty()) {
+        cout << "Nothing to undo.\n";
+        return;
+    }
+    UndoStep step = move(undo_steps.back());
+    undo_steps.pop_back();
+    reverse(step.city_names.begin(), step.city_names.end()); // Last touched, first restored
+    vector<int> touched;
+    for (const auto& row : step.rows) touched.push_back(row.first);
+    loadRegionsOf(touched, true); // The rows come back whole, so their regions must be in memory
+    RoadStore target = roads; // Shares everything but the rows put back
+    target.restoreRows(step.rows);
+    size_t city_changes;
+    size_t road_changes = restoreState(target, step.city_names, false, city_changes);
+    cout << "Last change undone: " << road_changes << " roads and " << city_changes << " cities restored.\n";
+}
+
+// The journal is folded with the shards enabled, so cities.txt gets its Region column and the
+// shard directory is written in the same pass
+void CityRoadSystem::buildRegionShards(int cities_per_region) {
+    OperationTimer timer(Operation::buildRegionShards);
+    if (cities_per_region < 0) {
+        cout << "The number of cities per region cannot be negative.\n";
+        return;
+    }
+    loadAllRegions();
+    if (cities_per_region == 0 && !regions.hasRegions()) {
+        cout << cities_file << " has no Region column; give a number of cities per region to partition the network.\n";
+        return;
+    }
+    if (cities_per_region > 0) regions.partition(cities, roads, static_cast<size_t>(cities_per_region));
+    shards_enabled = true;
+    if (!foldJournal() || !shards_enabled) {
+        cout << "Failed to write the region shards.\n";
+        return;
+    }
+    size_t boundary = 0;
+    roads.forEachRoad([&](int i, int j, double) {
+        if (regions.regionOf(i) != regions.regionOf(j)) ++boundary;
+    });
+    size_t largest = 0;
+    for (uint32_t region = 0; region < regions.regionCount(); ++region) {
+        largest = max(largest, regions.regionCities(region).size());
+    }
+    cout << regions.regionCount() << " region" << (regions.regionCount() == 1 ? "" : "s") << " written to " << shards_dir
+         << " (largest " << largest << " cities), " << boundary << " of " << roads.roadCount() << " roads cross regions.\n";
+}
+
+// Cities are counted from the current assignment; roads come from memory for loaded regions
+// and from the manifest for the others, so nothing is loaded to list them
+void CityRoadSystem::displayRegions() const {
+    OperationTimer timer(Operation::displayRegions);
+    if (!regions.hasRegions()) {
+        cout << "No regions. Add a Region column to " << cities_file << " or build region shards.\n";
+        return;
+    }
+    vector<size_t> city_count(regions.regionCount(), 0);
+    vector<size_t> road_count(regions.regionCount(), 0);
     for (size_t i = 0; i < cities.size(); ++i) {
-        dot_file << "    " << i << " [label=\"" << cities[i] << "\"];\n";
+        uint32_t region = regions.regionOf(static_cast<int>(i));
+        if (region == RegionShards::NO_REGION || cities.isDeleted(i)) continue;
+        ++city_count[region];
+        if (!regions.isLoaded(region)) continue;
+        for (const Road& road : roads.row(static_cast<int>(i))) {
+            if (road.to > static_cast<int>(i) && regions.regionOf(road.to) == region) ++road_count[region];
+        }
+    }
+    cout << "\n" << regions.regionCount() << " region" << (regions.regionCount() == 1 ? "" : "s")
+         << (regions.isActive() ? ", sharded in " + shards_dir : ", not sharded") << ":\n";
+    for (uint32_t region = 0; region < regions.regionCount(); ++region) {
+        bool loaded = regions.isLoaded(region);
+        cout << regions.regionName(region) << ": " << city_count[region] << " cities, "
+             << (loaded ? road_count[region] : regions.regionRoads(region)) << " internal roads";
+        if (regions.isActive()) cout << (!loaded ? ", on disk" : regions.isPinned(region) ? ", loaded, changed" : ", loaded");
+        cout << "\n";
+    }
+    if (regions.isActive()) {
+        cout << "Region roads in memory: " << formatBytes(static_cast<double>(regions.loadedBytes()));
+        if (region_memory_limit > 0) {
+            cout << " (limit " << formatBytes(static_cast<double>(region_memory_limit)) << ")";
+        }
+        cout << ".\n";
     }
-    // Add edges (roads) with budgets as labels in billions RWF
+}
+
+// Only this region is loaded; its roads to other regions are boundary roads and already in memory
+void CityRoadSystem::displayRegion(const string& region_name) const {
+    OperationTimer timer(Operation::displayRegion);
+    uint32_t region = regions.findRegion(region_name);
+    if (region == RegionShards::NO_REGION) {
+        cout << "Region " << region_name << " not found.\n";
+        return;
+    }
+    vector<int> members;
     for (size_t i = 0; i < cities.size(); ++i) {
-        for (size_t j = i + 1; j < cities.size(); ++j) {
-            if (road_matrix[i][j] == 1) {
-                dot_file << "    " << i << " -> " << j << " [label=\"" << budget_matrix[i][j] << " billion RWF\", dir=both];\n";
+        if (regions.regionOf(static_cast<int>(i)) == region && !cities.isDeleted(i)) members.push_back(static_cast<int>(i));
+    }
+    loadRegionsOf(members, false);
+    OutputBuffer out(cout);
+    out << "\nRegion " << region_name << ": " << members.size() << (members.size() == 1 ? " city\n" : " cities\n");
+    for (int city : members) out << "Index: " << city << ", City: " << cities[city] << '\n';
+    size_t internal = 0;
+    size_t leaving = 0;
+    for (int city : members) {
+        for (const Road& road : roads.row(city)) {
+            if (regions.regionOf(road.to) != region) {
+                ++leaving;
+            } else if (road.to > city) {
+                out << cities[city] << " <-> " << cities[road.to] << ": Budget = " << road.budget << " billion RWF\n";
+                ++internal;
             }
         }
     }
-    dot_file << "}\n";
-    dot_file.close();
+    out << internal << " internal road" << (internal == 1 ? "" : "s") << ", " << leaving << " road"
+        << (leaving == 1 ? "" : "s") << " to other regions.\n";
 }
 
-// Generate the Graphviz DOT file and provide instructions to create an image
-void CityRoadSystem::generateGraphImage() const {
-    generateDotFile();
-    cout << "Graphviz DOT file generated as city_roads.dot. Run 'dot -Tpng city_roads.dot -o city_roads.png' to visualize.\n";
-}
\ No newline at end of file
+// Operation metrics are process-wide, so this shows the calls of every thread and system instance
+void CityRoadSystem::displayOperationStats() const {
+    printMetrics(cout);
+}
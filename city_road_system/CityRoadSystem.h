@@ -1,39 +1,213 @@
+#ifndef CITY_ROAD_SYSTEM_H
+#define CITY_ROAD_SYSTEM_H
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <fstream>
+#include "BitAdjacency.h"
+#include "CityTable.h"
+#include "ContractionHierarchy.h"
+#include "Journal.h"
+#include "NetworkAggregates.h"
+#include "NetworkVersions.h"
+#include "PathEngine.h"
+#include "RegionShards.h"
+#include "RoadStore.h"
+
+// A roads.txt line that was skipped while loading
+struct RoadLineError {
+    size_t line;          // Line number in roads.txt, counting the header as line 1
+    std::string message;  // What is wrong with it
+};
 
 // Class to manage a network of cities and roads with budgets in RWF (billions)
 class CityRoadSystem {
 private:
-    // Vector to store city names (e.g., "Kigali", "Huye")
-    std::vector<std::string> cities;
-    // Adjacency matrix for roads: road_matrix[i][j] = 1 if a road exists between city i and city j, 0 otherwise
-    std::vector<std::vector<int>> road_matrix;
-    // Adjacency matrix for budgets: budget_matrix[i][j] holds the budget in billions RWF for the road between city i and city j
-    std::vector<std::vector<double>> budget_matrix;
+    // Interned city names (e.g., "Kigali", "Huye") with a hash index from name to city index
+    CityTable cities;
+    // Sparse road store: roads[i] lists the cities connected to city i with the road budget in billions RWF.
+    // Mutable, like the aggregates, because regions are loaded into it on first use (see regions).
+    mutable RoadStore roads;
+    // Threads used to parse roads.txt, 0 for one per core (set before constructing a system)
+    static size_t load_threads;
+    // Bytes of region roads kept loaded before cold regions are evicted, 0 for no limit
+    static size_t region_memory_limit;
     // File names for persisting data
     const std::string cities_file = "cities.txt"; // Stores city names with indices
     const std::string roads_file = "roads.txt";   // Stores roads and their budgets in billions RWF
+    const std::string journal_file = "city_roads.journal"; // Mutations made since cities.txt/roads.txt were last written
+    const std::string snapshot_file = "city_roads.snap";    // Binary snapshot mirroring cities.txt/roads.txt for fast startup
+    const std::string route_index_file = "city_roads.ch";   // Saved routing index, only used while it matches the roads
+    const std::string shards_dir = "city_roads.shards";      // Region shards, only used while they match cities.txt/roads.txt
+    const std::string generation_file = "city_roads.gen";    // Generation of cities.txt/roads.txt; replacing it commits a compaction
+    // Generation of the current cities.txt/roads.txt pair, one more with every compaction
+    uint64_t data_generation = 0;
+    // Journal records replayed at startup; from a journal older than the data files, these were
+    // written after a fold and are not in the data files yet
+    size_t replayed_records = 0;
+    // False if the journal was older than the data files without a fold marker for them
+    bool journal_matched = true;
+    // Keep the binary snapshot up to date when the CSV files are rewritten (set once a snapshot exists)
+    bool snapshot_enabled = false;
+    // Keep the region shards up to date when the CSV files are rewritten (set once shards exist)
+    bool shards_enabled = false;
+    // Route query engine; reuses its scratch buffers across queries
+    mutable PathEngine path_engine;
+    // Contraction hierarchy routing index, built on request and dropped whenever a road changes
+    mutable ContractionHierarchy route_index;
+    // Bit-packed adjacency of the whole network for the connectivity queries, built on first use
+    // and dropped on every change
+    mutable BitAdjacency bit_adjacency;
+    // Components, per-city sums and the budget index, updated by every road change (and by
+    // regions being loaded or evicted)
+    mutable NetworkAggregates aggregates;
+    // Region of every city, and with shards, which regions are loaded. While shards are in use,
+    // only the boundary roads and the loaded regions are in roads: operations load the regions
+    // of the cities they touch, or every region when they need the whole network.
+    mutable RegionShards regions;
+    // Named versions: the city table as it was (shared with later versions and readers until a
+    // city changes) and a copy of the roads that shares every chunk not written since
+    struct SavedVersion {
+        std::shared_ptr<const CityTable> cities;
+        RoadStore roads;
+    };
+    std::map<std::string, SavedVersion> saved_versions;
+    // One change that can be undone: the rows it rewrote as they were before (shared with the
+    // road store, not copied, when they had been rewritten already) and the name each city slot
+    // it touched had before ("" for none)
+    struct UndoStep {
+        std::vector<std::pair<int, std::shared_ptr<const std::vector<Road>>>> rows;
+        std::vector<std::pair<int, std::string>> city_names;
+    };
+    static const size_t UNDO_LIMIT = 64;
+    std::deque<UndoStep> undo_steps;
+    // Slots of deleted cities, reused lowest first by new cities so that journal replay
+    // assigns the same indices; emptied when the city table is compacted
+    std::set<int> free_city_slots;
+    // Write-ahead journal: every change is appended here instead of rewriting the CSV files
+    Journal journal;
+    // Versions published to concurrent readers after every change, once enableConcurrentReaders is called
+    NetworkVersions versions;
+    bool concurrent_readers = false;
+    // City table shared by published versions until a city is added or renamed
+    std::shared_ptr<const CityTable> published_cities;
+    bool cities_changed = true;
+    uint64_t version_number = 0;
+
+    // The benchmark suite (bench.cpp) times some private helpers directly
+    friend class CityRoadSystemBench;
 
     // Helper methods (private to encapsulate internal logic)
-    // Check if a city exists in the cities vector
-    bool cityExists(const std::string& city_name) const;
-    // Get the index of a city in the cities vector, returns -1 if not found
-    int getCityIndex(const std::string& city_name) const;
-    // Save the list of cities to cities.txt in the format "Index,CityName"
-    void saveCitiesToFile() const;
-    // Save roads and budgets to roads.txt in the format "Road,Budget" (e.g., "Kigali-Huye,5")
-    void saveRoadsToFile() const;
-    // Generate a Graphviz DOT file (city_roads.dot) to visualize the city-road network
-    void generateDotFile() const;
+    // Check if a city exists in the city table
+    bool cityExists(std::string_view city_name) const;
+    // Get the index of a city in the city table, returns -1 if not found
+    int getCityIndex(std::string_view city_name) const;
+    // Save the list of cities in the format of cities.txt, "Index,CityName", returns false on a write error
+    bool saveCitiesToFile(const std::string& path) const;
+    // Save roads and budgets in the format of roads.txt, "Road,Budget" (e.g., "Kigali-Huye,5"), returns false on a write error
+    bool saveRoadsToFile(const std::string& path) const;
+    // Generate a Graphviz DOT file (city_roads.dot) to visualize the city-road network.
+    // If planned_roads is not empty, those roads are drawn in bold and every other road dashed.
+    void generateDotFile(const std::vector<RoadEdge>& planned_roads = {}) const;
+    // Append a mutation to the journal and fold the journal into the CSV files once it grows large;
+    // returns false (and tells the user) if the journal could not be written
+    bool journalMutation(const std::string& record);
+    // Journal a batch of mutations with at most one commit, one published version and one fold check
+    bool journalMutations(const std::vector<std::string>& records);
+    // Append cities already known to be new and distinct, growing the storage once; false as for journalMutations
+    bool appendCities(const std::vector<std::string_view>& new_names);
+    // Give a new city the lowest free slot, or a new one, and grow the road store and aggregates; returns its index
+    int placeCity(std::string_view name);
+    // Remove an existing road from the road store and the aggregates
+    void removeRoadAt(int idx1, int idx2);
+    // Remove every road of a city, then leave a tombstone in its slot and free it for reuse
+    void removeCityAt(int index);
+    // Give a tombstoned slot a name again
+    void reviveCity(int index, std::string_view name);
+    // Start a new undo step for the change about to be made (dropping the oldest past UNDO_LIMIT)
+    void saveUndoStep();
+    // Note the row of a city before the change of the newest undo step
+    void recordRowUndo(int city);
+    // Note the name a city slot had before the change of the newest undo step
+    void recordCityUndo(int index, std::string_view old_name);
+    // Move the network to a target state: the given city slots get the given names ("" for a
+    // tombstone) and the roads become target_roads. The way there is journaled. With record_undo,
+    // the old names and rows are added to the newest undo step. Returns the number of roads that changed.
+    size_t restoreState(const RoadStore& target_roads, const std::vector<std::pair<int, std::string>>& city_names,
+                        bool record_undo, size_t& city_changes);
+    // The city table as an immutable copy, made again only after a city changed
+    std::shared_ptr<const CityTable> sharedCities();
+    // Rebuild the aggregates from the roads, counting the tombstones as deleted
+    void rebuildAggregates() const;
+    // Renumber the live cities densely, dropping tombstones, and rewrite the data files.
+    // City indices change, so the journal is folded before and after. Returns false on a write error.
+    bool compactCities();
+    // Apply one journal record during replay, returns false if it no longer applies
+    bool applyJournalRecord(std::string_view record);
+    // Rewrite cities.txt and roads.txt (and the snapshot, if enabled) from memory and empty the journal
+    bool foldJournal();
+    // Move the files of the committed generation into place and remove those of a compaction that
+    // never committed; called before anything is loaded
+    bool recoverGeneration();
+    // Identify the current cities.txt/roads.txt pair by size and modification time
+    uint64_t csvStamp() const;
+    // Parse cities.txt into memory, with the Region column if it has one
+    void loadCityFile(bool regions_only);
+    // Parse cities.txt and roads.txt into memory
+    void loadCsvFiles();
+    // Make sure the regions of these cities are loaded, evicting the least recently used other
+    // regions past region_memory_limit; with pin, they stay loaded until the shards are rewritten
+    void loadRegionsOf(const std::vector<int>& city_list, bool pin) const;
+    // Load the regions of the cities with indices first_row to last_row, for a window of rows
+    void loadRegionsOfRows(size_t first_row, size_t last_row) const;
+    // Load every region, for operations over the whole network
+    void loadAllRegions() const;
+    // Put the internal roads of a region into the roads and aggregates, or take them out
+    void loadRegion(uint32_t region) const;
+    void evictRegion(uint32_t region) const;
+    // Fall back to roads.txt for every region that is not loaded, and stop using the shards
+    void loadRegionsFromCsv() const;
+    // Check if regions may be evicted now (not while versions or readers share the roads)
+    bool evictionAllowed() const;
+    // Parse the text of roads.txt into edges (in file order) and skipped lines (in line order).
+    // The text is split into newline-aligned chunks that up to threads threads parse into
+    // buffers of their own; the buffers are joined in chunk order, so the result is the same
+    // for any number of threads.
+    void parseRoadsText(std::string_view text, size_t threads, std::vector<RoadEdge>& edges,
+                        std::vector<RoadLineError>& errors) const;
+    // Cheapest route between two city indices, through the routing index when one is ready
+    bool routeBetween(int idx1, int idx2, double& cost, std::vector<int>& path) const;
+    // Build the whole-network bit-packed adjacency if needed, returns false (after saying why) if it is too large
+    bool bitAdjacencyReady() const;
+    // Drop the routing index and its file after a road or budget change
+    void invalidateRouteIndex();
+    // Publish the current cities and roads to concurrent readers (if enabled)
+    void publishVersion();
 
 public:
     // Constructor: Initializes the system by loading existing data from files
     CityRoadSystem();
-    // Load cities, roads, and budgets from files at startup
+    // Number of threads later systems use to parse roads.txt while loading (0 = one per core)
+    static void setLoadThreads(size_t threads) { load_threads = threads; }
+    // Bytes of region roads later systems keep loaded before evicting cold regions (0 = no limit)
+    static void setRegionMemoryLimit(size_t bytes) { region_memory_limit = bytes; }
+    // Load cities, roads, and budgets from files at startup, then replay the journal
     void loadData();
     // Add a specified number of cities to the system
     void addCities(int num_cities);
+    // Add one city by name, returns false if the name is empty or already taken
+    bool addCity(const std::string& city_name);
+    // Bulk import: add every name that is not empty, not already a city and not repeated earlier in
+    // the list. Storage grows once and the batch is persisted with one journal commit.
+    // Returns the number of cities added.
+    size_t importCities(const std::vector<std::string_view>& names);
+    // Bulk import of a file with one city name per line (see importCities)
+    void importCitiesFromFile(const std::string& file_name);
     // Add a road between two cities with a specified budget in billions RWF (Create operation for road and budget)
     void addRoad(const std::string& city1, const std::string& city2, double budget);
     // Read the budget for a road between two cities (Read operation for budget)
@@ -42,6 +216,11 @@ public:
     void updateBudget(const std::string& city1, const std::string& city2, double new_budget);
     // Delete the budget for a road by setting it to 0 (Delete operation for budget)
     void deleteBudget(const std::string& city1, const std::string& city2);
+    // Delete the road between two cities (O(degree))
+    void deleteRoad(const std::string& city1, const std::string& city2);
+    // Delete a city and all its roads (O(degree)). Other cities keep their indices until
+    // deleted slots make up a quarter of the table, when the cities are renumbered.
+    void deleteCity(int index);
     // Update the name of an existing city using its index
     void updateCityName(int index, const std::string& new_name);
     // Search for a city by its index
@@ -58,4 +237,96 @@ public:
     void displayCitiesAndRoadMatrix() const;
     // Generate a Graphviz DOT file and provide instructions to create a visual graph image
     void generateGraphImage() const;
+    // Display page page (from 1) of the road list, page_size roads per page; returns true if
+    // more pages follow
+    bool displayRoadsPage(int page, int page_size) const;
+    // Display a window of the road matrix (or of the budget matrix if budgets is set): rows and
+    // columns are inclusive ranges of city indices
+    void displayMatrixWindow(int first_row, int last_row, int first_column, int last_column, bool budgets) const;
+    // List only the non-zero cells of a window of the matrix
+    void displaySparseMatrix(int first_row, int last_row, int first_column, int last_column) const;
+    // Stream the network to a file as GraphML, or as a binary edge list (see NetworkRenderer.h)
+    // if binary_edges is set
+    void exportNetwork(const std::string& file_name, bool binary_edges) const;
+    // Fold the journal into cities.txt and roads.txt (compaction)
+    void compactData();
+    // Write the binary snapshot (city_roads.snap) from the current data and check it reads back identically
+    void saveSnapshot();
+    // Find the cheapest route between two cities, using road budgets as costs
+    void findShortestPath(const std::string& city1, const std::string& city2) const;
+    // List the k cities reachable most cheaply from a city (k = 0 lists every reachable city)
+    void findNearestCities(const std::string& city, int k) const;
+    // Answer route queries from a file of "From,To" lines, writing "From,To,Cost,Route" lines to output_file
+    void answerRouteQueries(const std::string& query_file, const std::string& output_file) const;
+    // Build the contraction hierarchy routing index for faster route queries and save it to city_roads.ch
+    void buildRouteIndex();
+    // Find the cheapest set of roads connecting all cities (minimum spanning forest), or only the
+    // named cities if city_names is not empty, report it and export it to city_roads.dot
+    void planMinimumNetwork(const std::vector<std::string>& city_names) const;
+    // Count the connected components of the whole network, or of the named cities only (roads
+    // leaving them are ignored), using the bit-packed adjacency
+    void findConnectedComponents(const std::vector<std::string>& city_names) const;
+    // List the cities at most hops roads away from a city (bit-parallel BFS)
+    void findCitiesWithinHops(const std::string& city, int hops) const;
+    // List the cities that have a road to both cities
+    void findCommonNeighbors(const std::string& city1, const std::string& city2) const;
+    // Display network totals: roads, budget, connected components and isolated cities (O(1))
+    void displayNetworkSummary() const;
+    // Display the number of roads at a city and their total budget (O(1))
+    void displayCityTotals(const std::string& city) const;
+    // Display the k most expensive roads
+    void displayTopRoads(int k) const;
+    // Display the roads whose budget lies between low and high (inclusive)
+    void displayRoadsInBudgetRange(double low, double high) const;
+    // Check whether any city of region_a is joined by roads to any city of region_b
+    void checkConnected(const std::vector<std::string>& region_a, const std::vector<std::string>& region_b) const;
+    // Betweenness and closeness centrality of every city (and betweenness of every road) over
+    // budget-weighted routes, written to city_file (and road_file, if given) keyed by city index.
+    // samples = 0 runs from every city; otherwise from that many random cities, which
+    // estimates the scores. threads = 0 uses one thread per core.
+    void analyzeCentrality(const std::string& city_file, int samples, const std::string& road_file = "",
+                           unsigned threads = 0) const;
+    // Batch mode: keep changes in memory and the journal buffer until the next checkpoint instead
+    // of syncing the journal after every change
+    void setDeferredSync(bool deferred);
+    // Make every change so far durable (one journal write and fsync), returns false on an I/O error
+    bool checkpoint();
+    // Start publishing an immutable version of the network after every change, so other threads
+    // can read through readSnapshot while this one keeps changing the data. Changes still come
+    // from one thread at a time; the display and route methods above stay single-threaded.
+    void enableConcurrentReaders();
+    // Pin the latest published version for reading from any thread (not ready before
+    // enableConcurrentReaders). The pinned version never changes while the reader is held.
+    NetworkVersions::Reader readSnapshot() const;
+    // Check snapshot isolation under load: reader threads verify every version they pin while
+    // a writer publishes budget changes to a private copy of the roads. Nothing is saved.
+    void stressTestReaders(int reader_threads, int updates) const;
+    // Save the current network as a named version. The roads are shared with the live network
+    // chunk by chunk, so saving is O(1) in the roads and a version only holds on to what changed
+    // since; the city table is shared until a city changes.
+    void saveVersion(const std::string& name);
+    // Bring the network back to a named version (can be undone)
+    void restoreVersion(const std::string& name);
+    // List the roads added, removed or re-budgeted between two versions ("current" is the live
+    // network). Only the chunks that differ are compared.
+    void diffVersions(const std::string& from, const std::string& to) const;
+    // Forget a named version
+    void deleteVersion(const std::string& name);
+    // List the named versions and the number of changes that can be undone
+    void listVersions() const;
+    // Undo the last change of this session (up to 64 levels); renumbering the cities clears the history
+    void undoLastChange();
+    // Split the cities into regions and write the region shards (city_roads.shards/), kept up to
+    // date from then on. cities_per_region = 0 uses the Region column of cities.txt; otherwise
+    // the cities are partitioned automatically into connected regions of about that size.
+    // Later sessions load a region only when one of its cities is used.
+    void buildRegionShards(int cities_per_region);
+    // List the regions with their cities, roads and loading state
+    void displayRegions() const;
+    // List the cities and internal roads of one region, loading only that region
+    void displayRegion(const std::string& region_name) const;
+    // Display call counts, latency and bytes read/written per operation, summed over all threads
+    void displayOperationStats() const;
 };
+
+#endif
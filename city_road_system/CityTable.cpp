@@ -0,0 +1,257 @@
+#include "CityTable.h"
+
+using namespace std;
+
+// FNV-1a over the name bytes
+uint64_t CityTable::hashName(string_view name) {
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : name) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Copy through the assignment operator so the views are set up in one place
+CityTable::CityTable(const CityTable& other) {
+    *this = other;
+}
+
+// Copy the containers, then point the views at this table's copies rather than the source's
+CityTable& CityTable::operator=(const CityTable& other) {
+    if (this == &other) return *this;
+    arena = other.arena;
+    names = other.names;
+    hashes = other.hashes;
+    slots = other.slots;
+    indexed = other.indexed;
+    dead_bytes = other.dead_bytes;
+    duplicates = other.duplicates;
+    adopted_owner = other.adopted_owner;
+    if (adopted_owner) {
+        arena_data = other.arena_data;
+        arena_size = other.arena_size;
+        names_data = other.names_data;
+        hashes_data = other.hashes_data;
+        slots_data = other.slots_data;
+        count = other.count;
+        slot_count = other.slot_count;
+    } else {
+        refreshViews();
+    }
+    return *this;
+}
+
+// Probe the hash index from the name's home slot until the name or an empty slot is found
+int CityTable::find(string_view name) const {
+    if (slot_count == 0) return -1;
+    uint32_t h = static_cast<uint32_t>(hashName(name));
+    size_t mask = slot_count - 1;
+    for (size_t s = h & mask;; s = (s + 1) & mask) {
+        int32_t city = slots_data[s];
+        if (city == -1) return -1;
+        if (hashes_data[city] == h && (*this)[city] == name) return city;
+    }
+}
+
+// Append the name to the arena and index it
+int CityTable::add(string_view name) {
+    makeOwned();
+    int index = static_cast<int>(names.size());
+    names.push_back({static_cast<uint32_t>(arena.size()), static_cast<uint32_t>(name.size())});
+    arena.append(name.data(), name.size());
+    hashes.push_back(static_cast<uint32_t>(hashName(name)));
+    refreshViews();
+    if (!name.empty()) {
+        if (find(name) == -1) {
+            indexCity(index);
+        } else {
+            ++duplicates;
+        }
+    }
+    refreshViews();
+    return index;
+}
+
+// Unindex the name and leave an empty one behind; the old bytes are dead until compaction
+void CityTable::remove(int index) {
+    makeOwned();
+    string old_name((*this)[index]);
+    bool was_indexed = find(old_name) == index;
+    if (was_indexed) {
+        unindexCity(index);
+    } else if (!old_name.empty()) {
+        --duplicates;
+    }
+    dead_bytes += names[index].length;
+    names[index] = {static_cast<uint32_t>(arena.size()), 0};
+    hashes[index] = static_cast<uint32_t>(hashName(string_view()));
+    refreshViews();
+    if (was_indexed) indexDuplicate(old_name);
+    compactArena();
+    refreshViews();
+}
+
+// Append the new name to the arena; the old bytes become dead until the arena is compacted
+void CityTable::rename(int index, string_view new_name) {
+    makeOwned();
+    string old_name((*this)[index]);
+    bool was_indexed = find(old_name) == index;
+    if (was_indexed) {
+        unindexCity(index);
+    } else if (!old_name.empty()) {
+        --duplicates;
+    }
+    dead_bytes += names[index].length;
+    names[index] = {static_cast<uint32_t>(arena.size()), static_cast<uint32_t>(new_name.size())};
+    arena.append(new_name.data(), new_name.size());
+    hashes[index] = static_cast<uint32_t>(hashName(new_name));
+    refreshViews();
+    if (find(new_name) == -1) {
+        indexCity(index);
+    } else {
+        ++duplicates;
+    }
+    if (was_indexed) indexDuplicate(old_name);
+    compactArena();
+    refreshViews();
+}
+
+// Reserve room so bulk loads grow the arena and index once
+void CityTable::reserve(size_t num_cities, size_t name_bytes) {
+    makeOwned();
+    names.reserve(num_cities);
+    hashes.reserve(num_cities);
+    arena.reserve(name_bytes);
+    while (slots.size() < num_cities * 2) growIndex();
+    refreshViews();
+}
+
+// Remove all cities
+void CityTable::clear() {
+    adopted_owner.reset();
+    arena.clear();
+    names.clear();
+    hashes.clear();
+    slots.clear();
+    indexed = 0;
+    dead_bytes = 0;
+    duplicates = 0;
+    refreshViews();
+}
+
+// Arrays backing the table
+CityTable::Layout CityTable::layout() const {
+    return Layout{arena_data, arena_size, names_data, hashes_data, count, slots_data, slot_count, indexed};
+}
+
+// Read straight from the adopted arrays; nothing is copied until the first write
+void CityTable::adopt(const Layout& source, shared_ptr<const void> owner) {
+    clear();
+    adopted_owner = move(owner);
+    arena_data = source.arena;
+    arena_size = source.arena_size;
+    names_data = source.names;
+    hashes_data = source.hashes;
+    count = source.count;
+    slots_data = source.slots;
+    slot_count = source.slot_count;
+    indexed = source.indexed;
+    size_t live = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (names_data[i].length != 0) ++live;
+    }
+    duplicates = live - indexed;
+}
+
+// Copy adopted arrays into the owned containers
+void CityTable::makeOwned() {
+    if (!adopted_owner) return;
+    arena.assign(arena_data, arena_size);
+    names.assign(names_data, names_data + count);
+    hashes.assign(hashes_data, hashes_data + count);
+    slots.assign(slots_data, slots_data + slot_count);
+    adopted_owner.reset();
+    refreshViews();
+}
+
+// Point the read views at the owned containers
+void CityTable::refreshViews() {
+    arena_data = arena.data();
+    arena_size = arena.size();
+    names_data = names.data();
+    hashes_data = hashes.data();
+    slots_data = slots.data();
+    count = names.size();
+    slot_count = slots.size();
+}
+
+// Linear probing insert into the first empty slot
+void CityTable::indexCity(int index) {
+    if ((indexed + 1) * 2 > slots.size()) growIndex();
+    size_t mask = slots.size() - 1;
+    size_t s = hashes[index] & mask;
+    while (slots[s] != -1) s = (s + 1) & mask;
+    slots[s] = index;
+    ++indexed;
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones
+void CityTable::unindexCity(int index) {
+    size_t mask = slots.size() - 1;
+    size_t s = hashes[index] & mask;
+    while (slots[s] != index) s = (s + 1) & mask;
+    size_t hole = s;
+    for (size_t next = (hole + 1) & mask; slots[next] != -1; next = (next + 1) & mask) {
+        size_t home = hashes[slots[next]] & mask;
+        // Move the entry back if its home slot is not between the hole and its current slot
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            slots[hole] = slots[next];
+            hole = next;
+        }
+    }
+    slots[hole] = -1;
+    --indexed;
+}
+
+// Duplicates are rare, so finding the next one is a plain scan, skipped when there are none.
+// The first one in index order takes the name, as it would have when the table was loaded.
+void CityTable::indexDuplicate(string_view name) {
+    if (duplicates == 0 || name.empty() || find(name) != -1) return;
+    uint32_t h = static_cast<uint32_t>(hashName(name));
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (hashes[i] == h && (*this)[i] == name) {
+            indexCity(static_cast<int>(i));
+            --duplicates;
+            return;
+        }
+    }
+}
+
+// Double the table (starting at 16 slots) and reinsert every indexed city
+void CityTable::growIndex() {
+    vector<int32_t> old;
+    old.swap(slots);
+    slots.assign(old.empty() ? 16 : old.size() * 2, -1);
+    size_t mask = slots.size() - 1;
+    for (int32_t city : old) {
+        if (city == -1) continue;
+        size_t s = hashes[city] & mask;
+        while (slots[s] != -1) s = (s + 1) & mask;
+        slots[s] = city;
+    }
+}
+
+// Rewrite the arena with only live names
+void CityTable::compactArena() {
+    if (dead_bytes * 2 < arena.size()) return;
+    string packed;
+    packed.reserve(arena.size() - dead_bytes);
+    for (NameRef& ref : names) {
+        uint32_t offset = static_cast<uint32_t>(packed.size());
+        packed.append(arena, ref.offset, ref.length);
+        ref.offset = offset;
+    }
+    arena.swap(packed);
+    dead_bytes = 0;
+}
@@ -0,0 +1,115 @@
+#ifndef CITY_TABLE_H
+#define CITY_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// City names interned in one contiguous string arena, with an open-addressing
+// hash index from name to city index. Lookups hash a string_view in place, so
+// finding a city never allocates and costs O(1) on average.
+// The table can also adopt arrays that live in a memory-mapped snapshot; they are
+// used in place and only copied into owned storage on the first add or rename.
+// A removed city leaves a tombstone: its slot keeps its index with an empty name that is
+// never indexed, so the indices of all other cities stay put. Renaming a tombstone revives
+// the slot.
+class CityTable {
+public:
+    // Location of a city name inside the arena
+    struct NameRef {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    // Raw arrays backing the table, as written to and read from a binary snapshot
+    struct Layout {
+        const char* arena;
+        size_t arena_size;
+        const NameRef* names;   // One per city
+        const uint32_t* hashes; // One per city
+        size_t count;
+        const int32_t* slots;   // Hash index, power-of-two size
+        size_t slot_count;
+        size_t indexed;         // Occupied slots
+    };
+
+    CityTable() = default;
+    // Copies get their own containers (or share the adopted arrays), with views pointing at them
+    CityTable(const CityTable& other);
+    CityTable& operator=(const CityTable& other);
+
+    // Number of cities
+    size_t size() const { return count; }
+    // Check if there are no cities
+    bool empty() const { return count == 0; }
+    // Name of the city at an index (valid until the next add or rename)
+    std::string_view operator[](size_t index) const {
+        return std::string_view(arena_data + names_data[index].offset, names_data[index].length);
+    }
+
+    // Index of a city by name, returns -1 if not found
+    int find(std::string_view name) const;
+    // Check if a city with this name exists
+    bool contains(std::string_view name) const { return find(name) != -1; }
+    // Append a city and return its index. A duplicate name is stored but not indexed,
+    // so lookups keep resolving to the first city with that name; once that city is renamed or
+    // removed, the next city with the name is indexed instead. An empty name adds a tombstone.
+    int add(std::string_view name);
+    // Turn the city at an index into a tombstone; its name is no longer found
+    void remove(int index);
+    // Check if the slot at an index is a tombstone
+    bool isDeleted(size_t index) const { return names_data[index].length == 0; }
+    // Change the name of the city at an index and re-index it
+    void rename(int index, std::string_view new_name);
+    // Reserve room for a number of cities and name bytes
+    void reserve(size_t num_cities, size_t name_bytes);
+    // Remove all cities
+    void clear();
+
+    // Arrays backing the table
+    Layout layout() const;
+    // Use arrays owned by someone else (e.g., a mapped snapshot); owner keeps them alive
+    void adopt(const Layout& source, std::shared_ptr<const void> owner);
+
+    // Hash used for city names (FNV-1a, stable across builds so it can be stored in snapshots)
+    static uint64_t hashName(std::string_view name);
+
+private:
+    std::string arena;               // All city names back to back
+    std::vector<NameRef> names;      // names[i] locates city i in the arena
+    std::vector<uint32_t> hashes;    // hashes[i] caches the hash of city i's name
+    std::vector<int32_t> slots;      // Hash index: power-of-two table of city indices, -1 = empty
+    size_t indexed = 0;              // Number of occupied slots
+    size_t dead_bytes = 0;           // Arena bytes left behind by renames
+    size_t duplicates = 0;           // Cities not indexed because an earlier city has their name
+
+    // Views used by every read: they point at the owned containers above or at adopted arrays
+    const char* arena_data = nullptr;
+    size_t arena_size = 0;
+    const NameRef* names_data = nullptr;
+    const uint32_t* hashes_data = nullptr;
+    const int32_t* slots_data = nullptr;
+    size_t count = 0;
+    size_t slot_count = 0;
+    std::shared_ptr<const void> adopted_owner; // Set while reads go to adopted arrays
+
+    // Copy adopted arrays into owned storage before the first write
+    void makeOwned();
+    // Point the read views at the owned containers
+    void refreshViews();
+    // Insert a city into the hash index (the name must not be indexed yet)
+    void indexCity(int index);
+    // Remove a city from the hash index, shifting later entries back into place
+    void unindexCity(int index);
+    // After the indexed city with this name lost it, index the first duplicate that still has it
+    void indexDuplicate(std::string_view name);
+    // Double the hash index once it is half full
+    void growIndex();
+    // Drop arena bytes left behind by renames once they are half of the arena
+    void compactArena();
+};
+
+#endif
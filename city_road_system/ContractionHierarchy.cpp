@@ -0,0 +1,366 @@
+#include "ContractionHierarchy.h"
+#include "Journal.h"
+#include "MappedFile.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <queue>
+
+using namespace std;
+
+static const char INDEX_MAGIC[8] = {'C', 'R', 'S', 'C', 'H', '\0', '\0', '\0'};
+static const uint32_t INDEX_VERSION = 1;
+// Witness searches give up after settling this many cities; a missed witness only costs an extra shortcut.
+// Priority estimates use a much shorter search than the real contraction.
+static const size_t WITNESS_SETTLE_LIMIT = 100;
+static const size_t ESTIMATE_SETTLE_LIMIT = 20;
+
+// File header of a saved index
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t num_cities;
+    uint64_t fingerprint;
+    uint64_t shortcuts;
+    uint64_t edge_count;
+    uint64_t checksum; // FNV-1a of the offsets and edges that follow
+};
+
+// FNV-1a, continued from a previous value
+static uint64_t fnv(const void* data, size_t size, uint64_t h = 1469598103934665603ULL) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Hash the city count and every road (once, from its lower endpoint) with its budget
+uint64_t ContractionHierarchy::fingerprint(const RoadStore& roads) {
+    uint64_t n = roads.cityCount();
+    uint64_t h = fnv(&n, sizeof(n));
+    roads.forEachRoad([&h](int i, int j, double budget) {
+        int32_t ends[2] = {i, j};
+        h = fnv(ends, sizeof(ends), h);
+        h = fnv(&budget, sizeof(budget), h);
+    });
+    return h;
+}
+
+// Contract every city; the edges a city still has when it is contracted all lead to more
+// important cities, so they become its upward edges and the city leaves the working graph
+void ContractionHierarchy::build(const RoadStore& roads) {
+    struct DynEdge {
+        int to;
+        int mid;
+        double weight;
+    };
+    size_t n = roads.cityCount();
+    vector<vector<DynEdge>> graph(n);
+    for (size_t i = 0; i < n; ++i) {
+        for (const Road& road : roads.row(static_cast<int>(i))) {
+            graph[i].push_back({road.to, -1, road.budget});
+        }
+    }
+    vector<vector<DynEdge>> upward(n);
+    vector<int> deleted_neighbours(n, 0);
+
+    // Witness search scratch: a Dijkstra from one neighbour of the contracted city that avoids it
+    // and stops once every target is settled, the distance limit is passed or enough cities are settled
+    vector<double> wdist(n, 0.0);
+    vector<uint32_t> wstamp(n, 0);
+    vector<uint32_t> wtarget(n, 0);
+    uint32_t wquery = 0;
+    vector<pair<double, int>> wheap;
+    auto witness = [&](int source, int skip, const vector<DynEdge>& targets, size_t first_target, double limit,
+                       size_t settle_limit) {
+        ++wquery;
+        size_t pending = 0;
+        for (size_t j = first_target; j < targets.size(); ++j) {
+            if (wtarget[targets[j].to] != wquery) ++pending;
+            wtarget[targets[j].to] = wquery;
+        }
+        wheap.clear();
+        wdist[source] = 0.0;
+        wstamp[source] = wquery;
+        wheap.push_back({0.0, source});
+        size_t settled = 0;
+        while (!wheap.empty() && pending > 0 && settled < settle_limit) {
+            pop_heap(wheap.begin(), wheap.end(), greater<pair<double, int>>());
+            auto [d, u] = wheap.back();
+            wheap.pop_back();
+            if (d > wdist[u]) continue;
+            if (d > limit) break;
+            ++settled;
+            if (wtarget[u] == wquery) --pending;
+            for (const DynEdge& e : graph[u]) {
+                if (e.to == skip) continue;
+                double nd = d + e.weight;
+                if (wstamp[e.to] != wquery || nd < wdist[e.to]) {
+                    wdist[e.to] = nd;
+                    wstamp[e.to] = wquery;
+                    wheap.push_back({nd, e.to});
+                    push_heap(wheap.begin(), wheap.end(), greater<pair<double, int>>());
+                }
+            }
+        }
+    };
+
+    // Add or lower the edge a-b in both directions
+    auto addShortcut = [&](int a, int b, int mid, double weight) {
+        for (int side = 0; side < 2; ++side) {
+            int from = side == 0 ? a : b;
+            int to = side == 0 ? b : a;
+            auto it = find_if(graph[from].begin(), graph[from].end(), [to](const DynEdge& e) { return e.to == to; });
+            if (it == graph[from].end()) {
+                graph[from].push_back({to, mid, weight});
+            } else if (weight < it->weight) {
+                it->weight = weight;
+                it->mid = mid;
+            }
+        }
+    };
+
+    // Count (and optionally add) the shortcuts needed to contract v
+    auto contract = [&](int v, bool apply) {
+        const vector<DynEdge>& neighbours = graph[v];
+        struct Shortcut {
+            int from;
+            int to;
+            double weight;
+        };
+        vector<Shortcut> found;
+        // Roads are symmetric, so each neighbour pair is checked once from its first member
+        for (size_t i = 0; i + 1 < neighbours.size(); ++i) {
+            const DynEdge& in = neighbours[i];
+            double max_out = 0.0;
+            for (size_t j = i + 1; j < neighbours.size(); ++j) max_out = max(max_out, neighbours[j].weight);
+            witness(in.to, v, neighbours, i + 1, in.weight + max_out, apply ? WITNESS_SETTLE_LIMIT : ESTIMATE_SETTLE_LIMIT);
+            for (size_t j = i + 1; j < neighbours.size(); ++j) {
+                const DynEdge& out = neighbours[j];
+                double via = in.weight + out.weight;
+                if (wstamp[out.to] == wquery && wdist[out.to] <= via) continue; // Witness route found
+                found.push_back({in.to, out.to, via});
+            }
+        }
+        if (apply) {
+            for (const Shortcut& s : found) addShortcut(s.from, s.to, v, s.weight);
+        }
+        return found.size();
+    };
+    auto priority = [&](int v) {
+        return static_cast<long long>(contract(v, false)) - static_cast<long long>(graph[v].size()) + deleted_neighbours[v];
+    };
+
+    // Lazy updates: re-evaluate the cheapest city and contract it only if it is still the cheapest
+    priority_queue<pair<long long, int>, vector<pair<long long, int>>, greater<pair<long long, int>>> order;
+    for (size_t v = 0; v < n; ++v) order.push({priority(static_cast<int>(v)), static_cast<int>(v)});
+    size_t shortcut_count = 0;
+    while (!order.empty()) {
+        int v = order.top().second;
+        order.pop();
+        long long key = priority(v);
+        if (!order.empty() && key > order.top().first) {
+            order.push({key, v});
+            continue;
+        }
+        shortcut_count += contract(v, true);
+        upward[v].swap(graph[v]);
+        for (const DynEdge& e : upward[v]) {
+            vector<DynEdge>& back = graph[e.to];
+            auto it = find_if(back.begin(), back.end(), [v](const DynEdge& b) { return b.to == v; });
+            *it = back.back();
+            back.pop_back();
+            ++deleted_neighbours[e.to];
+        }
+    }
+
+    // Upward CSR in city order
+    up_offsets.assign(n + 1, 0);
+    up_edges.clear();
+    for (size_t v = 0; v < n; ++v) {
+        for (const DynEdge& e : upward[v]) up_edges.push_back({e.to, e.mid, e.weight});
+        up_offsets[v + 1] = static_cast<uint32_t>(up_edges.size());
+    }
+    num_cities = n;
+    shortcuts = shortcut_count;
+    graph_fingerprint = fingerprint(roads);
+    ready = true;
+}
+
+// Drop the index and its scratch buffers
+void ContractionHierarchy::clear() {
+    ready = false;
+    num_cities = 0;
+    shortcuts = 0;
+    up_offsets.clear();
+    up_edges.clear();
+    forward_search = Search();
+    backward_search = Search();
+}
+
+// Bidirectional upward Dijkstra; each side stops once its smallest key cannot beat the best meeting
+bool ContractionHierarchy::shortestPath(int source, int target, double& cost, vector<int>& path) {
+    path.clear();
+    if (static_cast<size_t>(source) >= num_cities || static_cast<size_t>(target) >= num_cities) {
+        if (source != target) return false;
+        cost = 0.0;
+        path.push_back(source);
+        return true;
+    }
+    for (Search* s : {&forward_search, &backward_search}) {
+        if (s->dist.size() < num_cities) {
+            s->dist.resize(num_cities);
+            s->parent.resize(num_cities);
+            s->parent_mid.resize(num_cities);
+            s->stamp.resize(num_cities, 0);
+        }
+        s->heap.clear();
+    }
+    if (++query == 0) {
+        fill(forward_search.stamp.begin(), forward_search.stamp.end(), 0);
+        fill(backward_search.stamp.begin(), backward_search.stamp.end(), 0);
+        query = 1;
+    }
+    auto start = [this](Search& s, int city) {
+        s.dist[city] = 0.0;
+        s.parent[city] = -1;
+        s.parent_mid[city] = -1;
+        s.stamp[city] = query;
+        s.heap.push_back({0.0, city});
+    };
+    start(forward_search, source);
+    start(backward_search, target);
+
+    double best = numeric_limits<double>::infinity();
+    int meet = -1;
+    auto step = [&](Search& s, Search& other) {
+        pop_heap(s.heap.begin(), s.heap.end(), greater<pair<double, int>>());
+        auto [d, u] = s.heap.back();
+        s.heap.pop_back();
+        if (d > s.dist[u]) return;
+        if (other.stamp[u] == query && d + other.dist[u] < best) {
+            best = d + other.dist[u];
+            meet = u;
+        }
+        for (uint32_t k = up_offsets[u]; k < up_offsets[u + 1]; ++k) {
+            const UpEdge& e = up_edges[k];
+            double nd = d + e.weight;
+            if (s.stamp[e.to] != query || nd < s.dist[e.to]) {
+                s.dist[e.to] = nd;
+                s.parent[e.to] = u;
+                s.parent_mid[e.to] = e.mid;
+                s.stamp[e.to] = query;
+                s.heap.push_back({nd, e.to});
+                push_heap(s.heap.begin(), s.heap.end(), greater<pair<double, int>>());
+            }
+        }
+    };
+    while (true) {
+        bool forward_open = !forward_search.heap.empty() && forward_search.heap.front().first < best;
+        bool backward_open = !backward_search.heap.empty() && backward_search.heap.front().first < best;
+        if (!forward_open && !backward_open) break;
+        if (forward_open) step(forward_search, backward_search);
+        if (backward_open) step(backward_search, forward_search);
+    }
+    if (meet == -1) return false;
+    cost = best;
+
+    // source .. meet from the forward parents, then meet .. target from the backward parents
+    vector<int> up_chain;
+    for (int c = meet; c != -1; c = forward_search.parent[c]) up_chain.push_back(c);
+    reverse(up_chain.begin(), up_chain.end());
+    path.push_back(source);
+    for (size_t i = 1; i < up_chain.size(); ++i) {
+        unpack(up_chain[i - 1], up_chain[i], forward_search.parent_mid[up_chain[i]], path);
+    }
+    for (int c = meet; backward_search.parent[c] != -1; c = backward_search.parent[c]) {
+        unpack(c, backward_search.parent[c], backward_search.parent_mid[c], path);
+    }
+    return true;
+}
+
+// The edge is stored at whichever endpoint is less important
+const ContractionHierarchy::UpEdge* ContractionHierarchy::findEdge(int a, int b) const {
+    for (int side = 0; side < 2; ++side) {
+        int from = side == 0 ? a : b;
+        int to = side == 0 ? b : a;
+        for (uint32_t k = up_offsets[from]; k < up_offsets[from + 1]; ++k) {
+            if (up_edges[k].to == to) return &up_edges[k];
+        }
+    }
+    return nullptr;
+}
+
+// A shortcut a-b via mid is the edges a-mid and mid-b, each possibly a shortcut itself
+void ContractionHierarchy::unpack(int a, int b, int mid, vector<int>& path) const {
+    if (mid == -1) {
+        path.push_back(b);
+        return;
+    }
+    const UpEdge* first = findEdge(a, mid);
+    const UpEdge* second = findEdge(mid, b);
+    unpack(a, mid, first ? first->mid : -1, path);
+    unpack(mid, b, second ? second->mid : -1, path);
+}
+
+// Header, offsets and edges, written via a temporary file and rename
+bool ContractionHierarchy::save(const string& path) const {
+    if (!ready) return false;
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.num_cities = num_cities;
+    header.fingerprint = graph_fingerprint;
+    header.shortcuts = shortcuts;
+    header.edge_count = up_edges.size();
+    header.checksum = fnv(up_offsets.data(), up_offsets.size() * sizeof(uint32_t));
+    header.checksum = fnv(up_edges.data(), up_edges.size() * sizeof(UpEdge), header.checksum);
+
+    string temp_path = path + ".tmp";
+    ofstream out(temp_path, ios::binary | ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(up_offsets.data()), static_cast<streamsize>(up_offsets.size() * sizeof(uint32_t)));
+    out.write(reinterpret_cast<const char*>(up_edges.data()), static_cast<streamsize>(up_edges.size() * sizeof(UpEdge)));
+    out.close();
+    recordBytesWritten(sizeof(header) + up_offsets.size() * sizeof(uint32_t) + up_edges.size() * sizeof(UpEdge));
+    return !out.fail() && durableReplace(temp_path, path);
+}
+
+// Read and check a saved index; anything that does not match the expected graph is rejected
+bool ContractionHierarchy::load(const string& path, uint64_t expected_fingerprint) {
+    clear();
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(IndexHeader)) return false;
+    IndexHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0 || header.version != INDEX_VERSION ||
+        header.fingerprint != expected_fingerprint) {
+        return false;
+    }
+    uint64_t offsets_bytes = (header.num_cities + 1) * sizeof(uint32_t);
+    uint64_t edges_bytes = header.edge_count * sizeof(UpEdge);
+    if (file.size() != sizeof(IndexHeader) + offsets_bytes + edges_bytes) return false;
+    const char* body = file.data() + sizeof(IndexHeader);
+    if (fnv(body, offsets_bytes + edges_bytes) != header.checksum) return false;
+
+    up_offsets.resize(header.num_cities + 1);
+    up_edges.resize(header.edge_count);
+    memcpy(up_offsets.data(), body, offsets_bytes);
+    memcpy(up_edges.data(), body + offsets_bytes, edges_bytes);
+    if (up_offsets[header.num_cities] != header.edge_count) {
+        clear();
+        return false;
+    }
+    num_cities = header.num_cities;
+    shortcuts = header.shortcuts;
+    graph_fingerprint = header.fingerprint;
+    ready = true;
+    return true;
+}
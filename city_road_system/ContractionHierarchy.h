@@ -0,0 +1,74 @@
+#ifndef CONTRACTION_HIERARCHY_H
+#define CONTRACTION_HIERARCHY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "RoadStore.h"
+
+// Contraction hierarchy over the budget-weighted road network.
+// Preprocessing contracts cities one at a time in order of importance (edge difference),
+// adding a shortcut u-w whenever the only cheapest route between two neighbours went
+// through the contracted city. Each city keeps only its roads and shortcuts to more
+// important cities ("upward" edges), and a point-to-point query is a small bidirectional
+// Dijkstra that only ever climbs, so it settles a tiny part of the network.
+// The index is tied to one exact graph through a fingerprint of its roads and budgets.
+class ContractionHierarchy {
+public:
+    // Build the index for the current roads
+    void build(const RoadStore& roads);
+    // Drop the index
+    void clear();
+    // Check if the index has been built or loaded
+    bool isReady() const { return ready; }
+    // Number of shortcuts added during preprocessing
+    size_t shortcutCount() const { return shortcuts; }
+
+    // Cheapest route between two cities: total budget and the cities on the way (source first).
+    // Returns false if there is no route. Cities added after the index was built have no roads
+    // (adding a road invalidates the index), so they are unreachable.
+    bool shortestPath(int source, int target, double& cost, std::vector<int>& path);
+
+    // Save the index to a file, returns false on a write error
+    bool save(const std::string& path) const;
+    // Load an index from a file; fails if it was built for a different graph
+    bool load(const std::string& path, uint64_t expected_fingerprint);
+
+    // Fingerprint of a graph: city count, roads and budgets
+    static uint64_t fingerprint(const RoadStore& roads);
+
+private:
+    // Upward edge: a road or shortcut to a more important city. Shortcuts remember the
+    // contracted city they bypass (mid), original roads have mid = -1.
+    struct UpEdge {
+        int to;
+        int mid;
+        double weight;
+    };
+
+    bool ready = false;
+    size_t num_cities = 0;
+    size_t shortcuts = 0;
+    uint64_t graph_fingerprint = 0;
+    std::vector<uint32_t> up_offsets; // CSR over upward edges
+    std::vector<UpEdge> up_edges;
+
+    // Per-query scratch, one set per search direction, reused across queries
+    struct Search {
+        std::vector<double> dist;
+        std::vector<int> parent;      // Previous city on the upward route
+        std::vector<int> parent_mid;  // Shortcut middle city of the edge used to get here
+        std::vector<uint32_t> stamp;
+        std::vector<std::pair<double, int>> heap;
+    };
+    Search forward_search;
+    Search backward_search;
+    uint32_t query = 0;
+
+    // Weight and mid of the upward edge between two cities (either direction)
+    const UpEdge* findEdge(int a, int b) const;
+    // Expand an edge (possibly a shortcut) into original cities, appending everything after a
+    void unpack(int a, int b, int mid, std::vector<int>& path) const;
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include "Journal.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+Journal::~Journal() {
+    close();
+}
+
+// Open the journal in append mode; existing records count towards recordCount().
+// A torn last record (no '\n') is cut off so new records start on a fresh line.
+bool Journal::open(const string& path) {
+    close();
+    size_t valid_length = 0;
+    size_t file_length = 0;
+    base_generation = 0;
+    {
+        MappedFile file;
+        if (file.open(path)) {
+            string_view text = file.view();
+            file_length = text.size();
+            size_t last_newline = text.rfind('\n');
+            valid_length = last_newline == string_view::npos ? 0 : last_newline + 1;
+            size_t first_newline = text.find('\n');
+            if (first_newline != string_view::npos) parseTagged(text.substr(0, first_newline), 'G', base_generation);
+        }
+    }
+    replay(path, 0, [](string_view) {}, records);
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd == -1) return false;
+    if (valid_length < file_length && ftruncate(fd, static_cast<off_t>(valid_length)) != 0) return false;
+    return true;
+}
+
+// Flush what is pending before closing
+void Journal::close() {
+    if (fd == -1) return;
+    commit();
+    ::close(fd);
+    fd = -1;
+}
+
+// Queue a record; group commit once enough records are pending
+bool Journal::append(string_view record) {
+    pending.append(record.data(), record.size());
+    pending += '\n';
+    ++pending_records;
+    ++records;
+    return pending_records < sync_every || commit();
+}
+
+// Queue a batch of records; group commit at most once, after the whole batch
+bool Journal::appendAll(const vector<string>& records) {
+    for (const string& record : records) {
+        pending.append(record);
+        pending += '\n';
+    }
+    pending_records += records.size();
+    this->records += records.size();
+    return pending_records < sync_every || commit();
+}
+
+// One write() for the whole batch, then fdatasync so the batch survives a crash
+bool Journal::commit() {
+    if (fd == -1 || pending.empty()) return fd != -1;
+    size_t done = 0;
+    while (done < pending.size()) {
+        ssize_t written = ::write(fd, pending.data() + done, pending.size() - done);
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0) break;
+        done += static_cast<size_t>(written);
+    }
+    bytes_written += done;
+    recordBytesWritten(done);
+    bool complete = done == pending.size();
+    pending_records -= static_cast<size_t>(count(pending.begin(), pending.begin() + done, '\n'));
+    pending.erase(0, done); // Only what never reached the file is written again
+    return complete && fdatasync(fd) == 0;
+}
+
+// The marker is an ordinary record, committed with everything before it
+bool Journal::markFold(uint64_t generation) {
+    append("F\t" + to_string(generation));
+    return commit();
+}
+
+// Empty the journal file, pending records included, and write the stamp as its first line.
+// The stamp is only taken over once it is durable.
+bool Journal::restart(uint64_t generation) {
+    pending.clear();
+    pending_records = 0;
+    records = 0;
+    if (fd == -1 || ftruncate(fd, 0) != 0) return false;
+    string stamp = "G\t" + to_string(generation) + "\n";
+    if (::write(fd, stamp.data(), stamp.size()) != static_cast<ssize_t>(stamp.size())) return false;
+    bytes_written += stamp.size();
+    recordBytesWritten(stamp.size());
+    if (fdatasync(fd) != 0) return false;
+    base_generation = generation;
+    return true;
+}
+
+// Stamps and markers are the tag, a tab and nothing but the number
+bool Journal::parseTagged(string_view line, char tag, uint64_t& value) {
+    if (line.size() < 3 || line[0] != tag || line[1] != '\t') return false;
+    auto result = from_chars(line.data() + 2, line.data() + line.size(), value);
+    return result.ec == errc() && result.ptr == line.data() + line.size();
+}
+
+// fsync the temporary file, rename it over the target, then fsync the directory entry
+bool durableReplace(const string& temp_path, const string& target_path) {
+    int fd = ::open(temp_path.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    if (!synced || rename(temp_path.c_str(), target_path.c_str()) != 0) return false;
+
+    size_t slash = target_path.rfind('/');
+    string dir = slash == string::npos ? "." : target_path.substr(0, slash + 1);
+    int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd != -1) {
+        fsync(dir_fd);
+        ::close(dir_fd);
+    }
+    return true;
+}
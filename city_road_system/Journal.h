@@ -0,0 +1,114 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MappedFile.h"
+
+// Append-only write-ahead journal of individual mutations.
+// Each record is one text line. Records are buffered and written with a single
+// write() followed by fdatasync() once sync_every records are pending (or on an
+// explicit commit), so a record is durable once the commit that covers it returns.
+// A torn last line left by a crash has no '\n' and is ignored on replay.
+// A journal may start with a "G\t<generation>" line naming the generation of the data files its
+// records apply to (an unstamped journal is generation 0). Before records are folded into data
+// files of generation g, an "F\t<g>" marker is committed after them. Records are not idempotent
+// (city slots are reused), so in a journal older than the data files only the records after
+// the marker of their generation are replayed: they were written after a fold that could not
+// restart the journal. Without that marker nothing is known to be safe to replay.
+class Journal {
+public:
+    Journal() = default;
+    ~Journal();
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // Open (or create) the journal for appending
+    bool open(const std::string& path);
+    // Commit pending records and close the journal
+    void close();
+    // Check if the journal is open
+    bool isOpen() const { return fd != -1; }
+
+    // Buffer one record (without '\n'); commits once sync_every records are pending.
+    // Returns false if that commit failed (the record stays pending)
+    bool append(std::string_view record);
+    // Buffer several records and apply the commit rule once, so a bulk change costs one commit
+    bool appendAll(const std::vector<std::string>& records);
+    // Write and fsync all pending records, returns false on an I/O error. Bytes that did reach
+    // the file are dropped from the buffer, so a retry continues where the failed write stopped
+    bool commit();
+    // Commit a marker saying every record so far goes into the data files of this generation
+    bool markFold(uint64_t generation);
+    // Drop every record from the file (after its contents were folded into the data files) and
+    // stamp it with the generation of those files
+    bool restart(uint64_t generation);
+    // Generation the journal is stamped with
+    uint64_t generation() const { return base_generation; }
+    // Commit after this many pending records (1 = every record is synced before returning)
+    void setSyncEvery(size_t records) { sync_every = records == 0 ? 1 : records; }
+    // Number of records in the journal, committed or pending
+    size_t recordCount() const { return records; }
+    // Number of bytes written to the journal file since it was opened
+    size_t bytesWritten() const { return bytes_written; }
+
+    // Call fn(record) for every complete record in a journal file that the data files of
+    // min_generation do not hold yet, and set count to the number of them. Returns false, with
+    // nothing replayed, if the journal is older than those files and has no marker for them.
+    template <typename Fn>
+    static bool replay(const std::string& path, uint64_t min_generation, Fn fn, size_t& count);
+
+private:
+    // Read the number from a "<tag>\t<number>" line, returns false for any other line
+    static bool parseTagged(std::string_view line, char tag, uint64_t& value);
+
+    int fd = -1;
+    std::string pending;       // Records not yet written
+    size_t pending_records = 0;
+    size_t sync_every = 1;
+    size_t records = 0;
+    size_t bytes_written = 0;
+    uint64_t base_generation = 0;
+};
+
+template <typename Fn>
+bool Journal::replay(const std::string& path, uint64_t min_generation, Fn fn, size_t& count) {
+    count = 0;
+    MappedFile file;
+    if (!file.open(path)) return true;
+    std::string_view text = file.view();
+    text = text.substr(0, text.rfind('\n') + 1); // Without a torn or empty tail (npos + 1 is 0)
+    size_t pos = 0;
+    uint64_t generation = 0;
+    size_t first_newline = text.find('\n');
+    if (first_newline != std::string_view::npos && parseTagged(text.substr(0, first_newline), 'G', generation)) {
+        pos = first_newline + 1;
+    }
+    if (generation < min_generation) {
+        // Folded into newer data files: only records after the last marker of that fold are new
+        size_t resume = std::string_view::npos;
+        for (size_t at = pos; at < text.size();) {
+            size_t newline = text.find('\n', at);
+            uint64_t folded = 0;
+            if (parseTagged(text.substr(at, newline - at), 'F', folded) && folded == min_generation) resume = newline + 1;
+            at = newline + 1;
+        }
+        if (resume == std::string_view::npos) return false;
+        pos = resume;
+    }
+    while (pos < text.size()) {
+        size_t newline = text.find('\n', pos);
+        fn(text.substr(pos, newline - pos));
+        ++count;
+        pos = newline + 1;
+    }
+    return true;
+}
+
+// Make a freshly written file durable and move it over target (write-to-temp then rename)
+bool durableReplace(const std::string& temp_path, const std::string& target_path);
+
+#endif
@@ -0,0 +1,138 @@
+#include "LoadGenerator.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+// What one connection measured
+struct ConnectionResult {
+    vector<double> latencies_us; // One per answered request
+    size_t errors = 0;           // "ERR" responses
+    bool failed = false;         // Connect, send or receive failed part way
+};
+
+// Send everything in the buffer, returns false if the connection failed
+static bool sendAll(int fd, const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Keep up to depth requests outstanding: top up, send them in one write, then read responses
+// until at least one comes back, timing each request from its send to its response line
+static void driveConnection(const ServerAddress& address, const vector<string>& requests, size_t first,
+                            size_t count, unsigned depth, ConnectionResult& result) {
+    int fd = connectToServer(address);
+    if (fd == -1) {
+        result.failed = true;
+        return;
+    }
+    result.latencies_us.reserve(count);
+    deque<Clock::time_point> in_flight;
+    string out;
+    string in;
+    char buffer[16384];
+    size_t next = 0;
+    while (result.latencies_us.size() < count) {
+        out.clear();
+        Clock::time_point now = Clock::now();
+        while (next < count && in_flight.size() < depth) {
+            out += requests[(first + next++) % requests.size()];
+            out += '\n';
+            in_flight.push_back(now);
+        }
+        if (!out.empty() && !sendAll(fd, out)) {
+            result.failed = true;
+            break;
+        }
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            result.failed = true;
+            break;
+        }
+        Clock::time_point received = Clock::now();
+        in.append(buffer, static_cast<size_t>(n));
+        size_t pos = 0;
+        size_t newline;
+        while ((newline = in.find('\n', pos)) != string::npos && !in_flight.empty()) {
+            if (in.compare(pos, 3, "ERR") == 0) ++result.errors;
+            result.latencies_us.push_back(chrono::duration<double, micro>(received - in_flight.front()).count());
+            in_flight.pop_front();
+            pos = newline + 1;
+        }
+        in.erase(0, pos);
+    }
+    close(fd);
+}
+
+// Percentile of sorted samples (nearest rank)
+static double percentile(const vector<double>& sorted, double p) {
+    size_t rank = static_cast<size_t>(p / 100.0 * static_cast<double>(sorted.size()));
+    return sorted[min(rank, sorted.size() - 1)];
+}
+
+// Split the requests evenly over the connections, run them all at once, then merge the samples
+bool runLoadGenerator(const ServerAddress& address, const string& request_file, unsigned connections,
+                      unsigned depth, size_t total_requests) {
+    ifstream file(request_file);
+    vector<string> requests;
+    string line;
+    while (getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty() && line[0] != '#') requests.push_back(line);
+    }
+    if (requests.empty()) {
+        cout << "No requests found in " << request_file << ".\n";
+        return false;
+    }
+    connections = max(1u, connections);
+    depth = max(1u, depth);
+
+    vector<ConnectionResult> results(connections);
+    vector<thread> threads;
+    Clock::time_point start = Clock::now();
+    size_t first = 0;
+    for (unsigned c = 0; c < connections; ++c) {
+        size_t count = total_requests / connections + (c < total_requests % connections ? 1 : 0);
+        threads.emplace_back(driveConnection, cref(address), cref(requests), first, count, depth, ref(results[c]));
+        first += count;
+    }
+    for (thread& t : threads) t.join();
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    vector<double> latencies;
+    latencies.reserve(total_requests);
+    size_t errors = 0;
+    size_t failed = 0;
+    for (const ConnectionResult& result : results) {
+        latencies.insert(latencies.end(), result.latencies_us.begin(), result.latencies_us.end());
+        errors += result.errors;
+        failed += result.failed ? 1 : 0;
+    }
+    if (latencies.empty()) {
+        cout << "Could not get any answers from the server.\n";
+        return false;
+    }
+    sort(latencies.begin(), latencies.end());
+    cout << latencies.size() << " requests over " << connections << " connections (depth " << depth << ") in "
+         << seconds << " s: " << static_cast<size_t>(latencies.size() / max(seconds, 1e-9)) << " requests/s\n";
+    cout << "Latency (us): p50 " << percentile(latencies, 50) << ", p90 " << percentile(latencies, 90) << ", p99 "
+         << percentile(latencies, 99) << ", p99.9 " << percentile(latencies, 99.9) << ", max " << latencies.back() << "\n";
+    if (errors > 0) cout << errors << " requests were answered with an error.\n";
+    if (failed > 0) cout << failed << " connections failed before finishing.\n";
+    return failed == 0;
+}
@@ -0,0 +1,16 @@
+#ifndef LOAD_GENERATOR_H
+#define LOAD_GENERATOR_H
+
+#include <cstddef>
+#include <string>
+#include "QueryServer.h"
+
+// Load generator for the query server. Request lines are read from a file (in the server's
+// protocol, e.g. "route Kigali,Huye") and sent round-robin over several connections, one thread
+// per connection, each keeping up to `depth` requests in flight (pipelining). Reports throughput
+// and latency percentiles measured from sending a request to reading its response line.
+// Returns false if the file has no requests or the server cannot be reached.
+bool runLoadGenerator(const ServerAddress& address, const std::string& request_file, unsigned connections,
+                      unsigned depth, size_t total_requests);
+
+#endif
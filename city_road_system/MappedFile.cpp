@@ -0,0 +1,67 @@
+#include "MappedFile.h"
+#include "Metrics.h"
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+// Map the file read-only; fall back to reading it if mmap is not possible
+bool MappedFile::open(const string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        length = static_cast<size_t>(st.st_size);
+        if (length == 0) {
+            ::close(fd);
+            bytes = "";
+            is_open = true;
+            return true;
+        }
+        void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            madvise(addr, length, MADV_SEQUENTIAL); // Files are parsed front to back
+            ::close(fd);
+            bytes = static_cast<const char*>(addr);
+            is_mapped = true;
+            is_open = true;
+            recordBytesRead(length);
+            return true;
+        }
+    }
+    ::close(fd);
+
+    // Fallback: read the whole file into memory
+    ifstream file(path, ios::binary);
+    if (!file.is_open()) return false;
+    stringstream contents;
+    contents << file.rdbuf();
+    fallback = contents.str();
+    bytes = fallback.data();
+    length = fallback.size();
+    is_open = true;
+    recordBytesRead(length);
+    return true;
+}
+
+// Release the mapping or the fallback buffer
+void MappedFile::close() {
+    if (is_mapped) {
+        munmap(const_cast<char*>(bytes), length);
+    }
+    fallback.clear();
+    bytes = nullptr;
+    length = 0;
+    is_open = false;
+    is_mapped = false;
+}
@@ -0,0 +1,37 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only view of a whole file. The file is memory-mapped when possible; if
+// mapping fails (e.g., on a pipe or special file) its contents are read into an
+// owned buffer instead, so callers always get one contiguous range of bytes.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Open and map a file, returns false if it cannot be opened
+    bool open(const std::string& path);
+    // Unmap the file and release any buffer
+    void close();
+    // Check if a file is open
+    bool isOpen() const { return is_open; }
+    // File contents
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+    std::string_view view() const { return std::string_view(bytes, length); }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+    bool is_open = false;
+    bool is_mapped = false;
+    std::string fallback; // Holds the contents when the file could not be mapped
+};
+
+#endif
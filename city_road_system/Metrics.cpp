@@ -0,0 +1,295 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+#ifndef CRS_NO_METRICS
+
+#define CRS_OPERATION_COUNT(name) +1
+static const size_t OPERATION_COUNT = 0 CRS_OPERATIONS(CRS_OPERATION_COUNT);
+#undef CRS_OPERATION_COUNT
+#define CRS_OPERATION_NAME(name) #name,
+static const char* const OPERATION_NAMES[] = {CRS_OPERATIONS(CRS_OPERATION_NAME)};
+#undef CRS_OPERATION_NAME
+
+// Latency bucket b counts calls shorter than 2^(b + FIRST_BUCKET_SHIFT) ns (the first bound is
+// about 1 us, each next one doubles); the last bucket counts everything slower
+static const int FIRST_BUCKET_SHIFT = 10;
+static const size_t LATENCY_BUCKETS = 26;
+
+// Counters of one operation in one thread; only the owning thread writes them
+struct OperationCounters {
+    atomic<uint64_t> calls{0};
+    atomic<uint64_t> total_ns{0};
+    atomic<uint64_t> max_ns{0};
+    atomic<uint64_t> bytes_read{0};
+    atomic<uint64_t> bytes_written{0};
+    atomic<uint64_t> buckets[LATENCY_BUCKETS]{};
+};
+
+// All counters of one thread, on cache lines of their own
+struct alignas(64) ThreadMetrics {
+    OperationCounters operations[OPERATION_COUNT];
+};
+
+// Counters of one operation summed over threads
+struct OperationTotals {
+    uint64_t calls = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+    uint64_t buckets[LATENCY_BUCKETS] = {};
+
+    // Add one thread's counters
+    void add(const OperationCounters& counters) {
+        calls += counters.calls.load(memory_order_relaxed);
+        total_ns += counters.total_ns.load(memory_order_relaxed);
+        max_ns = max(max_ns, counters.max_ns.load(memory_order_relaxed));
+        bytes_read += counters.bytes_read.load(memory_order_relaxed);
+        bytes_written += counters.bytes_written.load(memory_order_relaxed);
+        for (size_t b = 0; b < LATENCY_BUCKETS; ++b) buckets[b] += counters.buckets[b].load(memory_order_relaxed);
+    }
+};
+
+// Blocks of live threads, plus the totals of threads that have exited
+struct MetricsRegistry {
+    mutex lock;
+    vector<ThreadMetrics*> live;
+    OperationTotals retired[OPERATION_COUNT];
+};
+
+// Constructed on first use, so it outlives every thread-local block that registers with it
+static MetricsRegistry& registry() {
+    static MetricsRegistry instance;
+    return instance;
+}
+
+// Registers this thread's block on first use and folds it into the retired totals at thread exit
+struct ThreadSlot {
+    ThreadMetrics* metrics;
+
+    ThreadSlot() : metrics(new ThreadMetrics()) {
+        MetricsRegistry& r = registry();
+        lock_guard<mutex> guard(r.lock);
+        r.live.push_back(metrics);
+    }
+    ~ThreadSlot() {
+        MetricsRegistry& r = registry();
+        lock_guard<mutex> guard(r.lock);
+        for (size_t op = 0; op < OPERATION_COUNT; ++op) r.retired[op].add(metrics->operations[op]);
+        r.live.erase(find(r.live.begin(), r.live.end(), metrics));
+        delete metrics;
+    }
+};
+
+// This thread's block
+static ThreadMetrics& threadMetrics() {
+    thread_local ThreadSlot slot;
+    return *slot.metrics;
+}
+
+// Innermost operation running on this thread, -1 for none
+static thread_local int current_operation = -1;
+
+// Only this thread writes the counter, so a plain load and store replaces a locked add
+static inline void bump(atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+OperationTimer::OperationTimer(Operation operation)
+    : operation(operation), previous(current_operation), start(chrono::steady_clock::now()) {
+    current_operation = static_cast<int>(operation);
+}
+
+// Count the call and put its duration in the bucket of its highest set bit
+OperationTimer::~OperationTimer() {
+    uint64_t ns = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    OperationCounters& counters = threadMetrics().operations[static_cast<size_t>(operation)];
+    bump(counters.calls, 1);
+    bump(counters.total_ns, ns);
+    if (ns > counters.max_ns.load(memory_order_relaxed)) counters.max_ns.store(ns, memory_order_relaxed);
+    int bit = ns == 0 ? 0 : 64 - __builtin_clzll(ns); // ns < 2^bit
+    size_t bucket = bit <= FIRST_BUCKET_SHIFT ? 0 : static_cast<size_t>(bit - FIRST_BUCKET_SHIFT);
+    bump(counters.buckets[min(bucket, LATENCY_BUCKETS - 1)], 1);
+    current_operation = previous;
+}
+
+void recordBytesRead(size_t bytes) {
+    if (current_operation >= 0) bump(threadMetrics().operations[current_operation].bytes_read, bytes);
+}
+
+void recordBytesWritten(size_t bytes) {
+    if (current_operation >= 0) bump(threadMetrics().operations[current_operation].bytes_written, bytes);
+}
+
+// Sum the retired totals and every live thread's block
+static vector<OperationTotals> collectMetrics() {
+    MetricsRegistry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    vector<OperationTotals> totals(r.retired, r.retired + OPERATION_COUNT);
+    for (const ThreadMetrics* metrics : r.live) {
+        for (size_t op = 0; op < OPERATION_COUNT; ++op) totals[op].add(metrics->operations[op]);
+    }
+    return totals;
+}
+
+// Upper bound of a latency bucket in nanoseconds
+static double bucketBound(size_t bucket) {
+    return static_cast<double>(uint64_t(1) << (bucket + FIRST_BUCKET_SHIFT));
+}
+
+// Upper bound of the bucket holding the given fraction of calls (the last bucket reports the maximum)
+static double latencyPercentile(const OperationTotals& totals, double fraction) {
+    uint64_t wanted = static_cast<uint64_t>(fraction * static_cast<double>(totals.calls) + 0.5);
+    uint64_t seen = 0;
+    for (size_t b = 0; b + 1 < LATENCY_BUCKETS; ++b) {
+        seen += totals.buckets[b];
+        if (seen >= max<uint64_t>(wanted, 1)) return min(bucketBound(b), static_cast<double>(totals.max_ns));
+    }
+    return static_cast<double>(totals.max_ns);
+}
+
+// Nanoseconds in the largest unit that keeps the number at least 1
+static string formatDuration(double ns) {
+    const char* units[] = {"ns", "us", "ms", "s"};
+    int unit = 0;
+    while (ns >= 1000.0 && unit < 3) {
+        ns /= 1000.0;
+        ++unit;
+    }
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), ns < 10.0 ? "%.2f %s" : ns < 100.0 ? "%.1f %s" : "%.0f %s", ns, units[unit]);
+    return buffer;
+}
+
+// p50/p99 are bucket upper bounds, so they are accurate to within a factor of two
+void printMetrics(ostream& out) {
+    vector<OperationTotals> totals = collectMetrics();
+    out << left << setw(28) << "Operation" << right << setw(10) << "Calls" << setw(11) << "Mean" << setw(11)
+        << "p50 <=" << setw(11) << "p99 <=" << setw(11) << "Max" << setw(14) << "Bytes read" << setw(15)
+        << "Bytes written" << "\n";
+    bool any = false;
+    for (size_t op = 0; op < OPERATION_COUNT; ++op) {
+        const OperationTotals& t = totals[op];
+        if (t.calls == 0) continue;
+        any = true;
+        out << left << setw(28) << OPERATION_NAMES[op] << right << setw(10) << t.calls << setw(11)
+            << formatDuration(static_cast<double>(t.total_ns) / static_cast<double>(t.calls)) << setw(11)
+            << formatDuration(latencyPercentile(t, 0.5)) << setw(11) << formatDuration(latencyPercentile(t, 0.99))
+            << setw(11) << formatDuration(static_cast<double>(t.max_ns)) << setw(14) << t.bytes_read << setw(15)
+            << t.bytes_written << "\n";
+    }
+    if (!any) out << "No operations recorded yet.\n";
+}
+
+// Histogram buckets are cumulative, as Prometheus expects; bounds are in seconds
+void writePrometheusMetrics(ostream& out) {
+    vector<OperationTotals> totals = collectMetrics();
+    out << "# HELP crs_operation_duration_seconds Latency of city road system operations.\n"
+        << "# TYPE crs_operation_duration_seconds histogram\n";
+    for (size_t op = 0; op < OPERATION_COUNT; ++op) {
+        const OperationTotals& t = totals[op];
+        if (t.calls == 0) continue;
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b + 1 < LATENCY_BUCKETS; ++b) {
+            cumulative += t.buckets[b];
+            out << "crs_operation_duration_seconds_bucket{operation=\"" << OPERATION_NAMES[op] << "\",le=\""
+                << bucketBound(b) / 1e9 << "\"} " << cumulative << "\n";
+        }
+        out << "crs_operation_duration_seconds_bucket{operation=\"" << OPERATION_NAMES[op] << "\",le=\"+Inf\"} "
+            << t.calls << "\n";
+        out << "crs_operation_duration_seconds_sum{operation=\"" << OPERATION_NAMES[op] << "\"} "
+            << static_cast<double>(t.total_ns) / 1e9 << "\n";
+        out << "crs_operation_duration_seconds_count{operation=\"" << OPERATION_NAMES[op] << "\"} " << t.calls << "\n";
+    }
+    const char* byte_metrics[2][2] = {{"crs_operation_bytes_read_total", "Bytes read from files by each operation."},
+                                      {"crs_operation_bytes_written_total", "Bytes written to files by each operation."}};
+    for (int kind = 0; kind < 2; ++kind) {
+        out << "# HELP " << byte_metrics[kind][0] << " " << byte_metrics[kind][1] << "\n"
+            << "# TYPE " << byte_metrics[kind][0] << " counter\n";
+        for (size_t op = 0; op < OPERATION_COUNT; ++op) {
+            uint64_t bytes = kind == 0 ? totals[op].bytes_read : totals[op].bytes_written;
+            if (bytes == 0) continue;
+            out << byte_metrics[kind][0] << "{operation=\"" << OPERATION_NAMES[op] << "\"} " << bytes << "\n";
+        }
+    }
+}
+
+#else
+
+// Nothing is recorded when metrics are compiled out
+void printMetrics(ostream& out) {
+    out << "Metrics were disabled at compile time (CRS_NO_METRICS).\n";
+}
+
+// An empty exposition with a note on why
+void writePrometheusMetrics(ostream& out) {
+    out << "# Metrics were disabled at compile time (CRS_NO_METRICS).\n";
+}
+
+#endif
+
+// Write to a temporary file and rename it, so a scraper never reads a half-written dump
+bool writeMetricsFile(const string& path) {
+    string temp_path = path + ".tmp";
+    ofstream out(temp_path);
+    writePrometheusMetrics(out);
+    out.close();
+    return !out.fail() && rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+// Background thread rewriting the dump file on a fixed interval
+struct MetricsDumper {
+    mutex lock;
+    condition_variable wake;
+    thread worker;
+    bool stopping = false;
+
+    ~MetricsDumper() { stop(); }
+
+    // Wake the thread, wait for its last write and reset for a later start
+    void stop() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (worker.joinable()) worker.join();
+        stopping = false;
+    }
+};
+
+// Created after the metrics registry, so it is destroyed (and its thread joined) before it
+static MetricsDumper& dumper() {
+#ifndef CRS_NO_METRICS
+    registry();
+#endif
+    static MetricsDumper instance;
+    return instance;
+}
+
+// Write once a period until stopped, then once more so the file has the final counts
+void startMetricsDump(const string& path, unsigned interval_seconds) {
+    MetricsDumper& d = dumper();
+    d.stop();
+    d.worker = thread([&d, path, interval_seconds] {
+        unique_lock<mutex> guard(d.lock);
+        while (!d.wake.wait_for(guard, chrono::seconds(max(1u, interval_seconds)), [&d] { return d.stopping; })) {
+            writeMetricsFile(path);
+        }
+        writeMetricsFile(path);
+    });
+}
+
+void stopMetricsDump() {
+    dumper().stop();
+}
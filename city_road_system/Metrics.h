@@ -0,0 +1,83 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Operation metrics: call counts, latency histograms and bytes read/written for every public
+// CityRoadSystem operation and the persistence helpers. Each thread counts into its own block
+// (single writer, relaxed atomics, no shared cache lines), and a dump sums the blocks of all
+// threads. Bytes read or written while an operation runs count toward the innermost operation
+// on that thread; I/O outside any operation is not counted.
+// Build with -DCRS_NO_METRICS to compile all of it out: the timer becomes an empty object and
+// the byte counters empty inline functions.
+
+// Every instrumented operation, in dump order
+#define CRS_OPERATIONS(X)                                                                          \
+    X(loadData) X(addCities) X(addCity) X(importCities) X(importCitiesFromFile) X(addRoad)         \
+    X(readBudget) X(updateBudget) X(deleteBudget) X(deleteRoad) X(deleteCity) X(updateCityName)    \
+    X(searchCity) X(displayCities) X(displayRoads) X(displayAdjacencyMatrices) X(displayAllData)   \
+    X(displayCitiesAndRoadMatrix) X(generateGraphImage) X(displayRoadsPage)                        \
+    X(displayMatrixWindow) X(displaySparseMatrix) X(exportNetwork) X(compactData)                  \
+    X(saveSnapshot) X(findShortestPath) X(findNearestCities) X(answerRouteQueries)                 \
+    X(buildRouteIndex) X(planMinimumNetwork) X(findConnectedComponents) X(findCitiesWithinHops)    \
+    X(findCommonNeighbors) X(displayNetworkSummary) X(displayCityTotals) X(displayTopRoads)        \
+    X(displayRoadsInBudgetRange) X(checkConnected) X(analyzeCentrality) X(saveVersion)             \
+    X(restoreVersion) X(diffVersions) X(deleteVersion) X(listVersions) X(undoLastChange)           \
+    X(buildRegionShards) X(displayRegions) X(displayRegion) X(checkpoint) X(stressTestReaders)     \
+    X(saveCitiesToFile) X(saveRoadsToFile) X(generateDotFile) X(loadRegion)
+
+enum class Operation {
+#define CRS_OPERATION_ENUM(name) name,
+    CRS_OPERATIONS(CRS_OPERATION_ENUM)
+#undef CRS_OPERATION_ENUM
+};
+
+#ifndef CRS_NO_METRICS
+
+// Times one call of an operation from construction to destruction and makes it the target of
+// byte counts on this thread while it runs
+class OperationTimer {
+public:
+    explicit OperationTimer(Operation operation);
+    ~OperationTimer();
+    OperationTimer(const OperationTimer&) = delete;
+    OperationTimer& operator=(const OperationTimer&) = delete;
+
+private:
+    Operation operation;
+    int previous; // Operation that was running on this thread before, -1 for none
+    std::chrono::steady_clock::time_point start;
+};
+
+// Count bytes read from or written to files by the operation running on this thread
+void recordBytesRead(size_t bytes);
+void recordBytesWritten(size_t bytes);
+
+#else
+
+class OperationTimer {
+public:
+    explicit OperationTimer(Operation) {}
+};
+
+inline void recordBytesRead(size_t) {}
+inline void recordBytesWritten(size_t) {}
+
+#endif
+
+// Table of calls, mean/p50/p99/max latency and bytes per operation (operations never called are left out)
+void printMetrics(std::ostream& out);
+// Prometheus text exposition format: latency histograms and byte counters labelled by operation
+void writePrometheusMetrics(std::ostream& out);
+// Write the Prometheus dump to a file (via a temporary file and rename), returns false on a write error
+bool writeMetricsFile(const std::string& path);
+// Rewrite the dump file every interval_seconds from a background thread until stopMetricsDump
+void startMetricsDump(const std::string& path, unsigned interval_seconds);
+// Stop the background dump after writing the file one last time
+void stopMetricsDump();
+
+#endif
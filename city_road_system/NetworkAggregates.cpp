@@ -0,0 +1,166 @@
+#include "NetworkAggregates.h"
+#include <algorithm>
+
+using namespace std;
+
+// One pass over the roads; the budget index waits for its first query
+void NetworkAggregates::rebuild(const RoadStore& roads) {
+    size_t n = roads.cityCount();
+    components.reset(n);
+    components_stale = false;
+    deleted = 0;
+    degrees.assign(n, 0);
+    budget_sums.assign(n, 0.0);
+    by_budget.clear();
+    index_built = false;
+    road_count = roads.roadCount();
+    total_budget = 0.0;
+    roads.forEachRoad([&](int i, int j, double budget) {
+        ++degrees[i];
+        ++degrees[j];
+        budget_sums[i] += budget;
+        budget_sums[j] += budget;
+        total_budget += budget;
+        components.unite(i, j);
+    });
+    isolated = static_cast<size_t>(count(degrees.begin(), degrees.end(), 0u));
+    largest = 0;
+    for (size_t i = 0; i < n; ++i) largest = max(largest, components.size(static_cast<int>(i)));
+}
+
+// O(n): the roads are only read later, if a component query comes
+void NetworkAggregates::restore(const RoadStore& roads, const double* sums, double total) {
+    size_t n = roads.cityCount();
+    components.reset(n);
+    components_stale = true;
+    deleted = 0;
+    degrees.resize(n);
+    for (size_t i = 0; i < n; ++i) degrees[i] = static_cast<uint32_t>(roads.row(static_cast<int>(i)).size());
+    budget_sums.assign(sums, sums + n);
+    by_budget.clear();
+    index_built = false;
+    road_count = roads.roadCount();
+    total_budget = total;
+    isolated = static_cast<size_t>(count(degrees.begin(), degrees.end(), 0u));
+    largest = 0;
+}
+
+// Union every road again; deleted cities have no roads, so they stay singletons
+void NetworkAggregates::refreshComponents(const RoadStore& roads) const {
+    if (!components_stale) return;
+    components.reset(degrees.size());
+    roads.forEachRoad([&](int i, int j, double) { components.unite(i, j); });
+    largest = 0;
+    for (size_t i = 0; i < degrees.size(); ++i) largest = max(largest, components.size(static_cast<int>(i)));
+    components_stale = false;
+}
+
+// Deleted cities are singleton components of their own, so they are subtracted
+size_t NetworkAggregates::componentCount(const RoadStore& roads) const {
+    refreshComponents(roads);
+    return components.count() - deleted;
+}
+
+size_t NetworkAggregates::largestComponent(const RoadStore& roads) const {
+    refreshComponents(roads);
+    return degrees.size() == deleted ? 0 : largest;
+}
+
+int NetworkAggregates::componentOf(const RoadStore& roads, int city) const {
+    refreshComponents(roads);
+    return components.root(city);
+}
+
+// The sums lose the road at once; the components wait for the next query
+void NetworkAggregates::removeRoad(int city1, int city2, double budget) {
+    for (int city : {city1, city2}) {
+        if (--degrees[city] == 0) ++isolated;
+        budget_sums[city] -= budget;
+    }
+    total_budget -= budget;
+    --road_count;
+    if (index_built) by_budget.erase({budget, min(city1, city2), max(city1, city2)});
+    components_stale = true;
+}
+
+// A deleted city no longer counts as an isolated city
+void NetworkAggregates::markDeleted(int city) {
+    if (degrees[city] == 0) --isolated;
+    ++deleted;
+}
+
+// A reused slot starts as an isolated city again
+void NetworkAggregates::markRevived(int city) {
+    if (degrees[city] == 0) ++isolated;
+    --deleted;
+}
+
+// New cities are isolated singletons
+void NetworkAggregates::resize(size_t num_cities) {
+    if (num_cities <= degrees.size()) return;
+    isolated += num_cities - degrees.size();
+    degrees.resize(num_cities, 0);
+    budget_sums.resize(num_cities, 0.0);
+    components.grow(num_cities);
+    largest = max<size_t>(largest, 1);
+}
+
+// A city stops being isolated with its first road
+void NetworkAggregates::addDegree(int city) {
+    if (degrees[city]++ == 0) --isolated;
+}
+
+void NetworkAggregates::addRoad(int city1, int city2, double budget) {
+    addDegree(city1);
+    addDegree(city2);
+    budget_sums[city1] += budget;
+    budget_sums[city2] += budget;
+    total_budget += budget;
+    ++road_count;
+    if (index_built) by_budget.insert({budget, min(city1, city2), max(city1, city2)});
+    if (components.unite(city1, city2)) largest = max(largest, components.size(city1));
+}
+
+// Move the road's index entry and shift the sums by the difference
+void NetworkAggregates::changeBudget(int city1, int city2, double old_budget, double new_budget) {
+    int a = min(city1, city2);
+    int b = max(city1, city2);
+    if (index_built) {
+        by_budget.erase({old_budget, a, b});
+        by_budget.insert({new_budget, a, b});
+    }
+    double delta = new_budget - old_budget;
+    budget_sums[a] += delta;
+    budget_sums[b] += delta;
+    total_budget += delta;
+}
+
+// Filled from a sorted list with end hints, which costs O(1) per road instead of a search each
+void NetworkAggregates::buildIndex(const RoadStore& roads) const {
+    if (index_built) return;
+    vector<BudgetEntry> entries;
+    entries.reserve(roads.roadCount());
+    roads.forEachRoad([&](int i, int j, double budget) { entries.push_back({budget, i, j}); });
+    sort(entries.begin(), entries.end());
+    by_budget.clear();
+    for (const BudgetEntry& entry : entries) by_budget.insert(by_budget.end(), entry);
+    index_built = true;
+}
+
+// The index is ordered most expensive first, so the top k are its first k entries
+void NetworkAggregates::topRoads(const RoadStore& roads, size_t k, vector<RoadEdge>& result) const {
+    buildIndex(roads);
+    result.clear();
+    for (auto it = by_budget.begin(); it != by_budget.end() && result.size() < k; ++it) {
+        result.push_back({it->city1, it->city2, it->budget});
+    }
+}
+
+// Start at the first road costing at most high and stop below low
+void NetworkAggregates::roadsInRange(const RoadStore& roads, double low, double high, vector<RoadEdge>& result) const {
+    buildIndex(roads);
+    result.clear();
+    for (auto it = by_budget.lower_bound({high, -1, -1}); it != by_budget.end() && it->budget >= low; ++it) {
+        result.push_back({it->city1, it->city2, it->budget});
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef NETWORK_AGGREGATES_H
+#define NETWORK_AGGREGATES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <vector>
+#include "RoadStore.h"
+#include "UnionFind.h"
+
+// Summaries of the road network kept up to date on every change, so planners' questions never
+// scan the roads: components (union-find), per-city degree and budget sums, network totals,
+// and an ordered index of roads by budget for top-k and budget-range queries. The index is
+// built on the first query that needs it (so loading stays one linear pass) and maintained
+// from then on.
+// Union-find cannot split a component, so removing a road only marks the components stale;
+// the next component query rebuilds them in one pass over the roads.
+// Deleted cities (tombstones) are left out of the city, isolated and component counts.
+class NetworkAggregates {
+public:
+    // Recompute everything from the roads (after loading); deleted cities are marked afterwards
+    void rebuild(const RoadStore& roads);
+    // Same state from budget sums and a total kept with the roads (a snapshot) without reading
+    // the roads: degrees are the row lengths and the components wait for their first query
+    void restore(const RoadStore& roads, const double* sums, double total);
+    // Grow to num_cities cities; new cities have no roads
+    void resize(size_t num_cities);
+    // Record a new road
+    void addRoad(int city1, int city2, double budget);
+    // Record a budget change of an existing road (a deleted budget is a change to 0)
+    void changeBudget(int city1, int city2, double old_budget, double new_budget);
+    // Record the removal of a road
+    void removeRoad(int city1, int city2, double budget);
+    // Mark a city without roads as deleted, or a deleted slot as reused by a new city
+    void markDeleted(int city);
+    void markRevived(int city);
+
+    // Number of roads at a city, O(1)
+    size_t degree(int city) const { return degrees[city]; }
+    // Total budget of the roads at a city, O(1)
+    double budgetAt(int city) const { return budget_sums[city]; }
+    // Number of roads and their total budget, O(1)
+    size_t roadCount() const { return road_count; }
+    double totalBudget() const { return total_budget; }
+    // Cities without any road, O(1)
+    size_t isolatedCount() const { return isolated; }
+    // Number of connected components and cities in the largest one, O(1) (one pass over roads
+    // after a road was removed). roads must be the store these aggregates follow.
+    size_t componentCount(const RoadStore& roads) const;
+    size_t largestComponent(const RoadStore& roads) const;
+    // Component representative of a city (equal for cities that are connected), O(log n)
+    int componentOf(const RoadStore& roads, int city) const;
+
+    // The k most expensive roads, most expensive first (ties by city index), O(log n + k).
+    // roads must be the store these aggregates follow; it is read once to build the index.
+    void topRoads(const RoadStore& roads, size_t k, std::vector<RoadEdge>& result) const;
+    // Roads with low <= budget <= high, most expensive first, O(log n + number found)
+    void roadsInRange(const RoadStore& roads, double low, double high, std::vector<RoadEdge>& result) const;
+
+private:
+    // Index entry: roads ordered by budget, most expensive first, then by cities (city1 < city2)
+    struct BudgetEntry {
+        double budget;
+        int city1;
+        int city2;
+        bool operator<(const BudgetEntry& other) const {
+            if (budget != other.budget) return budget > other.budget;
+            if (city1 != other.city1) return city1 < other.city1;
+            return city2 < other.city2;
+        }
+    };
+
+    mutable UnionFind components;
+    mutable bool components_stale = false;
+    mutable size_t largest = 0;
+    size_t deleted = 0;
+    std::vector<uint32_t> degrees;
+    std::vector<double> budget_sums;
+    mutable std::set<BudgetEntry> by_budget;
+    mutable bool index_built = false;
+    size_t road_count = 0;
+    double total_budget = 0.0;
+    size_t isolated = 0;
+
+    // Update the degree of a city and the isolated count
+    void addDegree(int city);
+    // Fill the budget index from the roads if it has not been built yet
+    void buildIndex(const RoadStore& roads) const;
+    // Recompute the union-find and the largest component if a road was removed
+    void refreshComponents(const RoadStore& roads) const;
+};
+
+#endif
@@ -0,0 +1,221 @@
+#include "NetworkCentrality.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+// Sources per block handed out by the scheduler: small enough to even out the threads at the
+// end, large enough that the queue locks are rarely contended
+static const size_t SOURCE_BLOCK = 8;
+static const uint32_t NOT_SETTLED = numeric_limits<uint32_t>::max();
+
+// The roads copied into flat CSR arrays, which the inner loops walk once per source
+struct CentralityGraph {
+    vector<uint32_t> offsets; // Arcs of city i are offsets[i] .. offsets[i + 1]
+    vector<int> targets;
+    vector<double> weights;
+};
+
+// Blocks [begin, end) of the source list waiting for one thread
+struct SourceQueue {
+    mutex lock;
+    deque<pair<size_t, size_t>> blocks;
+};
+
+// Scratch buffers and private accumulators of one thread. Like PathEngine, the buffers are
+// only trusted for cities stamped with the current source number, so nothing is cleared per source.
+struct BrandesWorker {
+    vector<double> dist;            // Cheapest budget from the source
+    vector<double> sigma;           // Number of cheapest routes from the source
+    vector<double> delta;           // Dependency of the source on the city
+    vector<uint32_t> stamp;         // Source number that last reached the city
+    vector<uint32_t> rank;          // Position in settling order, NOT_SETTLED until settled
+    vector<int> order;              // Cities in settling order
+    vector<pair<double, int>> heap; // Min-heap on budget with lazy deletion
+    uint32_t query = 0;
+    vector<double> betweenness;
+    vector<double> distance_sum;
+    vector<uint32_t> reached_by;
+    vector<double> arc_betweenness; // Per arc of the CSR arrays (each road twice)
+
+    // Size the buffers; called on the worker's own thread so its pages are local to it
+    void prepare(const CentralityGraph& graph);
+    // Dijkstra from source counting cheapest routes, then accumulate dependencies backwards
+    void run(const CentralityGraph& graph, int source);
+};
+
+void BrandesWorker::prepare(const CentralityGraph& graph) {
+    size_t n = graph.offsets.size() - 1;
+    dist.assign(n, 0.0);
+    sigma.assign(n, 0.0);
+    delta.assign(n, 0.0);
+    stamp.assign(n, 0);
+    rank.assign(n, NOT_SETTLED);
+    betweenness.assign(n, 0.0);
+    distance_sum.assign(n, 0.0);
+    reached_by.assign(n, 0);
+    arc_betweenness.assign(graph.targets.size(), 0.0);
+    order.reserve(n);
+}
+
+// A city's predecessors are the neighbours settled before it whose distance plus the road
+// budget gives exactly its distance. That sum is the same expression the relaxation
+// computed, so the test agrees with the route counts without storing predecessor lists.
+void BrandesWorker::run(const CentralityGraph& graph, int source) {
+    ++query;
+    order.clear();
+    heap.clear();
+    stamp[source] = query;
+    dist[source] = 0.0;
+    sigma[source] = 1.0;
+    delta[source] = 0.0;
+    rank[source] = NOT_SETTLED;
+    heap.push_back({0.0, source});
+    while (!heap.empty()) {
+        pop_heap(heap.begin(), heap.end(), greater<pair<double, int>>());
+        int u = heap.back().second;
+        double d = heap.back().first;
+        heap.pop_back();
+        if (rank[u] != NOT_SETTLED || d > dist[u]) continue; // Stale entry
+        rank[u] = static_cast<uint32_t>(order.size());
+        order.push_back(u);
+        for (uint32_t a = graph.offsets[u]; a < graph.offsets[u + 1]; ++a) {
+            int v = graph.targets[a];
+            double through_u = d + graph.weights[a];
+            if (stamp[v] != query) {
+                stamp[v] = query;
+                rank[v] = NOT_SETTLED;
+                delta[v] = 0.0;
+            } else if (rank[v] != NOT_SETTLED || through_u > dist[v]) {
+                continue;
+            } else if (through_u == dist[v]) {
+                sigma[v] += sigma[u]; // Another cheapest route
+                continue;
+            }
+            dist[v] = through_u;
+            sigma[v] = sigma[u];
+            heap.push_back({through_u, v});
+            push_heap(heap.begin(), heap.end(), greater<pair<double, int>>());
+        }
+    }
+
+    // Latest settled first, so every city's dependency is complete before it is passed on
+    for (size_t i = order.size(); i-- > 1;) {
+        int w = order[i];
+        double share = (1.0 + delta[w]) / sigma[w];
+        for (uint32_t a = graph.offsets[w]; a < graph.offsets[w + 1]; ++a) {
+            int v = graph.targets[a];
+            if (rank[v] < i && dist[v] + graph.weights[a] == dist[w]) {
+                double part = sigma[v] * share;
+                delta[v] += part;
+                arc_betweenness[a] += part;
+            }
+        }
+        betweenness[w] += delta[w];
+        distance_sum[w] += dist[w];
+        ++reached_by[w];
+    }
+}
+
+// Take the next block: the front of this thread's own queue, or else the back of another's
+static bool takeBlock(SourceQueue* queues, unsigned threads, unsigned self, pair<size_t, size_t>& block,
+                      atomic<size_t>& steals) {
+    for (unsigned k = 0; k < threads; ++k) {
+        SourceQueue& queue = queues[(self + k) % threads];
+        lock_guard<mutex> guard(queue.lock);
+        if (queue.blocks.empty()) continue;
+        if (k == 0) {
+            block = queue.blocks.front();
+            queue.blocks.pop_front();
+        } else {
+            block = queue.blocks.back(); // The far end of the victim's queue, away from where it is working
+            queue.blocks.pop_back();
+            steals.fetch_add(1, memory_order_relaxed);
+        }
+        return true;
+    }
+    return false; // No source is added while computing, so every queue stays empty from here on
+}
+
+NetworkCentrality::NetworkCentrality(unsigned num_threads) : num_threads(num_threads) {
+    if (this->num_threads == 0) this->num_threads = max(1u, thread::hardware_concurrency());
+}
+
+// Each thread starts with a contiguous run of blocks; the accumulators are summed in thread
+// order at the end
+void NetworkCentrality::compute(const RoadStore& roads, const vector<int>& sources, size_t population,
+                                CentralityScores& scores) const {
+    size_t n = roads.cityCount();
+    CentralityGraph graph;
+    graph.offsets.reserve(n + 1);
+    graph.offsets.push_back(0);
+    graph.targets.reserve(roads.roadCount() * 2);
+    graph.weights.reserve(roads.roadCount() * 2);
+    for (size_t i = 0; i < n; ++i) {
+        for (const Road& road : roads.row(static_cast<int>(i))) {
+            graph.targets.push_back(road.to);
+            graph.weights.push_back(road.budget);
+        }
+        graph.offsets.push_back(static_cast<uint32_t>(graph.targets.size()));
+    }
+
+    size_t block_count = (sources.size() + SOURCE_BLOCK - 1) / SOURCE_BLOCK;
+    unsigned threads = static_cast<unsigned>(max<size_t>(1, min<size_t>(num_threads, block_count)));
+    unique_ptr<SourceQueue[]> queues(new SourceQueue[threads]);
+    for (size_t b = 0; b < block_count; ++b) {
+        queues[b * threads / block_count].blocks.push_back({b * SOURCE_BLOCK, min(sources.size(), (b + 1) * SOURCE_BLOCK)});
+    }
+    vector<BrandesWorker> workers(threads);
+    atomic<size_t> steals{0};
+    auto work = [&](unsigned self) {
+        BrandesWorker& worker = workers[self];
+        worker.prepare(graph);
+        pair<size_t, size_t> block;
+        while (takeBlock(queues.get(), threads, self, block, steals)) {
+            for (size_t k = block.first; k < block.second; ++k) worker.run(graph, sources[k]);
+        }
+    };
+    vector<thread> pool;
+    for (unsigned t = 1; t < threads; ++t) pool.emplace_back(work, t);
+    work(0); // This thread runs sources too
+    for (thread& worker : pool) worker.join();
+
+    // Every pair is seen from both ends when every city is a source, hence the half
+    double scale = sources.empty() ? 0.0 : static_cast<double>(population) / (2.0 * static_cast<double>(sources.size()));
+    scores.betweenness.assign(n, 0.0);
+    scores.distance_sum.assign(n, 0.0);
+    scores.reached_by.assign(n, 0);
+    vector<double> arcs(graph.targets.size(), 0.0);
+    for (const BrandesWorker& worker : workers) {
+        for (size_t i = 0; i < n; ++i) {
+            scores.betweenness[i] += worker.betweenness[i];
+            scores.distance_sum[i] += worker.distance_sum[i];
+            scores.reached_by[i] += worker.reached_by[i];
+        }
+        for (size_t a = 0; a < arcs.size(); ++a) arcs[a] += worker.arc_betweenness[a];
+    }
+    for (double& value : scores.betweenness) value *= scale;
+
+    // A road's score is the sum over its two arcs
+    scores.roads.clear();
+    scores.road_betweenness.clear();
+    scores.roads.reserve(roads.roadCount());
+    scores.road_betweenness.reserve(roads.roadCount());
+    for (size_t i = 0; i < n; ++i) {
+        for (uint32_t a = graph.offsets[i]; a < graph.offsets[i + 1]; ++a) {
+            int j = graph.targets[a];
+            if (j <= static_cast<int>(i)) continue;
+            auto row_j = graph.targets.begin() + graph.offsets[j];
+            auto back = lower_bound(row_j, graph.targets.begin() + graph.offsets[j + 1], static_cast<int>(i));
+            scores.roads.push_back({static_cast<int>(i), j, graph.weights[a]});
+            scores.road_betweenness.push_back((arcs[a] + arcs[back - graph.targets.begin()]) * scale);
+        }
+    }
+    scores.steals = steals.load();
+}
@@ -0,0 +1,51 @@
+#ifndef NETWORK_CENTRALITY_H
+#define NETWORK_CENTRALITY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "RoadStore.h"
+
+// Centrality of every city and road, with road budgets as lengths. Indices are city indices.
+struct CentralityScores {
+    // Cheapest routes between pairs of other cities that pass through each city; routes tied
+    // for cheapest share the pair equally. Each unordered pair counts once.
+    std::vector<double> betweenness;
+    // Total budget of the cheapest routes from the sources that reach each city, and how many
+    // sources (other than the city itself) that is. With every city as a source, closeness is
+    // reached_by / distance_sum; with a sample, the same ratio estimates it.
+    std::vector<double> distance_sum;
+    std::vector<uint32_t> reached_by;
+    // Every road once (city1 < city2, in row order) and the cheapest routes that use it
+    std::vector<RoadEdge> roads;
+    std::vector<double> road_betweenness;
+    // Blocks of sources that threads took from another thread's queue
+    size_t steals = 0;
+};
+
+// Brandes' algorithm over budget-weighted roads: one Dijkstra per source counts the cheapest
+// routes to every city, then a pass back over the cities in settling order accumulates each
+// city's and road's share of them. Sources are independent, so they are split over worker
+// threads with private accumulators that are summed at the end. Sources go out in small
+// blocks from per-thread queues: a thread works through its own queue front to back, and once
+// it is empty steals blocks from the back of the other queues, so cities with large
+// reachable parts (slow sources) do not leave the other threads idle at the end.
+// Sampling (Brandes-Pich): running from k of n cities and scaling betweenness by n / k gives an
+// unbiased estimate in k / n of the time.
+class NetworkCentrality {
+public:
+    // num_threads = 0 uses one thread per hardware core
+    explicit NetworkCentrality(unsigned num_threads = 0);
+
+    // Run from every city in sources, drawn from population cities (sources.size() of them for
+    // the exact scores); betweenness is scaled by population / sources.size()
+    void compute(const RoadStore& roads, const std::vector<int>& sources, size_t population,
+                 CentralityScores& scores) const;
+    // Number of worker threads
+    unsigned threadCount() const { return num_threads; }
+
+private:
+    unsigned num_threads;
+};
+
+#endif
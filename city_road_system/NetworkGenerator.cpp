@@ -0,0 +1,155 @@
+#include "NetworkGenerator.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <random>
+
+using namespace std;
+
+// Uniform double in [0, 1) from the raw generator output; std distributions differ between
+// standard libraries, so they would break "same seed, same network" across compilers
+static double unitRandom(mt19937_64& rng) {
+    return static_cast<double>(rng() >> 11) * 0x1.0p-53;
+}
+
+// Budget rounded to three decimals so it survives the trip through roads.txt unchanged
+static double roundBudget(double budget) {
+    return max(0.001, round(budget * 1000.0) / 1000.0);
+}
+
+// Random budget between 1 and 10 billion RWF
+static double randomBudget(mt19937_64& rng) {
+    return roundBudget(1.0 + 9.0 * unitRandom(rng));
+}
+
+// "grid", "geometric" or "scale-free"
+bool parseNetworkShape(const string& text, NetworkShape& shape) {
+    if (text == "grid") {
+        shape = NetworkShape::Grid;
+    } else if (text == "geometric") {
+        shape = NetworkShape::Geometric;
+    } else if (text == "scale-free") {
+        shape = NetworkShape::ScaleFree;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Inverse of parseNetworkShape
+const char* networkShapeName(NetworkShape shape) {
+    switch (shape) {
+    case NetworkShape::Grid: return "grid";
+    case NetworkShape::Geometric: return "geometric";
+    case NetworkShape::ScaleFree: return "scale-free";
+    }
+    return "grid";
+}
+
+// Lattice with side ceil(sqrt(n)); the last row may be partial
+static void generateGrid(size_t n, mt19937_64& rng, vector<RoadEdge>& roads) {
+    size_t side = max<size_t>(1, static_cast<size_t>(ceil(sqrt(static_cast<double>(n)))));
+    for (size_t i = 0; i < n; ++i) {
+        if ((i + 1) % side != 0 && i + 1 < n) {
+            roads.push_back({static_cast<int>(i), static_cast<int>(i + 1), randomBudget(rng)});
+        }
+        if (i + side < n) {
+            roads.push_back({static_cast<int>(i), static_cast<int>(i + side), randomBudget(rng)});
+        }
+    }
+}
+
+// Points in the unit square bucketed into cells of the join radius, so only neighbouring
+// cells are compared. Road budgets are the distance times 100.
+static void generateGeometric(size_t n, double average_degree, mt19937_64& rng, vector<RoadEdge>& roads) {
+    const double pi = 3.14159265358979323846;
+    double radius = sqrt(average_degree / (pi * static_cast<double>(max<size_t>(n, 1))));
+    size_t side = static_cast<size_t>(sqrt(static_cast<double>(n))) + 1; // Keeps the bucket count near n
+    size_t cells = max<size_t>(1, min(static_cast<size_t>(1.0 / radius), side));
+    vector<double> x(n), y(n);
+    vector<vector<int>> bucket(cells * cells);
+    auto cellOf = [cells](double v) { return min(cells - 1, static_cast<size_t>(v * static_cast<double>(cells))); };
+    for (size_t i = 0; i < n; ++i) {
+        x[i] = unitRandom(rng);
+        y[i] = unitRandom(rng);
+        bucket[cellOf(y[i]) * cells + cellOf(x[i])].push_back(static_cast<int>(i));
+    }
+    for (size_t i = 0; i < n; ++i) {
+        size_t cx = cellOf(x[i]);
+        size_t cy = cellOf(y[i]);
+        for (size_t ny = cy > 0 ? cy - 1 : 0; ny <= min(cells - 1, cy + 1); ++ny) {
+            for (size_t nx = cx > 0 ? cx - 1 : 0; nx <= min(cells - 1, cx + 1); ++nx) {
+                for (int j : bucket[ny * cells + nx]) {
+                    if (j <= static_cast<int>(i)) continue;
+                    double distance = hypot(x[i] - x[j], y[i] - y[j]);
+                    if (distance < radius) roads.push_back({static_cast<int>(i), j, roundBudget(distance * 100.0)});
+                }
+            }
+        }
+    }
+}
+
+// Barabási–Albert: start from a clique of links + 1 cities, then every new city picks `links`
+// distinct targets by sampling road endpoints, which favours well-connected cities
+static void generateScaleFree(size_t n, double average_degree, mt19937_64& rng, vector<RoadEdge>& roads) {
+    size_t links = max<size_t>(1, static_cast<size_t>(lround(average_degree / 2.0)));
+    size_t seed_cities = min(n, links + 1);
+    vector<int> endpoints;
+    for (size_t i = 0; i < seed_cities; ++i) {
+        for (size_t j = i + 1; j < seed_cities; ++j) {
+            roads.push_back({static_cast<int>(i), static_cast<int>(j), randomBudget(rng)});
+            endpoints.push_back(static_cast<int>(i));
+            endpoints.push_back(static_cast<int>(j));
+        }
+    }
+    vector<int> targets;
+    for (size_t v = seed_cities; v < n; ++v) {
+        targets.clear();
+        while (targets.size() < min(links, v)) {
+            int target = endpoints.empty() ? static_cast<int>(rng() % v) : endpoints[rng() % endpoints.size()];
+            if (find(targets.begin(), targets.end(), target) == targets.end()) targets.push_back(target);
+        }
+        for (int target : targets) {
+            roads.push_back({target, static_cast<int>(v), randomBudget(rng)});
+            endpoints.push_back(target);
+            endpoints.push_back(static_cast<int>(v));
+        }
+    }
+}
+
+// Name the cities, then lay out the roads for the requested shape
+GeneratedNetwork generateNetwork(NetworkShape shape, size_t num_cities, double average_degree, uint64_t seed) {
+    GeneratedNetwork network;
+    network.cities.reserve(num_cities);
+    for (size_t i = 0; i < num_cities; ++i) network.cities.push_back("C" + to_string(i));
+    mt19937_64 rng(seed);
+    switch (shape) {
+    case NetworkShape::Grid: generateGrid(num_cities, rng, network.roads); break;
+    case NetworkShape::Geometric: generateGeometric(num_cities, average_degree, rng, network.roads); break;
+    case NetworkShape::ScaleFree: generateScaleFree(num_cities, average_degree, rng, network.roads); break;
+    }
+    return network;
+}
+
+// Same formats as saveCitiesToFile/saveRoadsToFile
+bool writeNetworkFiles(const GeneratedNetwork& network, const string& cities_file, const string& roads_file) {
+    ofstream cities(cities_file);
+    cities << "Index,CityName\n";
+    for (size_t i = 0; i < network.cities.size(); ++i) {
+        cities << i << "," << network.cities[i] << "\n";
+    }
+    cities.close();
+
+    ofstream roads(roads_file);
+    roads << "Road,Budget\n";
+    char buffer[32];
+    for (const RoadEdge& road : network.roads) {
+        auto result = to_chars(buffer, buffer + sizeof(buffer), road.budget);
+        roads << network.cities[road.city1] << "-" << network.cities[road.city2] << ",";
+        roads.write(buffer, result.ptr - buffer);
+        roads << "\n";
+    }
+    roads.close();
+    return !cities.fail() && !roads.fail();
+}
@@ -0,0 +1,33 @@
+#ifndef NETWORK_GENERATOR_H
+#define NETWORK_GENERATOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "RoadStore.h"
+
+// Shapes of synthetic road networks
+enum class NetworkShape {
+    Grid,      // Square lattice: each city joins its right and lower neighbour
+    Geometric, // Random points in a square, joined when closer than a radius (roads cost their length)
+    ScaleFree  // Preferential attachment: each new city joins `links` cities picked in proportion to degree
+};
+
+// A generated network: city names ("C0", "C1", ...) and roads between city indices
+struct GeneratedNetwork {
+    std::vector<std::string> cities;
+    std::vector<RoadEdge> roads;
+};
+
+// Parse "grid", "geometric" or "scale-free", returns false for anything else
+bool parseNetworkShape(const std::string& text, NetworkShape& shape);
+// Name of a shape as accepted by parseNetworkShape
+const char* networkShapeName(NetworkShape shape);
+// Build a network with num_cities cities. The same shape, size, degree and seed always give the same
+// network. average_degree sets the radius of geometric networks and twice the links per city of
+// scale-free ones; grids always have degree up to 4. Budgets have at most three decimals.
+GeneratedNetwork generateNetwork(NetworkShape shape, size_t num_cities, double average_degree, uint64_t seed);
+// Write the network as cities.txt/roads.txt files the system loads, returns false on a write error
+bool writeNetworkFiles(const GeneratedNetwork& network, const std::string& cities_file, const std::string& roads_file);
+
+#endif
@@ -0,0 +1,244 @@
+#include "NetworkPlanner.h"
+#include "UnionFind.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <queue>
+#include <thread>
+
+using namespace std;
+
+static const uint32_t NO_EDGE = numeric_limits<uint32_t>::max();
+// Below this many roads a round is cheaper than starting threads
+static const size_t PARALLEL_MIN_EDGES = 1 << 16;
+// Smallest slice of work handed to one thread
+static const size_t MIN_CHUNK = 1 << 12;
+
+// Split [0, count) into up to `threads` contiguous chunks and run fn(chunk, begin, end) on each,
+// the first chunk on the calling thread
+template <typename Fn>
+static void parallelFor(unsigned threads, size_t count, Fn fn) {
+    size_t chunks = min<size_t>(threads, max<size_t>(1, count / MIN_CHUNK));
+    if (chunks <= 1) {
+        fn(0, 0, count);
+        return;
+    }
+    size_t step = (count + chunks - 1) / chunks;
+    vector<thread> workers;
+    for (size_t c = 1; c < chunks; ++c) {
+        workers.emplace_back(fn, static_cast<unsigned>(c), min(count, c * step), min(count, (c + 1) * step));
+    }
+    fn(0, 0, min(count, step));
+    for (thread& worker : workers) worker.join();
+}
+
+NetworkPlanner::NetworkPlanner(unsigned num_threads) : num_threads(num_threads) {
+    if (this->num_threads == 0) this->num_threads = max(1u, thread::hardware_concurrency());
+}
+
+// Rounds of: every component offers its cheapest live road, merge the offers, drop roads that became internal
+void NetworkPlanner::boruvka(size_t n, const vector<RoadEdge>& edges, vector<uint32_t>& chosen) const {
+    unsigned threads = edges.size() >= PARALLEL_MIN_EDGES ? num_threads : 1;
+    UnionFind sets(n);
+    vector<int> comp(n); // Component of each endpoint, refreshed after every round
+    iota(comp.begin(), comp.end(), 0);
+    unique_ptr<atomic<uint32_t>[]> best(new atomic<uint32_t>[n]);
+    vector<uint32_t> live;
+    live.reserve(edges.size());
+    for (uint32_t id = 0; id < edges.size(); ++id) {
+        if (edges[id].city1 != edges[id].city2) live.push_back(id);
+    }
+    vector<int> active(n); // Components that may still have a road leaving them
+    iota(active.begin(), active.end(), 0);
+    vector<vector<uint32_t>> parts(threads);
+
+    // Strict order on roads: budget, then position, so every component agrees on the cheapest
+    auto lighter = [&edges](uint32_t a, uint32_t b) {
+        return edges[a].budget < edges[b].budget || (edges[a].budget == edges[b].budget && a < b);
+    };
+    auto offer = [&](int c, uint32_t id) {
+        uint32_t current = best[c].load(memory_order_relaxed);
+        while (current == NO_EDGE || lighter(id, current)) {
+            if (best[c].compare_exchange_weak(current, id, memory_order_relaxed)) break;
+        }
+    };
+
+    while (!live.empty()) {
+        for (int c : active) best[c].store(NO_EDGE, memory_order_relaxed);
+        parallelFor(threads, live.size(), [&](unsigned, size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                uint32_t id = live[k];
+                offer(comp[edges[id].city1], id);
+                offer(comp[edges[id].city2], id);
+            }
+        });
+
+        // A road picked by both of its components is only taken once
+        size_t next = 0;
+        for (int c : active) {
+            uint32_t id = best[c].load(memory_order_relaxed);
+            if (id == NO_EDGE) continue; // No roads leave this component any more
+            if (sets.unite(edges[id].city1, edges[id].city2)) chosen.push_back(id);
+            active[next++] = c;
+        }
+        active.resize(next);
+        next = 0;
+        for (int c : active) {
+            if (sets.find(c) == c) active[next++] = c;
+        }
+        active.resize(next);
+
+        parallelFor(threads, n, [&](unsigned, size_t begin, size_t end) {
+            for (size_t v = begin; v < end; ++v) comp[v] = sets.root(comp[v]);
+        });
+        // Keep roads between different components: filter each chunk, then copy the survivors
+        // back in chunk order (the same count splits into the same chunks both times)
+        parallelFor(threads, live.size(), [&](unsigned chunk, size_t begin, size_t end) {
+            vector<uint32_t>& part = parts[chunk];
+            part.clear();
+            for (size_t k = begin; k < end; ++k) {
+                uint32_t id = live[k];
+                if (comp[edges[id].city1] != comp[edges[id].city2]) part.push_back(id);
+            }
+        });
+        vector<size_t> part_start(threads + 1, 0);
+        for (unsigned c = 0; c < threads; ++c) part_start[c + 1] = part_start[c] + parts[c].size();
+        parallelFor(threads, live.size(), [&](unsigned chunk, size_t, size_t) {
+            copy(parts[chunk].begin(), parts[chunk].end(), live.begin() + part_start[chunk]);
+            parts[chunk].clear();
+        });
+        live.resize(part_start[threads]);
+    }
+}
+
+// Borůvka over every road, selected roads sorted by city
+double NetworkPlanner::spanningForest(const RoadStore& roads, vector<RoadEdge>& selected) const {
+    vector<RoadEdge> edges;
+    edges.reserve(roads.roadCount());
+    roads.forEachRoad([&edges](int i, int j, double budget) { edges.push_back({i, j, budget}); });
+    vector<uint32_t> chosen;
+    boruvka(roads.cityCount(), edges, chosen);
+
+    selected.clear();
+    double total = 0.0;
+    for (uint32_t id : chosen) {
+        selected.push_back(edges[id]);
+        total += edges[id].budget;
+    }
+    sort(selected.begin(), selected.end(), [](const RoadEdge& a, const RoadEdge& b) {
+        return a.city1 != b.city1 ? a.city1 < b.city1 : a.city2 < b.city2;
+    });
+    return total;
+}
+
+// Mehlhorn: grow Voronoi regions around the terminals, take the spanning forest of the
+// region graph, expand each picked region link into roads, then clean up with another
+// spanning forest and by trimming dead ends that are not terminals
+double NetworkPlanner::steinerTree(const RoadStore& roads, const vector<int>& terminals, vector<RoadEdge>& selected) const {
+    size_t n = roads.cityCount();
+    vector<double> dist(n, numeric_limits<double>::infinity());
+    vector<int> region(n, -1);
+    vector<int> parent(n, -1);
+    vector<double> parent_budget(n, 0.0);
+    vector<char> is_terminal(n, 0);
+    size_t regions = 0;
+    priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> heap;
+    for (int t : terminals) {
+        if (is_terminal[t]) continue;
+        is_terminal[t] = 1;
+        dist[t] = 0.0;
+        region[t] = static_cast<int>(regions++);
+        heap.push({0.0, t});
+    }
+    while (!heap.empty()) {
+        auto [d, u] = heap.top();
+        heap.pop();
+        if (d > dist[u]) continue;
+        for (const Road& road : roads.row(u)) {
+            double candidate = d + road.budget;
+            if (candidate < dist[road.to]) {
+                dist[road.to] = candidate;
+                region[road.to] = region[u];
+                parent[road.to] = u;
+                parent_budget[road.to] = road.budget;
+                heap.push({candidate, road.to});
+            }
+        }
+    }
+
+    // Region graph: every road between two regions links their terminals at the cost of the full path
+    vector<RoadEdge> links;
+    vector<RoadEdge> link_roads;
+    roads.forEachRoad([&](int i, int j, double budget) {
+        if (region[i] == -1 || region[j] == -1 || region[i] == region[j]) return;
+        links.push_back({region[i], region[j], dist[i] + budget + dist[j]});
+        link_roads.push_back({i, j, budget});
+    });
+    vector<uint32_t> chosen;
+    boruvka(regions, links, chosen);
+
+    // Expand each chosen link: its road plus the tree paths back to both terminals
+    vector<RoadEdge> expanded;
+    vector<char> parent_taken(n, 0);
+    auto climb = [&](int city) {
+        for (; parent[city] != -1 && !parent_taken[city]; city = parent[city]) {
+            parent_taken[city] = 1;
+            expanded.push_back({parent[city], city, parent_budget[city]});
+        }
+    };
+    for (uint32_t id : chosen) {
+        const RoadEdge& road = link_roads[id];
+        expanded.push_back(road);
+        climb(road.city1);
+        climb(road.city2);
+    }
+    chosen.clear();
+    boruvka(n, expanded, chosen);
+
+    // Trim cities that only hang off the tree and are not terminals
+    vector<vector<uint32_t>> incident(n);
+    vector<int> degree(n, 0);
+    for (uint32_t id : chosen) {
+        incident[expanded[id].city1].push_back(id);
+        incident[expanded[id].city2].push_back(id);
+        ++degree[expanded[id].city1];
+        ++degree[expanded[id].city2];
+    }
+    vector<char> removed(expanded.size(), 0);
+    vector<int> leaves;
+    for (uint32_t id : chosen) {
+        for (int city : {expanded[id].city1, expanded[id].city2}) {
+            if (degree[city] == 1 && !is_terminal[city]) leaves.push_back(city);
+        }
+    }
+    while (!leaves.empty()) {
+        int city = leaves.back();
+        leaves.pop_back();
+        if (degree[city] != 1) continue;
+        for (uint32_t id : incident[city]) {
+            if (removed[id]) continue;
+            removed[id] = 1;
+            --degree[city];
+            int other = expanded[id].city1 == city ? expanded[id].city2 : expanded[id].city1;
+            if (--degree[other] == 1 && !is_terminal[other]) leaves.push_back(other);
+            break;
+        }
+    }
+
+    selected.clear();
+    double total = 0.0;
+    for (uint32_t id : chosen) {
+        if (removed[id]) continue;
+        RoadEdge road = expanded[id];
+        if (road.city1 > road.city2) swap(road.city1, road.city2);
+        selected.push_back(road);
+        total += road.budget;
+    }
+    sort(selected.begin(), selected.end(), [](const RoadEdge& a, const RoadEdge& b) {
+        return a.city1 != b.city1 ? a.city1 < b.city1 : a.city2 < b.city2;
+    });
+    return total;
+}
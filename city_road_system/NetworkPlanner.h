@@ -0,0 +1,34 @@
+#ifndef NETWORK_PLANNER_H
+#define NETWORK_PLANNER_H
+
+#include <cstdint>
+#include <vector>
+#include "RoadStore.h"
+
+// Cheapest sets of roads that keep cities connected, using road budgets as costs.
+// Spanning forests use Borůvka's algorithm: every round each component picks its
+// cheapest road to another component (ties broken by road position, so no cycles
+// form), the picks are merged with a union-find, and roads inside a component are
+// dropped. Each round at least halves the number of components. Picking and dropping
+// are spread over worker threads, which write a component's pick with a lock-free
+// compare-and-swap, so large networks scale with the number of cores.
+// Connecting only some cities (a Steiner tree) uses Mehlhorn's 2-approximation on top.
+class NetworkPlanner {
+public:
+    // num_threads = 0 uses one thread per hardware core
+    explicit NetworkPlanner(unsigned num_threads = 0);
+
+    // Minimum spanning forest over all cities: the selected roads and their total budget
+    double spanningForest(const RoadStore& roads, std::vector<RoadEdge>& selected) const;
+    // Cheap network connecting the given cities (at most twice the optimum), possibly through
+    // other cities. Cities that cannot reach each other end up in separate trees.
+    double steinerTree(const RoadStore& roads, const std::vector<int>& terminals, std::vector<RoadEdge>& selected) const;
+
+private:
+    unsigned num_threads;
+
+    // Borůvka over an edge list with n endpoints; appends the positions of the chosen edges
+    void boruvka(size_t n, const std::vector<RoadEdge>& edges, std::vector<uint32_t>& chosen) const;
+};
+
+#endif
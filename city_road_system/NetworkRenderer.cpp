@@ -0,0 +1,240 @@
+#include "NetworkRenderer.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+using namespace std;
+
+// Reserve a little past FLUSH_BYTES so that the append that crosses it does not reallocate
+OutputBuffer::OutputBuffer(ostream& out) : out(out) {
+    buffer.reserve(FLUSH_BYTES + 256);
+}
+
+// Short text is buffered; text longer than the buffer goes straight to the stream after it
+OutputBuffer& OutputBuffer::operator<<(string_view text) {
+    if (text.size() >= FLUSH_BYTES) {
+        flush();
+        out.write(text.data(), static_cast<streamsize>(text.size()));
+        flushed += text.size();
+        return *this;
+    }
+    buffer.append(text);
+    if (buffer.size() >= FLUSH_BYTES) flush();
+    return *this;
+}
+
+// to_chars with a precision behaves as printf("%.*g"), the ostream default
+OutputBuffer& OutputBuffer::operator<<(double value) {
+    char digits[32];
+    auto result = to_chars(digits, digits + sizeof(digits), value, chars_format::general, 6);
+    return *this << string_view(digits, static_cast<size_t>(result.ptr - digits));
+}
+
+// Shortest round-trip formatting
+OutputBuffer& OutputBuffer::exact(double value) {
+    char digits[32];
+    auto result = to_chars(digits, digits + sizeof(digits), value);
+    return *this << string_view(digits, static_cast<size_t>(result.ptr - digits));
+}
+
+// Format an integer in place
+OutputBuffer& OutputBuffer::integer(long long value) {
+    char digits[24];
+    auto result = to_chars(digits, digits + sizeof(digits), value);
+    return *this << string_view(digits, static_cast<size_t>(result.ptr - digits));
+}
+
+// Binary data goes through the same buffer as text
+OutputBuffer& OutputBuffer::write(const void* data, size_t size) {
+    return *this << string_view(static_cast<const char*>(data), size);
+}
+
+// One stream write for everything collected so far
+bool OutputBuffer::flush() {
+    if (!buffer.empty()) {
+        out.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+        flushed += buffer.size();
+        buffer.clear();
+    }
+    return !out.fail();
+}
+
+// List every city that was not deleted
+size_t NetworkRenderer::cityList(OutputBuffer& out) const {
+    size_t listed = 0;
+    for (size_t i = 0; i < cities.size(); ++i) {
+        if (cities.isDeleted(i)) continue;
+        out << "Index: " << i << ", City: " << cities[i] << '\n';
+        ++listed;
+    }
+    return listed;
+}
+
+// Skip whole rows by counting their roads to higher cities, then list from the first wanted road
+size_t NetworkRenderer::roadList(OutputBuffer& out, size_t first, size_t count) const {
+    size_t skipped = 0;
+    size_t listed = 0;
+    for (size_t i = 0; i < cities.size() && listed < count; ++i) {
+        RoadStore::RowView row = roads.row(static_cast<int>(i));
+        // Roads to higher cities, each visited once from its lower end
+        const Road* higher = upper_bound(row.begin(), row.end(), static_cast<int>(i),
+                                         [](int city, const Road& road) { return city < road.to; });
+        size_t in_row = static_cast<size_t>(row.end() - higher);
+        if (skipped + in_row <= first) {
+            skipped += in_row;
+            continue;
+        }
+        higher += first - min(first, skipped);
+        skipped = first;
+        for (; higher != row.end() && listed < count; ++higher, ++listed) {
+            out << cities[i] << " <-> " << cities[higher->to] << ": Budget = " << higher->budget << " billion RWF\n";
+        }
+    }
+    return listed;
+}
+
+// Header line of 3-letter names, and the all-zero row the matrix rows are copied from
+void NetworkRenderer::matrixHeader(OutputBuffer& out, const MatrixWindow& window, vector<int>& columns,
+                                   string& zero_row) const {
+    columns.clear();
+    zero_row.clear();
+    out << "  ";
+    size_t last = min(window.last_column, cities.size() == 0 ? 0 : cities.size() - 1);
+    for (size_t j = window.first_column; j <= last && j < cities.size(); ++j) {
+        if (cities.isDeleted(j)) continue;
+        out << cities[j].substr(0, 3) << ' '; // First 3 letters of the city name for brevity
+        columns.push_back(static_cast<int>(j));
+        zero_row += "0  ";
+    }
+    out << '\n';
+}
+
+// Each row copies the zero row up to the next road's cell, formats that cell and carries on.
+// Every zero cell is 3 bytes wide, so column k starts at byte 3k of the zero row.
+void NetworkRenderer::matrix(OutputBuffer& out, const MatrixWindow& window, bool budgets) const {
+    vector<int> columns;
+    string zero_row;
+    matrixHeader(out, window, columns, zero_row);
+    string_view zeros(zero_row);
+    size_t last = min(window.last_row, cities.size() == 0 ? 0 : cities.size() - 1);
+    for (size_t i = window.first_row; i <= last && i < cities.size(); ++i) {
+        if (cities.isDeleted(i)) continue;
+        out << cities[i].substr(0, 3) << ' ';
+        RoadStore::RowView row = roads.row(static_cast<int>(i));
+        size_t copied = 0; // Bytes of the zero row written so far
+        auto column = columns.begin();
+        if (!columns.empty()) {
+            // Roads into the window; tombstones have no roads, so every one has a column
+            const Road* road = lower_bound(row.begin(), row.end(), columns.front(),
+                                           [](const Road& r, int city) { return r.to < city; });
+            for (; road != row.end() && road->to <= columns.back(); ++road) {
+                if (budgets && road->budget == 0.0) continue; // A zero budget shows as a zero cell
+                column = lower_bound(column, columns.end(), road->to);
+                size_t cell = static_cast<size_t>(column - columns.begin()) * 3;
+                out << zeros.substr(copied, cell - copied);
+                if (budgets) {
+                    out << static_cast<int>(road->budget) << ' ';
+                } else {
+                    out << "1  ";
+                }
+                copied = cell + 3;
+            }
+        }
+        out << zeros.substr(copied) << '\n';
+    }
+}
+
+// Roads are listed from each end that falls in the window, like the cells of the matrix
+size_t NetworkRenderer::sparseCells(OutputBuffer& out, const MatrixWindow& window) const {
+    size_t listed = 0;
+    size_t last = min(window.last_row, cities.size() == 0 ? 0 : cities.size() - 1);
+    for (size_t i = window.first_row; i <= last && i < cities.size(); ++i) {
+        RoadStore::RowView row = roads.row(static_cast<int>(i));
+        const Road* road = lower_bound(row.begin(), row.end(), window.first_column,
+                                       [](const Road& r, size_t city) { return static_cast<size_t>(r.to) < city; });
+        for (; road != row.end() && static_cast<size_t>(road->to) <= window.last_column; ++road) {
+            out << '[' << i << "][" << road->to << "] " << cities[i] << " -> " << cities[road->to]
+                << ": Budget = " << road->budget << " billion RWF\n";
+            ++listed;
+        }
+    }
+    return listed;
+}
+
+// Planned roads are sorted by city like forEachRoad visits them, so one pointer walks along
+// to find which roads are planned
+void NetworkRenderer::dot(OutputBuffer& out, const vector<RoadEdge>& planned_roads) const {
+    out << "digraph city_roads {\n";
+    out << "    rankdir=LR;\n"; // Set layout direction to left-to-right
+    // Add nodes (cities)
+    for (size_t i = 0; i < cities.size(); ++i) {
+        if (cities.isDeleted(i)) continue;
+        out << "    " << i << " [label=\"" << cities[i] << "\"];\n";
+    }
+    // Add edges (roads) with budgets as labels in billions RWF
+    auto planned = planned_roads.begin();
+    roads.forEachRoad([&](int i, int j, double budget) {
+        out << "    " << i << " -> " << j << " [label=\"" << budget << " billion RWF\", dir=both";
+        if (!planned_roads.empty()) {
+            while (planned != planned_roads.end() && (planned->city1 < i || (planned->city1 == i && planned->city2 < j))) ++planned;
+            bool in_plan = planned != planned_roads.end() && planned->city1 == i && planned->city2 == j;
+            out << (in_plan ? ", penwidth=3, color=darkgreen" : ", style=dashed, color=gray");
+        }
+        out << "];\n";
+    });
+    out << "}\n";
+}
+
+// Write text with the five XML special characters escaped
+static void xmlText(OutputBuffer& out, string_view text) {
+    size_t start = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        const char* entity = nullptr;
+        switch (text[i]) {
+        case '&': entity = "&amp;"; break;
+        case '<': entity = "&lt;"; break;
+        case '>': entity = "&gt;"; break;
+        case '"': entity = "&quot;"; break;
+        case '\'': entity = "&apos;"; break;
+        default: continue;
+        }
+        out << text.substr(start, i - start) << entity;
+        start = i + 1;
+    }
+    out << text.substr(start);
+}
+
+// Nodes are "n<index>" so that they map back to cities.txt
+void NetworkRenderer::graphML(OutputBuffer& out) const {
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+           "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\">\n"
+           "  <key id=\"name\" for=\"node\" attr.name=\"name\" attr.type=\"string\"/>\n"
+           "  <key id=\"budget\" for=\"edge\" attr.name=\"budget\" attr.type=\"double\"/>\n"
+           "  <graph id=\"city_roads\" edgedefault=\"undirected\">\n";
+    for (size_t i = 0; i < cities.size(); ++i) {
+        if (cities.isDeleted(i)) continue;
+        out << "    <node id=\"n" << i << "\"><data key=\"name\">";
+        xmlText(out, cities[i]);
+        out << "</data></node>\n";
+    }
+    roads.forEachRoad([&](int i, int j, double budget) {
+        out << "    <edge source=\"n" << i << "\" target=\"n" << j << "\"><data key=\"budget\">";
+        out.exact(budget) << "</data></edge>\n";
+    });
+    out << "  </graph>\n</graphml>\n";
+}
+
+// Header first, then one fixed-size record per road
+void NetworkRenderer::edgeList(OutputBuffer& out) const {
+    EdgeListHeader header = {};
+    memcpy(header.magic, "CRSEDGE", 8);
+    header.version = 1;
+    header.record_size = sizeof(EdgeListRecord);
+    header.city_count = cities.size();
+    header.road_count = roads.roadCount();
+    out.write(&header, sizeof(header));
+    roads.forEachRoad([&](int i, int j, double budget) {
+        EdgeListRecord record = {static_cast<uint32_t>(i), static_cast<uint32_t>(j), budget};
+        out.write(&record, sizeof(record));
+    });
+}
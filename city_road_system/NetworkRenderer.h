@@ -0,0 +1,120 @@
+#ifndef NETWORK_RENDERER_H
+#define NETWORK_RENDERER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "CityTable.h"
+#include "RoadStore.h"
+
+// Output formatted into one reusable buffer and handed to a stream in writes of FLUSH_BYTES,
+// instead of one stream call (and one to_string temporary) per cell. Numbers are formatted
+// with to_chars straight into the buffer. The buffer is flushed when it fills up, on flush()
+// and on destruction.
+class OutputBuffer {
+public:
+    // Bytes collected before they are written to the stream
+    static const size_t FLUSH_BYTES = size_t(1) << 20;
+
+    explicit OutputBuffer(std::ostream& out);
+    ~OutputBuffer() { flush(); }
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    OutputBuffer& operator<<(std::string_view text);
+    OutputBuffer& operator<<(char c) {
+        buffer.push_back(c);
+        if (buffer.size() >= FLUSH_BYTES) flush();
+        return *this;
+    }
+    // Integers in decimal
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    OutputBuffer& operator<<(T value) {
+        return integer(static_cast<long long>(value));
+    }
+    // Doubles the way an ostream prints them by default (%g, 6 significant digits)
+    OutputBuffer& operator<<(double value);
+    // A double with the shortest text that reads back to the same value
+    OutputBuffer& exact(double value);
+    // Raw bytes, for binary formats
+    OutputBuffer& write(const void* data, size_t size);
+    // Write out everything buffered, returns false if the stream failed
+    bool flush();
+    // Bytes handed to the stream so far plus those still buffered
+    size_t bytesWritten() const { return flushed + buffer.size(); }
+
+private:
+    std::ostream& out;
+    std::string buffer;
+    size_t flushed = 0;
+
+    OutputBuffer& integer(long long value);
+};
+
+// Part of the adjacency matrix to render: inclusive ranges of city indices, clipped to the
+// cities that exist. Deleted cities are never shown.
+struct MatrixWindow {
+    size_t first_row = 0;
+    size_t last_row = SIZE_MAX;
+    size_t first_column = 0;
+    size_t last_column = SIZE_MAX;
+};
+
+// Binary edge list (native byte order): an EdgeListHeader, then road_count EdgeListRecords
+// with city1 < city2, in city order. City indices are those of cities.txt.
+struct EdgeListHeader {
+    char magic[8];        // "CRSEDGE\0"
+    uint32_t version;     // 1
+    uint32_t record_size; // sizeof(EdgeListRecord)
+    uint64_t city_count;
+    uint64_t road_count;
+};
+
+struct EdgeListRecord {
+    uint32_t city1;
+    uint32_t city2;
+    double budget;
+};
+
+// Streaming renderers for the displays and exports of a network. Every renderer walks the
+// sorted CSR rows once and formats into an OutputBuffer, so output costs O(cells shown) for
+// the matrices and O(cities + roads) for everything else, with a few large writes.
+// Matrix rows start as a copy of a prebuilt all-zero row for the window, and only the cells
+// of actual roads are formatted, so a dense display costs little more than a memcpy per row.
+class NetworkRenderer {
+public:
+    NetworkRenderer(const CityTable& cities, const RoadStore& roads) : cities(cities), roads(roads) {}
+
+    // "Index: i, City: name" lines, returns the number of cities listed
+    size_t cityList(OutputBuffer& out) const;
+    // "A <-> B: Budget = x billion RWF" lines for count roads starting at road number first
+    // (in city order), returns the number of roads listed
+    size_t roadList(OutputBuffer& out, size_t first = 0, size_t count = SIZE_MAX) const;
+    // The window of the road matrix (1 where two cities share a road), or of the budget matrix
+    // (whole billions of RWF) when budgets is set, with 3-letter name headers
+    void matrix(OutputBuffer& out, const MatrixWindow& window, bool budgets) const;
+    // Only the non-zero cells of a window, one "row -> column" line each, returns their number
+    size_t sparseCells(OutputBuffer& out, const MatrixWindow& window) const;
+    // Graphviz DOT. If planned_roads is not empty (sorted like forEachRoad visits roads), those
+    // roads are drawn in bold and every other road dashed.
+    void dot(OutputBuffer& out, const std::vector<RoadEdge>& planned_roads) const;
+    // GraphML with city names and exact budgets
+    void graphML(OutputBuffer& out) const;
+    // Binary edge list (see EdgeListHeader)
+    void edgeList(OutputBuffer& out) const;
+
+private:
+    const CityTable& cities;
+    const RoadStore& roads;
+
+    // Column header of a matrix window; fills columns with the live cities of the window and
+    // zero_row with "0  " for each of them
+    void matrixHeader(OutputBuffer& out, const MatrixWindow& window, std::vector<int>& columns,
+                      std::string& zero_row) const;
+};
+
+#endif
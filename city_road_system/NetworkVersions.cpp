@@ -0,0 +1,110 @@
+#include "NetworkVersions.h"
+#include "PathEngine.h"
+#include <algorithm>
+#include <thread>
+
+using namespace std;
+
+// Slot indices in use by live threads, shared by every NetworkVersions instance
+static atomic<bool> slot_taken[NetworkVersions::MAX_READER_THREADS];
+
+// A reader thread's slot index, claimed on its first read and released when the thread exits
+struct SlotLease {
+    size_t index = NetworkVersions::MAX_READER_THREADS;
+
+    SlotLease() {
+        while (true) {
+            for (size_t i = 0; i < NetworkVersions::MAX_READER_THREADS; ++i) {
+                bool expected = false;
+                if (!slot_taken[i].load(memory_order_relaxed) &&
+                    slot_taken[i].compare_exchange_strong(expected, true, memory_order_acquire)) {
+                    index = i;
+                    return;
+                }
+            }
+            this_thread::yield(); // Every slot is held by a live thread
+        }
+    }
+    ~SlotLease() { slot_taken[index].store(false, memory_order_release); }
+};
+
+// Slot of the calling thread
+static size_t readerSlot() {
+    thread_local SlotLease lease;
+    return lease.index;
+}
+
+// Announce the epoch first, then load the version: a writer that misses the announcement has
+// already replaced the version, so this load sees the new one
+NetworkVersions::Reader::Reader(const NetworkVersions& versions) : versions(versions), slot(readerSlot()) {
+    ReaderSlot& s = versions.slots[slot];
+    if (s.depth++ == 0) s.epoch.store(versions.global_epoch.load());
+    version = versions.current.load();
+}
+
+// Withdraw the announcement once the outermost guard on this thread ends
+NetworkVersions::Reader::~Reader() {
+    ReaderSlot& s = versions.slots[slot];
+    if (--s.depth == 0) s.epoch.store(0, memory_order_release);
+}
+
+// Look up both cities and binary search the road in the pinned version
+bool NetworkVersions::Reader::budget(string_view city1, string_view city2, double& budget) const {
+    if (!version) return false;
+    int idx1 = cityIndex(city1);
+    int idx2 = cityIndex(city2);
+    if (idx1 == -1 || idx2 == -1) return false;
+    const Road* road = version->roads.find(idx1, idx2);
+    if (!road) return false;
+    budget = road->budget;
+    return true;
+}
+
+// Dijkstra over the pinned version; each thread keeps its own engine so queries never share scratch
+bool NetworkVersions::Reader::route(string_view city1, string_view city2, double& cost, vector<int>& path) const {
+    if (!version) return false;
+    int idx1 = cityIndex(city1);
+    int idx2 = cityIndex(city2);
+    if (idx1 == -1 || idx2 == -1) return false;
+    thread_local PathEngine engine;
+    return engine.shortestPath(version->roads, idx1, idx2, cost, path);
+}
+
+// Free everything; no reader may still hold a guard
+NetworkVersions::~NetworkVersions() {
+    delete current.load();
+    for (const auto& entry : retired) delete entry.second;
+}
+
+// Swap the version in, retire the old one at the epoch it was replaced in, and advance the epoch
+void NetworkVersions::publish(unique_ptr<const NetworkVersion> version) {
+    const NetworkVersion* old = current.exchange(version.release());
+    uint64_t epoch = global_epoch.fetch_add(1);
+    lock_guard<mutex> lock(retired_mutex);
+    if (old) retired.emplace_back(epoch, old);
+    reclaim();
+}
+
+// Number of replaced versions not freed yet
+size_t NetworkVersions::retiredCount() const {
+    lock_guard<mutex> lock(retired_mutex);
+    return retired.size();
+}
+
+// A reader that announced epoch e may hold any version retired at e or later
+void NetworkVersions::reclaim() {
+    uint64_t oldest = UINT64_MAX;
+    for (const ReaderSlot& s : slots) {
+        uint64_t epoch = s.epoch.load();
+        if (epoch != 0) oldest = min(oldest, epoch);
+    }
+    size_t kept = 0;
+    for (const auto& entry : retired) {
+        if (entry.first < oldest) {
+            delete entry.second;
+        } else {
+            retired[kept++] = entry;
+        }
+    }
+    retired.resize(kept);
+}
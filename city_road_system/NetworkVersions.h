@@ -0,0 +1,93 @@
+#ifndef NETWORK_VERSIONS_H
+#define NETWORK_VERSIONS_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "CityTable.h"
+#include "RoadStore.h"
+
+// One immutable state of the network, as seen by concurrent readers
+struct NetworkVersion {
+    uint64_t number = 0;
+    std::shared_ptr<const CityTable> cities; // Shared between versions until a city changes
+    RoadStore roads;                         // Shares its base and untouched delta chunks with other versions
+};
+
+// Publishes versions of the network to reader threads with snapshot isolation.
+// One writer publishes a new version after each change; readers pin whichever version is
+// current and see exactly that state for as long as they hold it, with no locks on either side.
+// Old versions are freed by epoch-based reclamation: a reader announces the global epoch in
+// its own cache-line-sized slot before loading the current version, a replaced version is
+// retired at the epoch it was replaced in, and it is freed once every announced epoch is newer.
+// Readers only write their own slot, so read throughput scales with the number of cores.
+// Versions are freed only on the publishing thread, which must be the thread that writes the
+// live RoadStore: the versions share rows with it, and RoadStore decides copy on write by
+// use_count(), which is only safe while every shared row is released on its writing thread.
+// A reader must therefore never free or keep a copy of a version it pinned.
+class NetworkVersions {
+public:
+    // Pins one version for the lifetime of the guard. Guards may nest on a thread but must not
+    // move between threads. Reads are safe from any number of threads at once.
+    class Reader {
+    public:
+        explicit Reader(const NetworkVersions& versions);
+        ~Reader();
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        // Check if a version has been published
+        bool ready() const { return version != nullptr; }
+        // Number of the pinned version (0 before the first publish)
+        uint64_t versionNumber() const { return version ? version->number : 0; }
+        const CityTable& cities() const { return *version->cities; }
+        const RoadStore& roads() const { return version->roads; }
+        // Index of a city by name, returns -1 if not found
+        int cityIndex(std::string_view name) const { return version->cities->find(name); }
+        // Budget of the road between two cities, returns false if either city or the road is missing
+        bool budget(std::string_view city1, std::string_view city2, double& budget) const;
+        // Cheapest route between two cities (Dijkstra with per-thread scratch buffers)
+        bool route(std::string_view city1, std::string_view city2, double& cost, std::vector<int>& path) const;
+
+    private:
+        const NetworkVersions& versions;
+        const NetworkVersion* version;
+        size_t slot;
+    };
+
+    NetworkVersions() = default;
+    ~NetworkVersions();
+    NetworkVersions(const NetworkVersions&) = delete;
+    NetworkVersions& operator=(const NetworkVersions&) = delete;
+
+    // Make a version current and free replaced versions no reader can still see.
+    // Only the thread that writes the stores the versions were copied from may publish.
+    void publish(std::unique_ptr<const NetworkVersion> version);
+    // Number of replaced versions still waiting for readers to move on
+    size_t retiredCount() const;
+
+    // Most reader threads that can hold a guard at the same time; more wait for a free slot
+    static const size_t MAX_READER_THREADS = 256;
+
+private:
+    // Epoch announced by one reader thread, 0 while it holds no guard
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{0};
+        unsigned depth = 0; // Nested guards; only touched by the owning thread
+    };
+
+    mutable ReaderSlot slots[MAX_READER_THREADS];
+    std::atomic<const NetworkVersion*> current{nullptr};
+    std::atomic<uint64_t> global_epoch{1};
+    mutable std::mutex retired_mutex;
+    std::vector<std::pair<uint64_t, const NetworkVersion*>> retired; // Retire epoch and version
+
+    // Free retired versions older than every epoch a reader has announced (on the publishing thread)
+    void reclaim();
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "PathEngine.h"
+#include <algorithm>
+
+using namespace std;
+
+// Grow buffers if the graph has grown and bump the query number instead of clearing
+void PathEngine::begin(size_t n, int source) {
+    if (dist.size() < n) {
+        dist.resize(n);
+        parent.resize(n);
+        stamp.resize(n, 0);
+    }
+    if (++query == 0) { // Wrapped around: old stamps could look current again
+        fill(stamp.begin(), stamp.end(), 0);
+        query = 1;
+    }
+    heap.clear();
+    dist[source] = 0.0;
+    parent[source] = -1;
+    stamp[source] = query;
+    heapPush(0.0, source);
+}
+
+// Pop until a city whose key is still its best distance, then relax its roads
+int PathEngine::settleNext(const RoadStore& roads) {
+    while (!heap.empty()) {
+        HeapEntry top = heapPop();
+        if (top.key > dist[top.city]) continue; // Stale entry, a cheaper route was found later
+        for (const Road& road : roads.row(top.city)) {
+            double candidate = top.key + road.budget;
+            if (!reached(road.to) || candidate < dist[road.to]) {
+                dist[road.to] = candidate;
+                parent[road.to] = top.city;
+                stamp[road.to] = query;
+                heapPush(candidate, road.to);
+            }
+        }
+        return top.city;
+    }
+    return -1;
+}
+
+// Dijkstra with early exit once the target is settled
+bool PathEngine::shortestPath(const RoadStore& roads, int source, int target, double& cost, vector<int>& path) {
+    path.clear();
+    begin(roads.cityCount(), source);
+    int city;
+    while ((city = settleNext(roads)) != -1 && city != target) {
+    }
+    if (city != target) return false;
+    cost = dist[target];
+    for (int c = target; c != -1; c = parent[c]) path.push_back(c);
+    reverse(path.begin(), path.end());
+    return true;
+}
+
+// Full Dijkstra from source
+void PathEngine::allDistances(const RoadStore& roads, int source, vector<double>& distances) {
+    size_t n = roads.cityCount();
+    begin(n, source);
+    while (settleNext(roads) != -1) {
+    }
+    distances.assign(n, -1.0);
+    for (size_t i = 0; i < n; ++i) {
+        if (reached(static_cast<int>(i))) distances[i] = dist[i];
+    }
+}
+
+// Dijkstra that stops after k cities besides the source have been settled
+void PathEngine::nearest(const RoadStore& roads, int source, size_t k, vector<pair<int, double>>& result) {
+    result.clear();
+    begin(roads.cityCount(), source);
+    int city;
+    while ((k == 0 || result.size() < k) && (city = settleNext(roads)) != -1) {
+        if (city != source) result.push_back({city, dist[city]});
+    }
+}
+
+// Append at the bottom and sift up
+void PathEngine::heapPush(double key, int city) {
+    size_t i = heap.size();
+    heap.push_back({key, city});
+    while (i > 0) {
+        size_t up = (i - 1) / 4;
+        if (heap[up].key <= key) break;
+        heap[i] = heap[up];
+        i = up;
+    }
+    heap[i] = {key, city};
+}
+
+// Take the root, move the last entry down past its smallest of up to four children
+PathEngine::HeapEntry PathEngine::heapPop() {
+    HeapEntry top = heap[0];
+    HeapEntry last = heap.back();
+    heap.pop_back();
+    size_t n = heap.size();
+    if (n == 0) return top;
+    size_t i = 0;
+    while (true) {
+        size_t first = 4 * i + 1;
+        if (first >= n) break;
+        size_t best = first;
+        size_t end = min(first + 4, n);
+        for (size_t c = first + 1; c < end; ++c) {
+            if (heap[c].key < heap[best].key) best = c;
+        }
+        if (heap[best].key >= last.key) break;
+        heap[i] = heap[best];
+        i = best;
+    }
+    heap[i] = last;
+    return top;
+}
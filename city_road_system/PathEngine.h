@@ -0,0 +1,48 @@
+#ifndef PATH_ENGINE_H
+#define PATH_ENGINE_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "RoadStore.h"
+
+// Budget-weighted shortest path queries (Dijkstra) over a RoadStore.
+// The engine keeps its scratch buffers between queries: distances and parents are
+// only trusted for cities stamped with the current query number, so nothing is
+// cleared or allocated per query once the buffers have grown to the city count.
+// The heap is an array-based 4-ary min-heap with lazy deletion, which keeps
+// sift-down touching one cache line of children per level.
+class PathEngine {
+public:
+    // Cheapest route from source to target: total budget and the cities on the way
+    // (source first). Returns false if target cannot be reached.
+    bool shortestPath(const RoadStore& roads, int source, int target, double& cost, std::vector<int>& path);
+    // Cheapest total budget from source to every city (-1 for unreachable cities)
+    void allDistances(const RoadStore& roads, int source, std::vector<double>& distances);
+    // The k cities closest to source by total budget, nearest first (source excluded).
+    // k = 0 returns every reachable city.
+    void nearest(const RoadStore& roads, int source, size_t k, std::vector<std::pair<int, double>>& result);
+
+private:
+    struct HeapEntry {
+        double key;
+        int city;
+    };
+
+    std::vector<double> dist;     // Best known budget per city, valid when stamp[city] == query
+    std::vector<int> parent;      // Previous city on the best route
+    std::vector<uint32_t> stamp;  // Query number that last wrote dist/parent
+    std::vector<HeapEntry> heap;  // 4-ary min-heap on key
+    uint32_t query = 0;
+
+    // Prepare buffers for a graph with n cities and start a new query from source
+    void begin(size_t n, int source);
+    // Settle the next city; returns -1 when the heap is empty
+    int settleNext(const RoadStore& roads);
+    // Check if a city has a distance in the current query
+    bool reached(int city) const { return stamp[city] == query; }
+    void heapPush(double key, int city);
+    HeapEntry heapPop();
+};
+
+#endif
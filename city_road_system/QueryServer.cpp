@@ -0,0 +1,474 @@
+#include "QueryServer.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Epoll ids of the fds that are not connections
+static const uint64_t LISTEN_ID = 0;
+static const uint64_t WAKE_ID = 1;
+static const uint64_t SIGNAL_ID = 2;
+// A connection stops being read while this many batches or bytes of output are waiting for it
+static const uint64_t MAX_PENDING_BATCHES = 64;
+static const size_t MAX_PENDING_OUTPUT = 4 << 20;
+// A request line longer than this closes the connection
+static const size_t MAX_REQUEST_LINE = 64 << 10;
+// Reads per wake-up for one connection, so one busy client cannot starve the others
+static const int READS_PER_EVENT = 16;
+
+// Address as the user would type it
+static string addressText(const ServerAddress& address) {
+    return address.is_unix ? "unix:" + address.path : "tcp:127.0.0.1:" + to_string(address.port);
+}
+
+// "unix:PATH" or "tcp:PORT"
+bool parseServerAddress(const string& text, ServerAddress& address) {
+    if (text.compare(0, 5, "unix:") == 0 && text.size() > 5) {
+        address.is_unix = true;
+        address.path = text.substr(5);
+        return address.path.size() < sizeof(sockaddr_un::sun_path);
+    }
+    if (text.compare(0, 4, "tcp:") == 0) {
+        unsigned port = 0;
+        const char* last = text.data() + text.size();
+        auto result = from_chars(text.data() + 4, last, port);
+        if (result.ec != errc() || result.ptr != last || port == 0 || port > 65535) return false;
+        address.is_unix = false;
+        address.port = static_cast<uint16_t>(port);
+        return true;
+    }
+    return false;
+}
+
+// Fill in the socket address for either kind of server address
+static socklen_t socketAddress(const ServerAddress& address, sockaddr_storage& storage) {
+    memset(&storage, 0, sizeof(storage));
+    if (address.is_unix) {
+        sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&storage);
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, address.path.c_str(), address.path.size() + 1);
+        return sizeof(sockaddr_un);
+    }
+    sockaddr_in* in = reinterpret_cast<sockaddr_in*>(&storage);
+    in->sin_family = AF_INET;
+    in->sin_port = htons(address.port);
+    in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return sizeof(sockaddr_in);
+}
+
+// Blocking connection with Nagle disabled, so pipelined requests are not held back
+int connectToServer(const ServerAddress& address) {
+    sockaddr_storage storage;
+    socklen_t length = socketAddress(address, storage);
+    int fd = socket(address.is_unix ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&storage), length) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (!address.is_unix) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+// Strip spaces, tabs and a trailing '\r' from both ends
+static string_view trim(string_view text) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == string_view::npos) return string_view();
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+// Split comma-separated arguments into at most max_args trimmed fields; returns the field count,
+// or max_args + 1 if there are more
+static size_t splitArguments(string_view text, string_view* args, size_t max_args) {
+    text = trim(text);
+    if (text.empty()) return 0;
+    size_t count = 0;
+    size_t start = 0;
+    while (true) {
+        size_t comma = text.find(',', start);
+        if (count == max_args) return max_args + 1;
+        args[count++] = trim(text.substr(start, comma == string_view::npos ? string_view::npos : comma - start));
+        if (comma == string_view::npos) return count;
+        start = comma + 1;
+    }
+}
+
+// Shortest text that reads back to the same value
+static void appendNumber(string& out, double value) {
+    char buffer[32];
+    auto result = to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+QueryServer::QueryServer(CityRoadSystem& system, unsigned num_workers) : system(system), num_workers(num_workers) {
+    if (this->num_workers == 0) this->num_workers = max(1u, thread::hardware_concurrency());
+}
+
+// Close whatever run() did not (e.g., when listen succeeded but run was never called)
+QueryServer::~QueryServer() {
+    for (int fd : {listen_fd, epoll_fd, wake_fd, signal_fd}) {
+        if (fd != -1) close(fd);
+    }
+}
+
+// Refuse to take over a Unix socket another server is still answering on; a stale one is replaced
+bool QueryServer::listen(const ServerAddress& address) {
+    this->address = address;
+    if (address.is_unix) {
+        struct stat info;
+        if (lstat(address.path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+            int probe = connectToServer(address);
+            if (probe != -1) {
+                close(probe);
+                cout << "Another server is already listening on " << addressText(address) << ".\n";
+                return false;
+            }
+            unlink(address.path.c_str());
+        }
+    }
+    listen_fd = socket(address.is_unix ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd != -1 && !address.is_unix) {
+        int one = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    sockaddr_storage storage;
+    socklen_t length = socketAddress(address, storage);
+    if (listen_fd == -1 || bind(listen_fd, reinterpret_cast<sockaddr*>(&storage), length) == -1 ||
+        ::listen(listen_fd, SOMAXCONN) == -1) {
+        cout << "Could not listen on " << addressText(address) << ": " << strerror(errno) << ".\n";
+        if (listen_fd != -1) close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+// Block SIGINT/SIGTERM before the workers start (they inherit the mask), so the signals only
+// arrive through the signalfd and the loop can shut down cleanly
+void QueryServer::run() {
+    if (listen_fd == -1) return;
+    sigset_t signals, previous;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+    signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    for (auto [fd, id] : {pair<int, uint64_t>{listen_fd, LISTEN_ID}, {wake_fd, WAKE_ID}, {signal_fd, SIGNAL_ID}}) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = id;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+    stopping = false;
+    for (unsigned w = 0; w < num_workers; ++w) workers.emplace_back(&QueryServer::workerLoop, this);
+    cout << "Serving on " << addressText(address) << " with " << num_workers << " workers (Ctrl+C to stop).\n";
+    cout.flush();
+
+    epoll_event events[64];
+    bool running = true;
+    while (running) {
+        int ready = epoll_wait(epoll_fd, events, 64, -1);
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            cout << "Event loop failed: " << strerror(errno) << ".\n";
+            break;
+        }
+        for (int e = 0; e < ready; ++e) {
+            uint64_t id = events[e].data.u64;
+            uint32_t flags = events[e].events;
+            if (id == LISTEN_ID) {
+                acceptConnections();
+            } else if (id == WAKE_ID) {
+                collectResults();
+            } else if (id == SIGNAL_ID) {
+                signalfd_siginfo info;
+                ssize_t got = read(signal_fd, &info, sizeof(info)); // Consume it, or restoring the mask delivers it
+                (void)got;
+                running = false;
+            } else {
+                auto it = connections.find(id);
+                if (it == connections.end()) continue;
+                Connection& connection = it->second;
+                if ((flags & (EPOLLERR | EPOLLHUP)) || ((flags & EPOLLOUT) && !flushConnection(connection))) {
+                    closeConnection(id);
+                } else if (flags & EPOLLIN) {
+                    readConnection(id, connection);
+                } else {
+                    updateEvents(id, connection);
+                }
+            }
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_ready.notify_all();
+    for (thread& worker : workers) worker.join();
+    workers.clear();
+    queue.clear();
+    done.clear();
+    while (!connections.empty()) closeConnection(connections.begin()->first);
+    for (int* fd : {&listen_fd, &epoll_fd, &wake_fd, &signal_fd}) {
+        close(*fd);
+        *fd = -1;
+    }
+    if (address.is_unix) unlink(address.path.c_str());
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    cout << "Server stopped.\n";
+}
+
+// Take batches until stopped; each batch is answered against one pinned version
+void QueryServer::workerLoop() {
+    while (true) {
+        Batch batch;
+        {
+            unique_lock<mutex> lock(queue_mutex);
+            queue_ready.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) return;
+            batch = move(queue.front());
+            queue.pop_front();
+        }
+        {
+            auto reader = system.readSnapshot();
+            string_view requests = batch.requests;
+            size_t pos = 0;
+            while (pos < requests.size()) {
+                size_t newline = requests.find('\n', pos);
+                answer(reader, requests.substr(pos, newline - pos), batch.responses);
+                pos = newline + 1;
+            }
+        }
+        {
+            lock_guard<mutex> lock(done_mutex);
+            done.push_back(move(batch));
+        }
+        uint64_t one = 1;
+        ssize_t written = write(wake_fd, &one, sizeof(one));
+        (void)written; // The counter only saturates if the loop has already been woken
+    }
+}
+
+// Parse "command arg1,arg2" and answer it from the pinned version
+void QueryServer::answer(const NetworkVersions::Reader& reader, string_view request, string& out) {
+    request = trim(request);
+    size_t space = request.find_first_of(" \t");
+    string_view command = request.substr(0, space);
+    string_view args[2];
+    size_t count = space == string_view::npos ? 0 : splitArguments(request.substr(space + 1), args, 2);
+
+    if (!reader.ready()) {
+        out += "ERR no data loaded\n";
+    } else if (command == "budget" && count == 2) {
+        double budget;
+        if (reader.cityIndex(args[0]) == -1 || reader.cityIndex(args[1]) == -1) {
+            out += "ERR city not found\n";
+        } else if (!reader.budget(args[0], args[1], budget)) {
+            out += "ERR no road\n";
+        } else {
+            out += "OK ";
+            appendNumber(out, budget);
+            out += '\n';
+        }
+    } else if (command == "neighbors" && count == 1) {
+        int city = reader.cityIndex(args[0]);
+        if (city == -1) {
+            out += "ERR city not found\n";
+        } else {
+            RoadStore::RowView row = reader.roads().row(city);
+            out += "OK ";
+            out += to_string(row.size());
+            for (const Road& road : row) {
+                out += ',';
+                out += reader.cities()[road.to];
+                out += ',';
+                appendNumber(out, road.budget);
+            }
+            out += '\n';
+        }
+    } else if (command == "route" && count == 2) {
+        double cost;
+        vector<int> path;
+        if (reader.cityIndex(args[0]) == -1 || reader.cityIndex(args[1]) == -1) {
+            out += "ERR city not found\n";
+        } else if (!reader.route(args[0], args[1], cost, path)) {
+            out += "ERR no route\n";
+        } else {
+            out += "OK ";
+            appendNumber(out, cost);
+            for (int city : path) {
+                out += ',';
+                out += reader.cities()[city];
+            }
+            out += '\n';
+        }
+    } else if (command == "stats" && count == 0) {
+        out += "OK cities=" + to_string(reader.cities().size()) + ",roads=" + to_string(reader.roads().roadCount()) +
+               ",version=" + to_string(reader.versionNumber()) + "\n";
+    } else {
+        out += "ERR unknown request\n";
+    }
+}
+
+// Accept until the backlog is empty
+void QueryServer::acceptConnections() {
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) return; // EAGAIN once the backlog is empty; other errors are per connection
+        if (!address.is_unix) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        uint64_t id = next_connection++;
+        Connection& connection = connections[id];
+        connection.fd = fd;
+        connection.events = EPOLLIN;
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = id;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+// Everything up to the last complete line becomes one batch; the partial line waits for more bytes
+void QueryServer::readConnection(uint64_t id, Connection& connection) {
+    char buffer[16384];
+    for (int r = 0; r < READS_PER_EVENT; ++r) {
+        ssize_t n = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            connection.in.append(buffer, static_cast<size_t>(n));
+            continue;
+        }
+        if (n == 0) {
+            connection.peer_closed = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            closeConnection(id);
+            return;
+        }
+        break;
+    }
+
+    if (connection.peer_closed && !connection.in.empty()) connection.in += '\n'; // Last line may lack one
+    size_t last = connection.in.rfind('\n');
+    if (last != string::npos) {
+        Batch batch{id, connection.next_batch++, connection.in.substr(0, last + 1), string()};
+        connection.in.erase(0, last + 1);
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            queue.push_back(move(batch));
+        }
+        queue_ready.notify_one();
+    }
+    if (connection.in.size() > MAX_REQUEST_LINE ||
+        (connection.peer_closed && connection.next_reply == connection.next_batch && connection.out.empty())) {
+        closeConnection(id);
+        return;
+    }
+    updateEvents(id, connection);
+}
+
+// Drain the eventfd, then move every finished batch to its connection in sequence order
+void QueryServer::collectResults() {
+    uint64_t count;
+    ssize_t got = read(wake_fd, &count, sizeof(count));
+    (void)got; // Nothing to read just means another wake-up already collected the batches
+    vector<Batch> finished;
+    {
+        lock_guard<mutex> lock(done_mutex);
+        finished.swap(done);
+    }
+    vector<uint64_t> touched;
+    for (Batch& batch : finished) {
+        auto it = connections.find(batch.connection);
+        if (it == connections.end()) continue; // Closed while the batch was being answered
+        it->second.ready.emplace(batch.sequence, move(batch.responses));
+        touched.push_back(batch.connection);
+    }
+    sort(touched.begin(), touched.end());
+    touched.erase(unique(touched.begin(), touched.end()), touched.end());
+    for (uint64_t id : touched) {
+        Connection& connection = connections[id];
+        while (!connection.ready.empty() && connection.ready.begin()->first == connection.next_reply) {
+            connection.out += connection.ready.begin()->second;
+            connection.ready.erase(connection.ready.begin());
+            ++connection.next_reply;
+        }
+        if (!flushConnection(connection) ||
+            (connection.peer_closed && connection.next_reply == connection.next_batch && connection.out.empty())) {
+            closeConnection(id);
+        } else {
+            updateEvents(id, connection);
+        }
+    }
+}
+
+// Send until done or the socket buffer is full; written bytes are dropped from the front lazily
+bool QueryServer::flushConnection(Connection& connection) {
+    while (connection.out_sent < connection.out.size()) {
+        ssize_t n = send(connection.fd, connection.out.data() + connection.out_sent,
+                         connection.out.size() - connection.out_sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            connection.out_sent += static_cast<size_t>(n);
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return false;
+        }
+    }
+    if (connection.out_sent == connection.out.size()) {
+        connection.out.clear();
+        connection.out_sent = 0;
+    } else if (connection.out_sent > connection.out.size() / 2) {
+        connection.out.erase(0, connection.out_sent);
+        connection.out_sent = 0;
+    }
+    return true;
+}
+
+// Only call epoll_ctl when the wanted events actually change
+void QueryServer::updateEvents(uint64_t id, Connection& connection) {
+    bool backed_up = connection.next_batch - connection.next_reply >= MAX_PENDING_BATCHES ||
+                     connection.out.size() - connection.out_sent >= MAX_PENDING_OUTPUT;
+    uint32_t wanted = 0;
+    if (!connection.peer_closed && !backed_up) wanted |= EPOLLIN;
+    if (connection.out_sent < connection.out.size()) wanted |= EPOLLOUT;
+    if (wanted == connection.events) return;
+    epoll_event event{};
+    event.events = wanted;
+    event.data.u64 = id;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection.fd, &event);
+    connection.events = wanted;
+}
+
+// Closing the fd also removes it from the epoll set
+void QueryServer::closeConnection(uint64_t id) {
+    auto it = connections.find(id);
+    if (it == connections.end()) return;
+    close(it->second.fd);
+    connections.erase(it);
+}
@@ -0,0 +1,114 @@
+#ifndef QUERY_SERVER_H
+#define QUERY_SERVER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "CityRoadSystem.h"
+
+// Where the query server listens: "unix:PATH" (Unix domain socket) or "tcp:PORT" (127.0.0.1 only)
+struct ServerAddress {
+    bool is_unix = true;
+    std::string path;
+    uint16_t port = 0;
+};
+
+// Parse "unix:PATH" or "tcp:PORT", returns false if the text is neither
+bool parseServerAddress(const std::string& text, ServerAddress& address);
+// Open a blocking connection to a server, returns -1 on failure
+int connectToServer(const ServerAddress& address);
+
+// Long-running server that loads the network once and answers read queries over a socket.
+// The protocol is line based: each request is one line, "command arg1,arg2", and gets exactly
+// one response line, "OK ..." or "ERR message". Clients may pipeline: send many requests without
+// waiting, and responses come back in request order.
+//
+//   budget CITY1,CITY2    OK BUDGET
+//   neighbors CITY        OK COUNT,CITY,BUDGET,CITY,BUDGET,...
+//   route CITY1,CITY2     OK COST,CITY,CITY,...   (cities on the cheapest route, in order)
+//   stats                 OK cities=N,roads=M,version=V
+//
+// One thread runs an epoll event loop that accepts connections and does all socket I/O. Every
+// read that completes one or more lines hands them to a fixed pool of workers as one batch; the
+// workers answer against a pinned snapshot (CityRoadSystem::readSnapshot) and wake the loop with
+// an eventfd. Batches of one connection may finish out of order and are put back in order before
+// they are written. A connection with too much unanswered work stops being read until it drains.
+class QueryServer {
+public:
+    // num_workers = 0 uses one worker per hardware core
+    QueryServer(CityRoadSystem& system, unsigned num_workers = 0);
+    ~QueryServer();
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    // Open the listening socket, returns false (after printing why) if it cannot be opened
+    bool listen(const ServerAddress& address);
+    // Serve until SIGINT or SIGTERM arrives
+    void run();
+    // Answer one request line against a pinned version, appending one response line to out
+    static void answer(const NetworkVersions::Reader& reader, std::string_view request, std::string& out);
+
+private:
+    // Lines read from one connection, answered together by one worker
+    struct Batch {
+        uint64_t connection;
+        uint64_t sequence;
+        std::string requests;
+        std::string responses;
+    };
+
+    // State of one client connection, only touched by the event loop thread
+    struct Connection {
+        int fd = -1;
+        std::string in;                         // Bytes read but not yet a complete line
+        std::string out;                        // Responses not yet written
+        size_t out_sent = 0;                    // Bytes of out already written
+        uint64_t next_batch = 0;                // Sequence number for the next batch handed out
+        uint64_t next_reply = 0;                // Sequence number whose responses are written next
+        std::map<uint64_t, std::string> ready;  // Finished batches waiting for earlier ones
+        uint32_t events = 0;                    // Events currently registered with epoll
+        bool peer_closed = false;               // Close once everything asked for has been answered
+    };
+
+    CityRoadSystem& system;
+    unsigned num_workers;
+    ServerAddress address;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;   // eventfd the workers signal when batches are done
+    int signal_fd = -1; // signalfd for SIGINT and SIGTERM
+    uint64_t next_connection = 3; // Epoll ids below this belong to the listening, wake and signal fds
+    std::unordered_map<uint64_t, Connection> connections;
+
+    std::vector<std::thread> workers;
+    std::mutex queue_mutex;
+    std::condition_variable queue_ready;
+    std::deque<Batch> queue;
+    bool stopping = false;
+    std::mutex done_mutex;
+    std::vector<Batch> done;
+
+    // Answer batches until the server stops
+    void workerLoop();
+    // Accept every pending connection
+    void acceptConnections();
+    // Read what a connection has sent and hand complete lines to the workers
+    void readConnection(uint64_t id, Connection& connection);
+    // Put finished batches back in order on their connections and write them
+    void collectResults();
+    // Write as much pending output as the socket takes, returns false if the connection failed
+    bool flushConnection(Connection& connection);
+    // Register interest in reads (unless the connection is backed up) and in writes (if output is pending)
+    void updateEvents(uint64_t id, Connection& connection);
+    // Close a connection and forget it; batches still in the pool are dropped when they finish
+    void closeConnection(uint64_t id);
+};
+
+#endif
@@ -0,0 +1,435 @@
+#include "RegionShards.h"
+#include "MappedFile.h"
+#include "Journal.h"
+#include "Metrics.h"
+#include "NetworkRenderer.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+const uint32_t RegionShards::NO_REGION;
+
+// Names are looked up in the hash index
+uint32_t RegionShards::findRegion(string_view name) const {
+    auto it = region_index.find(string(name));
+    return it == region_index.end() ? NO_REGION : it->second;
+}
+
+// New regions start loaded: they only exist in memory until the shards are written
+uint32_t RegionShards::addRegion(const string& name) {
+    uint32_t region = static_cast<uint32_t>(region_names.size());
+    region_names.push_back(name);
+    region_index.emplace(name, region);
+    states.emplace_back();
+    region_cities.emplace_back();
+    return region;
+}
+
+// Regions are created the first time their name appears
+void RegionShards::setRegion(int city, string_view name) {
+    if (static_cast<size_t>(city) >= city_region.size()) city_region.resize(city + 1, NO_REGION);
+    if (name.empty()) {
+        city_region[city] = NO_REGION;
+        return;
+    }
+    uint32_t region = findRegion(name);
+    city_region[city] = region != NO_REGION ? region : addRegion(string(name));
+}
+
+// Only grows; slots of deleted cities keep their entry until renumber drops them
+void RegionShards::resize(size_t num_cities) {
+    if (num_cities > city_region.size()) city_region.resize(num_cities, NO_REGION);
+}
+
+// The city's roads become boundary roads, which are always in memory
+void RegionShards::clearRegion(int city) {
+    if (static_cast<size_t>(city) < city_region.size()) city_region[city] = NO_REGION;
+}
+
+// Regions keep their numbers; those left without cities are dropped when the shards are written
+void RegionShards::renumber(const vector<int>& new_index, size_t num_cities) {
+    vector<uint32_t> renumbered(num_cities, NO_REGION);
+    for (size_t i = 0; i < min(new_index.size(), city_region.size()); ++i) {
+        if (new_index[i] >= 0) renumbered[new_index[i]] = city_region[i];
+    }
+    city_region.swap(renumbered);
+}
+
+// Breadth-first growth keeps regions connected and cuts few roads on road-like networks;
+// absorbing the small leftovers keeps the number of shards close to cities / cities_per_region
+void RegionShards::partition(const CityTable& cities, const RoadStore& roads, size_t cities_per_region) {
+    size_t target = max<size_t>(1, cities_per_region);
+    size_t n = cities.size();
+    vector<uint32_t> assigned(n, NO_REGION);
+    vector<size_t> sizes;
+    vector<int> queue;
+    for (size_t seed = 0; seed < n; ++seed) {
+        if (cities.isDeleted(seed) || assigned[seed] != NO_REGION) continue;
+        uint32_t region = static_cast<uint32_t>(sizes.size());
+        size_t size = 0;
+        queue.assign(1, static_cast<int>(seed));
+        for (size_t head = 0; head < queue.size() && size < target; ++head) {
+            int city = queue[head];
+            if (assigned[city] != NO_REGION) continue;
+            assigned[city] = region;
+            ++size;
+            for (const Road& road : roads.row(city)) {
+                if (assigned[road.to] == NO_REGION) queue.push_back(road.to);
+            }
+        }
+        sizes.push_back(size);
+    }
+
+    // Move each small region into the neighbouring region it shares the most roads with
+    vector<vector<int>> members(sizes.size());
+    for (size_t i = 0; i < n; ++i) {
+        if (assigned[i] != NO_REGION) members[assigned[i]].push_back(static_cast<int>(i));
+    }
+    vector<size_t> shared(sizes.size(), 0);
+    vector<uint32_t> touched;
+    uint32_t leftover = NO_REGION; // Region that isolated small regions are being collected into
+    for (uint32_t region = 0; region < sizes.size(); ++region) {
+        if (members[region].empty() || members[region].size() * 4 >= target) continue;
+        touched.clear();
+        for (int city : members[region]) {
+            for (const Road& road : roads.row(city)) {
+                uint32_t other = assigned[road.to];
+                if (other == region) continue;
+                if (shared[other]++ == 0) touched.push_back(other);
+            }
+        }
+        uint32_t best = NO_REGION;
+        for (uint32_t other : touched) {
+            if (best == NO_REGION || shared[other] > shared[best] || (shared[other] == shared[best] && other < best)) best = other;
+        }
+        for (uint32_t other : touched) shared[other] = 0;
+        if (best == NO_REGION) {
+            // Isolated: collect such pieces into one region until it reaches the target size
+            if (leftover == NO_REGION || members[leftover].size() >= target) {
+                leftover = region;
+                continue;
+            }
+            best = leftover;
+        }
+        for (int city : members[region]) assigned[city] = best;
+        members[best].insert(members[best].end(), members[region].begin(), members[region].end());
+        members[region].clear();
+    }
+
+    city_region.swap(assigned);
+    region_names.clear();
+    region_index.clear();
+    states.clear();
+    region_cities.clear();
+    for (size_t region = 0; region < sizes.size(); ++region) addRegion("region" + to_string(region));
+    dropEmptyRegions();
+    region_index.clear(); // Number the names after the regions that are left
+    for (uint32_t region = 0; region < region_names.size(); ++region) {
+        region_names[region] = "region" + to_string(region);
+        region_index.emplace(region_names[region], region);
+    }
+    listRegionCities();
+}
+
+// Neighbours are counted once per road, so a city follows the region it has most roads into
+void RegionShards::placeUnassigned(const CityTable& cities, const RoadStore& roads) {
+    if (!hasRegions()) return;
+    resize(cities.size());
+    vector<size_t> sizes(region_names.size(), 0);
+    for (size_t i = 0; i < cities.size(); ++i) {
+        if (city_region[i] != NO_REGION && !cities.isDeleted(i)) ++sizes[city_region[i]];
+    }
+    vector<size_t> votes(region_names.size(), 0);
+    vector<uint32_t> touched;
+    for (size_t i = 0; i < cities.size(); ++i) {
+        if (city_region[i] != NO_REGION || cities.isDeleted(i)) continue;
+        touched.clear();
+        for (const Road& road : roads.row(static_cast<int>(i))) {
+            uint32_t region = city_region[road.to];
+            if (region != NO_REGION && votes[region]++ == 0) touched.push_back(region);
+        }
+        uint32_t best = NO_REGION;
+        for (uint32_t region : touched) {
+            if (best == NO_REGION || votes[region] > votes[best] || (votes[region] == votes[best] && region < best)) best = region;
+        }
+        for (uint32_t region : touched) votes[region] = 0;
+        if (best == NO_REGION) best = static_cast<uint32_t>(min_element(sizes.begin(), sizes.end()) - sizes.begin());
+        city_region[i] = best;
+        ++sizes[best];
+    }
+}
+
+// One pass over the cities; regions keep their relative order
+void RegionShards::dropEmptyRegions() {
+    vector<size_t> sizes(region_names.size(), 0);
+    for (uint32_t region : city_region) {
+        if (region != NO_REGION) ++sizes[region];
+    }
+    vector<uint32_t> new_number(region_names.size(), NO_REGION);
+    vector<string> kept;
+    for (uint32_t region = 0; region < region_names.size(); ++region) {
+        if (sizes[region] == 0) continue;
+        new_number[region] = static_cast<uint32_t>(kept.size());
+        kept.push_back(move(region_names[region]));
+    }
+    for (uint32_t& region : city_region) {
+        if (region != NO_REGION) region = new_number[region];
+    }
+    region_names.clear();
+    region_index.clear();
+    states.clear();
+    region_cities.clear();
+    for (const string& name : kept) addRegion(name);
+}
+
+// Counting sort by region, so every list comes out in index order
+void RegionShards::listRegionCities() {
+    region_cities.assign(region_names.size(), vector<int>());
+    for (size_t i = 0; i < city_region.size(); ++i) {
+        if (city_region[i] != NO_REGION) region_cities[city_region[i]].push_back(static_cast<int>(i));
+    }
+}
+
+// Write roads in the binary edge list format (via a temporary file and rename)
+static bool writeEdgeFile(const string& path, size_t num_cities, const vector<EdgeListRecord>& records) {
+    string temp_path = path + ".tmp";
+    ofstream file(temp_path, ios::binary);
+    EdgeListHeader header = {};
+    memcpy(header.magic, "CRSEDGE", 8);
+    header.version = 1;
+    header.record_size = sizeof(EdgeListRecord);
+    header.city_count = num_cities;
+    header.road_count = records.size();
+    {
+        OutputBuffer out(file);
+        out.write(&header, sizeof(header));
+        out.write(records.data(), records.size() * sizeof(EdgeListRecord));
+        out.flush();
+        recordBytesWritten(out.bytesWritten());
+    }
+    file.close();
+    return !file.fail() && durableReplace(temp_path, path);
+}
+
+// Read a binary edge list whose cities all lie below max_cities
+static bool readEdgeFile(const string& path, size_t max_cities, vector<RoadEdge>& edges) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(EdgeListHeader)) return false;
+    EdgeListHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, "CRSEDGE", 8) != 0 || header.version != 1 || header.record_size != sizeof(EdgeListRecord) ||
+        header.city_count > max_cities || file.size() != sizeof(header) + header.road_count * sizeof(EdgeListRecord)) {
+        return false;
+    }
+    recordBytesRead(file.size());
+    edges.resize(header.road_count);
+    const char* next = file.data() + sizeof(header);
+    for (RoadEdge& edge : edges) {
+        EdgeListRecord record;
+        memcpy(&record, next, sizeof(record));
+        next += sizeof(record);
+        if (record.city1 >= header.city_count || record.city2 >= header.city_count) return false;
+        edge = {static_cast<int>(record.city1), static_cast<int>(record.city2), record.budget};
+    }
+    return true;
+}
+
+// Path of a region's shard file
+static string regionPath(const string& dir, uint32_t region) {
+    return dir + "/region" + to_string(region) + ".edges";
+}
+
+// Cities still without a region are placed first, so every road is either internal or boundary
+bool RegionShards::write(const string& dir, const CityTable& cities, const RoadStore& roads, uint64_t source_stamp) {
+    placeUnassigned(cities, roads);
+    resize(cities.size());
+    // Tombstones hold no roads and need no region
+    for (size_t i = 0; i < cities.size(); ++i) {
+        if (cities.isDeleted(i)) city_region[i] = NO_REGION;
+    }
+    dropEmptyRegions();
+    listRegionCities();
+
+    string manifest = dir + "/manifest.txt";
+    mkdir(dir.c_str(), 0755);
+    unlink(manifest.c_str()); // The directory does not open again until the manifest is back
+    vector<EdgeListRecord> records;
+    for (uint32_t region = 0; region < region_names.size(); ++region) {
+        records.clear();
+        for (int city : region_cities[region]) {
+            for (const Road& road : roads.row(city)) {
+                if (road.to > city && city_region[road.to] == region) {
+                    records.push_back({static_cast<uint32_t>(city), static_cast<uint32_t>(road.to), road.budget});
+                }
+            }
+        }
+        if (!writeEdgeFile(regionPath(dir, region), cities.size(), records)) return false;
+        states[region].roads = records.size();
+        states[region].loaded = true;
+        states[region].pinned = false;
+    }
+    // Shard files of regions that no longer exist
+    uint32_t stale = static_cast<uint32_t>(region_names.size());
+    while (unlink(regionPath(dir, stale).c_str()) == 0) ++stale;
+
+    records.clear();
+    roads.forEachRoad([&](int i, int j, double budget) {
+        if (city_region[i] != city_region[j] || city_region[i] == NO_REGION) {
+            records.push_back({static_cast<uint32_t>(i), static_cast<uint32_t>(j), budget});
+        }
+    });
+    if (!writeEdgeFile(dir + "/boundary.edges", cities.size(), records)) return false;
+
+    string temp_path = dir + "/city_regions.bin.tmp";
+    ofstream region_file(temp_path, ios::binary);
+    region_file.write(reinterpret_cast<const char*>(city_region.data()),
+                      static_cast<streamsize>(city_region.size() * sizeof(uint32_t)));
+    region_file.close();
+    recordBytesWritten(city_region.size() * sizeof(uint32_t));
+    if (region_file.fail() || !durableReplace(temp_path, dir + "/city_regions.bin")) return false;
+
+    temp_path = manifest + ".tmp";
+    ofstream manifest_file(temp_path);
+    manifest_file << "CRSHARDS,1," << source_stamp << "," << cities.size() << "," << records.size() << "\n";
+    for (uint32_t region = 0; region < region_names.size(); ++region) {
+        manifest_file << region_cities[region].size() << "," << states[region].roads << "," << region_names[region] << "\n";
+    }
+    recordBytesWritten(static_cast<size_t>(max<streamoff>(0, manifest_file.tellp())));
+    manifest_file.close();
+    if (manifest_file.fail() || !durableReplace(temp_path, manifest)) return false;
+
+    shard_dir = dir;
+    active = true;
+    loaded_bytes = 0;
+    for (uint32_t region = 0; region < region_names.size(); ++region) loaded_bytes += regionBytes(region);
+    return true;
+}
+
+// Parse one unsigned decimal field of a manifest line
+static bool manifestNumber(string_view& line, uint64_t& value) {
+    size_t comma = line.find(',');
+    string_view field = line.substr(0, comma);
+    line = comma == string_view::npos ? string_view() : line.substr(comma + 1);
+    auto result = from_chars(field.data(), field.data() + field.size(), value);
+    return result.ec == errc() && result.ptr == field.data() + field.size();
+}
+
+// Everything is read and checked before any member changes
+bool RegionShards::open(const string& dir, uint64_t source_stamp, size_t num_cities, vector<RoadEdge>& boundary,
+                        string& error) {
+    MappedFile manifest;
+    if (!manifest.open(dir + "/manifest.txt")) {
+        error = "no shards";
+        return false;
+    }
+    recordBytesRead(manifest.size());
+    string_view text = manifest.view();
+    size_t newline = text.find('\n');
+    string_view line = text.substr(0, newline);
+    uint64_t version = 0, stamp, city_count, boundary_count;
+    bool tagged = line.substr(0, 9) == "CRSHARDS,";
+    if (tagged) line.remove_prefix(9);
+    if (!tagged || !manifestNumber(line, version) || version != 1 || !manifestNumber(line, stamp) ||
+        !manifestNumber(line, city_count) || !manifestNumber(line, boundary_count)) {
+        error = "unreadable manifest";
+        return false;
+    }
+    if (stamp != source_stamp || city_count != num_cities) {
+        error = "shards were written from other data files";
+        return false;
+    }
+    vector<string> names;
+    vector<RegionState> region_states;
+    while (newline != string_view::npos && newline + 1 < text.size()) {
+        text.remove_prefix(newline + 1);
+        newline = text.find('\n');
+        line = text.substr(0, newline);
+        uint64_t region_size, region_roads;
+        if (!manifestNumber(line, region_size) || !manifestNumber(line, region_roads) || line.empty()) {
+            error = "unreadable manifest";
+            return false;
+        }
+        names.emplace_back(line);
+        region_states.emplace_back();
+        region_states.back().roads = region_roads;
+        region_states.back().loaded = false;
+    }
+
+    MappedFile region_file;
+    if (!region_file.open(dir + "/city_regions.bin") || region_file.size() != num_cities * sizeof(uint32_t)) {
+        error = "missing or truncated city_regions.bin";
+        return false;
+    }
+    recordBytesRead(region_file.size());
+    vector<uint32_t> regions(num_cities);
+    if (num_cities > 0) memcpy(regions.data(), region_file.data(), region_file.size());
+    for (uint32_t region : regions) {
+        if (region != NO_REGION && region >= names.size()) {
+            error = "city_regions.bin names a region that does not exist";
+            return false;
+        }
+    }
+    vector<RoadEdge> edges;
+    if (!readEdgeFile(dir + "/boundary.edges", num_cities, edges) || edges.size() != boundary_count) {
+        error = "missing or corrupt boundary.edges";
+        return false;
+    }
+
+    city_region.swap(regions);
+    region_names.clear();
+    region_index.clear();
+    for (uint32_t region = 0; region < names.size(); ++region) {
+        region_names.push_back(names[region]);
+        region_index.emplace(names[region], region);
+    }
+    states.swap(region_states);
+    listRegionCities();
+    boundary.swap(edges);
+    shard_dir = dir;
+    active = true;
+    loaded_bytes = 0;
+    return true;
+}
+
+// Regions keep their assignment; only the loading state goes away
+void RegionShards::deactivate() {
+    active = false;
+    loaded_bytes = 0;
+    for (RegionState& state : states) {
+        state.loaded = true;
+        state.pinned = false;
+    }
+}
+
+// The cities of the file must all exist in the table
+bool RegionShards::readRegion(uint32_t region, vector<RoadEdge>& edges) const {
+    return readEdgeFile(regionPath(shard_dir, region), city_region.size(), edges);
+}
+
+// Keeps loaded_bytes in step with the loaded set
+void RegionShards::setLoaded(uint32_t region, bool loaded) {
+    if (states[region].loaded == loaded) return;
+    states[region].loaded = loaded;
+    if (loaded) {
+        loaded_bytes += regionBytes(region);
+        touch(region);
+    } else {
+        loaded_bytes -= regionBytes(region);
+    }
+}
+
+// Linear in the number of regions, which is small next to the roads a region holds
+uint32_t RegionShards::evictionCandidate(const vector<uint32_t>& keep) const {
+    uint32_t oldest = NO_REGION;
+    for (uint32_t region = 0; region < states.size(); ++region) {
+        const RegionState& state = states[region];
+        if (!state.loaded || state.pinned || find(keep.begin(), keep.end(), region) != keep.end()) continue;
+        if (oldest == NO_REGION || state.last_used < states[oldest].last_used) oldest = region;
+    }
+    return oldest;
+}
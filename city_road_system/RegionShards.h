@@ -0,0 +1,128 @@
+#ifndef REGION_SHARDS_H
+#define REGION_SHARDS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "CityTable.h"
+#include "RoadStore.h"
+
+// Cities partitioned into regions, and the sharded on-disk layout that lets a session load
+// only the regions it touches.
+//
+// Every city belongs to one region, taken from the Region column of cities.txt or computed by
+// partition(). A road between two cities of the same region is internal to that region and is
+// stored in the region's shard; every other road (between regions, or at a city added since
+// the shards were written) is a boundary road, kept in memory at all times.
+//
+// Layout of the shard directory (binary files in native byte order):
+//   manifest.txt          "CRSHARDS,1,<source stamp>,<cities>,<boundary roads>", then one
+//                         "<cities>,<roads>,<name>" line per region
+//   city_regions.bin      uint32_t region of every city
+//   boundary.edges        boundary roads
+//   region<r>.edges       internal roads of region r
+// The .edges files use the binary edge list format of NetworkRenderer.h. The manifest is
+// written last and removed first, so a half-written directory never opens; the source stamp
+// ties the shards to one cities.txt/roads.txt pair, like the snapshot.
+//
+// Loading state: a region is loaded once its internal roads are in the road store. Pinned
+// regions have changes their shard file does not hold yet and stay loaded until the shards
+// are written again; the others can be evicted, least recently used first.
+class RegionShards {
+public:
+    static const uint32_t NO_REGION = UINT32_MAX;
+
+    // Check if any city has a region
+    bool hasRegions() const { return !region_names.empty(); }
+    // Number of regions
+    size_t regionCount() const { return region_names.size(); }
+    // Region of a city, NO_REGION if it has none
+    uint32_t regionOf(int city) const {
+        return static_cast<size_t>(city) < city_region.size() ? city_region[city] : NO_REGION;
+    }
+    // Name of a region
+    const std::string& regionName(uint32_t region) const { return region_names[region]; }
+    // Region with a name, NO_REGION if there is none
+    uint32_t findRegion(std::string_view name) const;
+    // Cities of a region in index order, as of the last time the shards were written or opened
+    const std::vector<int>& regionCities(uint32_t region) const { return region_cities[region]; }
+
+    // Give a city a region by name (an empty name leaves it without one), creating the region if needed
+    void setRegion(int city, std::string_view name);
+    // Grow to num_cities cities; new cities have no region
+    void resize(size_t num_cities);
+    // Forget the region of a city slot (it was deleted or reused)
+    void clearRegion(int city);
+    // Follow a renumbering of the cities: new_index[i] is the new index of city i (-1 = dropped)
+    void renumber(const std::vector<int>& new_index, size_t num_cities);
+    // Replace the regions with an automatic partition into connected regions of about
+    // cities_per_region cities: regions grow breadth-first from the lowest unassigned city, then
+    // regions under a quarter of that size join the neighbouring region they share most roads with
+    // (small regions without neighbours are collected together)
+    void partition(const CityTable& cities, const RoadStore& roads, size_t cities_per_region);
+    // Give every live city without a region the region most of its neighbours are in, or the
+    // smallest region if none of them has one
+    void placeUnassigned(const CityTable& cities, const RoadStore& roads);
+
+    // Write the shard directory for these roads (every region must be loaded). Afterwards every
+    // region counts as loaded and unpinned. Returns false on a write error.
+    bool write(const std::string& dir, const CityTable& cities, const RoadStore& roads, uint64_t source_stamp);
+    // Open a shard directory written for source_stamp and num_cities cities: read the regions of
+    // the cities and the boundary roads; no region is loaded yet. On failure nothing changes and
+    // error says why.
+    bool open(const std::string& dir, uint64_t source_stamp, size_t num_cities, std::vector<RoadEdge>& boundary,
+              std::string& error);
+    // Check if shards are in use (opened or written this session)
+    bool isActive() const { return active; }
+    // Stop using the shards; every region counts as loaded from now on
+    void deactivate();
+    // Read the internal roads of a region from its shard file, returns false if it is unreadable
+    bool readRegion(uint32_t region, std::vector<RoadEdge>& edges) const;
+
+    // Loading state of a region
+    bool isLoaded(uint32_t region) const { return !active || states[region].loaded; }
+    bool isPinned(uint32_t region) const { return states[region].pinned; }
+    // Record that a region was loaded or evicted
+    void setLoaded(uint32_t region, bool loaded);
+    // Keep a region loaded until the shards are written again
+    void pin(uint32_t region) { states[region].pinned = true; }
+    // Mark a region as just used (for least-recently-used eviction)
+    void touch(uint32_t region) { states[region].last_used = ++clock; }
+    // Internal roads of a region as last written
+    size_t regionRoads(uint32_t region) const { return states[region].roads; }
+    // Bytes the loaded regions take in the road store (both directions of each internal road)
+    size_t loadedBytes() const { return loaded_bytes; }
+    // Bytes a region takes in the road store once loaded
+    size_t regionBytes(uint32_t region) const { return states[region].roads * 2 * sizeof(Road); }
+    // Least recently used loaded region that is not pinned and not in keep, NO_REGION if none
+    uint32_t evictionCandidate(const std::vector<uint32_t>& keep) const;
+
+private:
+    std::vector<uint32_t> city_region;
+    std::vector<std::string> region_names;
+    std::unordered_map<std::string, uint32_t> region_index; // Name -> region
+    std::vector<std::vector<int>> region_cities;
+    struct RegionState {
+        size_t roads = 0;
+        bool loaded = true;
+        bool pinned = false;
+        uint64_t last_used = 0;
+    };
+    std::vector<RegionState> states;
+    std::string shard_dir;
+    bool active = false;
+    size_t loaded_bytes = 0;
+    uint64_t clock = 0;
+
+    // Recompute the city list of every region
+    void listRegionCities();
+    // Add a region with a name, returns its number
+    uint32_t addRegion(const std::string& name);
+    // Drop regions without cities and number the rest densely, keeping their order
+    void dropEmptyRegions();
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include "RoadStore.h"
+#include <algorithm>
+
+using namespace std;
+
+// A CSR base built in memory; shared by every copy of the store that still reads it
+struct OwnedBase {
+    vector<uint32_t> offsets;
+    vector<Road> edges;
+};
+
+// Build the CSR base from a road list with a counting pass, then sort and dedup each row
+void RoadStore::build(size_t num_cities, const vector<RoadEdge>& edges) {
+    vector<uint32_t> offsets(num_cities + 1, 0);
+    this->num_cities = num_cities;
+
+    auto valid = [num_cities](const RoadEdge& e) {
+        return e.city1 != e.city2 && e.city1 >= 0 && e.city2 >= 0 &&
+               static_cast<size_t>(e.city1) < num_cities && static_cast<size_t>(e.city2) < num_cities;
+    };
+
+    // Count both directions of every road, then turn counts into row offsets
+    for (const RoadEdge& e : edges) {
+        if (!valid(e)) continue;
+        ++offsets[e.city1 + 1];
+        ++offsets[e.city2 + 1];
+    }
+    for (size_t i = 0; i < num_cities; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    // Scatter roads into their rows in file order
+    vector<Road> base_edges(offsets[num_cities], Road{0, 0.0});
+    vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (const RoadEdge& e : edges) {
+        if (!valid(e)) continue;
+        base_edges[fill[e.city1]++] = Road{e.city2, e.budget};
+        base_edges[fill[e.city2]++] = Road{e.city1, e.budget};
+    }
+
+    // Sort each row by neighbour; stable so that for duplicates the last one read wins
+    uint32_t out = 0;
+    for (size_t i = 0; i < num_cities; ++i) {
+        uint32_t first = offsets[i];
+        uint32_t last = offsets[i + 1];
+        stable_sort(base_edges.begin() + first, base_edges.begin() + last,
+                    [](const Road& a, const Road& b) { return a.to < b.to; });
+        offsets[i] = out;
+        for (uint32_t k = first; k < last; ++k) {
+            if (k + 1 < last && base_edges[k + 1].to == base_edges[k].to) continue; // Keep the later duplicate
+            base_edges[out++] = base_edges[k];
+        }
+    }
+    offsets[num_cities] = out;
+    base_edges.resize(out);
+    base_edges.shrink_to_fit();
+    road_count = out / 2;
+    useOwnedBase(move(offsets), move(base_edges));
+}
+
+// Read the base straight from the adopted arrays
+void RoadStore::adoptBase(size_t num_cities, const uint32_t* offsets, const Road* edges, size_t num_roads,
+                          shared_ptr<const void> owner) {
+    base_owner = move(owner);
+    offsets_data = offsets;
+    edges_data = edges;
+    base_rows = num_cities;
+    this->num_cities = num_cities;
+    delta_chunks = make_shared<ChunkDirectory>((num_cities + DELTA_CHUNK - 1) / DELTA_CHUNK);
+    delta_rows = 0;
+    road_count = num_roads;
+}
+
+// Grow the store; the CSR base is left alone and new rows read as empty
+void RoadStore::resize(size_t num_cities) {
+    if (num_cities > this->num_cities) {
+        this->num_cities = num_cities;
+        if (delta_chunks.use_count() > 1) delta_chunks = make_shared<ChunkDirectory>(*delta_chunks);
+        delta_chunks->resize((num_cities + DELTA_CHUNK - 1) / DELTA_CHUNK);
+    }
+}
+
+// Neighbours of a city: its delta row if it has been rewritten, otherwise its CSR slice
+RoadStore::RowView RoadStore::row(int city) const {
+    const DeltaChunk* chunk = (*delta_chunks)[city / DELTA_CHUNK].get();
+    if (chunk && chunk->rows[city % DELTA_CHUNK]) {
+        const vector<Road>& r = *chunk->rows[city % DELTA_CHUNK];
+        return RowView{r.data(), r.data() + r.size()};
+    }
+    if (static_cast<size_t>(city) >= base_rows) {
+        return RowView{nullptr, nullptr}; // City added after the base was built
+    }
+    return RowView{edges_data + offsets_data[city], edges_data + offsets_data[city + 1]};
+}
+
+// Binary search the sorted row of city1 for city2
+const Road* RoadStore::find(int city1, int city2) const {
+    RowView r = row(city1);
+    const Road* it = lower_bound(r.begin(), r.end(), city2,
+                                 [](const Road& road, int to) { return road.to < to; });
+    if (it == r.end() || it->to != city2) return nullptr;
+    return it;
+}
+
+// Add a road in both directions
+bool RoadStore::insert(int city1, int city2, double budget) {
+    if (city1 == city2 || hasRoad(city1, city2)) return false;
+    insertSorted(mutableRow(city1), city2, budget);
+    insertSorted(mutableRow(city2), city1, budget);
+    ++road_count;
+    foldDeltaIfLarge();
+    return true;
+}
+
+// Change the budget of an existing road in both directions
+bool RoadStore::setBudget(int city1, int city2, double budget) {
+    if (!hasRoad(city1, city2)) return false;
+    insertSorted(mutableRow(city1), city2, budget);
+    insertSorted(mutableRow(city2), city1, budget);
+    foldDeltaIfLarge();
+    return true;
+}
+
+// Remove both directions from their (delta) rows
+bool RoadStore::erase(int city1, int city2) {
+    if (!hasRoad(city1, city2)) return false;
+    for (auto [from, to] : {pair<int, int>{city1, city2}, pair<int, int>{city2, city1}}) {
+        vector<Road>& r = mutableRow(from);
+        r.erase(lower_bound(r.begin(), r.end(), to, [](const Road& road, int t) { return road.to < t; }));
+    }
+    --road_count;
+    foldDeltaIfLarge();
+    return true;
+}
+
+// Merge the rows that may differ. Both directions of a road are always written together, so a
+// changed road shows up in the row of its lower city as well and is reported from there.
+void RoadStore::diff(const RoadStore& before, const RoadStore& after, vector<RoadChange>& changes) {
+    changes.clear();
+    size_t n = max(before.num_cities, after.num_cities);
+    bool same_base = before.edges_data == after.edges_data && before.offsets_data == after.offsets_data &&
+                     before.base_rows == after.base_rows;
+    if (same_base && before.delta_chunks == after.delta_chunks) return; // Nothing written since the copy
+    auto rowOf = [](const RoadStore& store, size_t city) {
+        return city < store.num_cities ? store.row(static_cast<int>(city)) : RowView{nullptr, nullptr};
+    };
+    auto compareRow = [&](size_t city) {
+        RowView a = rowOf(before, city);
+        RowView b = rowOf(after, city);
+        const Road* x = lower_bound(a.begin(), a.end(), static_cast<int>(city) + 1, [](const Road& road, int to) { return road.to < to; });
+        const Road* y = lower_bound(b.begin(), b.end(), static_cast<int>(city) + 1, [](const Road& road, int to) { return road.to < to; });
+        int i = static_cast<int>(city);
+        while (x != a.end() || y != b.end()) {
+            if (y == b.end() || (x != a.end() && x->to < y->to)) {
+                changes.push_back({i, x->to, x->budget, nullopt});
+                ++x;
+            } else if (x == a.end() || y->to < x->to) {
+                changes.push_back({i, y->to, nullopt, y->budget});
+                ++y;
+            } else {
+                if (x->budget != y->budget) changes.push_back({i, x->to, x->budget, y->budget});
+                ++x;
+                ++y;
+            }
+        }
+    };
+    for (size_t c = 0; c * DELTA_CHUNK < n; ++c) {
+        const DeltaChunk* a = c < before.delta_chunks->size() ? (*before.delta_chunks)[c].get() : nullptr;
+        const DeltaChunk* b = c < after.delta_chunks->size() ? (*after.delta_chunks)[c].get() : nullptr;
+        if (same_base && a == b) continue; // Same rows on both sides
+        size_t last = min(n, (c + 1) * DELTA_CHUNK);
+        for (size_t city = c * DELTA_CHUNK; city < last; ++city) {
+            size_t k = city % DELTA_CHUNK;
+            const vector<Road>* row_a = a ? a->rows[k].get() : nullptr;
+            const vector<Road>* row_b = b ? b->rows[k].get() : nullptr;
+            if (same_base && row_a == row_b && (city < before.num_cities) == (city < after.num_cities)) continue;
+            compareRow(city);
+        }
+    }
+}
+
+// Rewritten rows are shared as they are; others are copied out of the base
+shared_ptr<const vector<Road>> RoadStore::sharedRow(int city) const {
+    const DeltaChunk* chunk = (*delta_chunks)[city / DELTA_CHUNK].get();
+    if (chunk && chunk->rows[city % DELTA_CHUNK]) return chunk->rows[city % DELTA_CHUNK];
+    RowView r = row(city);
+    return make_shared<const vector<Road>>(r.begin(), r.end());
+}
+
+// Each row goes back into the delta as a private copy; the road count follows the row sizes
+void RoadStore::restoreRows(const vector<pair<int, shared_ptr<const vector<Road>>>>& rows) {
+    ptrdiff_t entries = 0;
+    for (const auto& [city, saved] : rows) {
+        entries -= static_cast<ptrdiff_t>(row(city).size());
+        shared_ptr<vector<Road>>& slot = mutableSlot(city);
+        if (!slot) ++delta_rows;
+        slot = make_shared<vector<Road>>(*saved);
+        entries += static_cast<ptrdiff_t>(saved->size());
+    }
+    road_count = static_cast<size_t>(static_cast<ptrdiff_t>(road_count) + entries / 2);
+    foldDeltaIfLarge();
+}
+
+// A directory or chunk still shared with another copy of the store is cloned (a pointer per
+// chunk or per row) before anything in it changes
+shared_ptr<vector<Road>>& RoadStore::mutableSlot(int city) {
+    if (delta_chunks.use_count() > 1) delta_chunks = make_shared<ChunkDirectory>(*delta_chunks);
+    shared_ptr<DeltaChunk>& chunk = (*delta_chunks)[city / DELTA_CHUNK];
+    if (!chunk) {
+        chunk = make_shared<DeltaChunk>();
+    } else if (chunk.use_count() > 1) {
+        chunk = make_shared<DeltaChunk>(*chunk);
+    }
+    return chunk->rows[city % DELTA_CHUNK];
+}
+
+// Copy a city's CSR slice into the delta buffer the first time it is written, and a shared row
+// before it is written
+vector<Road>& RoadStore::mutableRow(int city) {
+    shared_ptr<vector<Road>>& slot = mutableSlot(city);
+    if (!slot) {
+        RowView r = row(city); // Still the base slice, the slot is empty
+        slot = make_shared<vector<Road>>(r.begin(), r.end());
+        ++delta_rows;
+    } else if (slot.use_count() > 1) {
+        slot = make_shared<vector<Road>>(*slot);
+    }
+    return *slot;
+}
+
+// Insert a neighbour keeping the row sorted, or overwrite its budget if it is already there
+bool RoadStore::insertSorted(vector<Road>& row, int to, double budget) {
+    auto it = lower_bound(row.begin(), row.end(), to,
+                          [](const Road& road, int t) { return road.to < t; });
+    if (it != row.end() && it->to == to) {
+        it->budget = budget;
+        return false;
+    }
+    row.insert(it, Road{to, budget});
+    return true;
+}
+
+// Rebuild the CSR base once more than 1/8 of the cities (and at least 64) have delta rows,
+// or 1/2 if another copy shares the base and would keep the old one alive next to the new.
+// The new base is a fresh allocation, so copies still reading the old one are unaffected.
+void RoadStore::foldDeltaIfLarge() {
+    size_t n = num_cities;
+    size_t fraction = base_owner.use_count() > 1 ? 2 : 8;
+    if (delta_rows < 64 || delta_rows * fraction < n) return;
+
+    vector<uint32_t> offsets(n + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+        offsets[i + 1] = offsets[i] + static_cast<uint32_t>(row(static_cast<int>(i)).size());
+    }
+    vector<Road> edges;
+    edges.reserve(offsets[n]);
+    for (size_t i = 0; i < n; ++i) {
+        RowView r = row(static_cast<int>(i));
+        edges.insert(edges.end(), r.begin(), r.end());
+    }
+    useOwnedBase(move(offsets), move(edges));
+}
+
+// Share the new arrays as the base (dropping any adopted ones) and start an empty delta
+void RoadStore::useOwnedBase(vector<uint32_t> offsets, vector<Road> edges) {
+    auto base = make_shared<OwnedBase>();
+    base->offsets = move(offsets);
+    base->edges = move(edges);
+    offsets_data = base->offsets.data();
+    edges_data = base->edges.data();
+    base_rows = base->offsets.size() - 1;
+    base_owner = move(base);
+    delta_chunks = make_shared<ChunkDirectory>((num_cities + DELTA_CHUNK - 1) / DELTA_CHUNK);
+    delta_rows = 0;
+}
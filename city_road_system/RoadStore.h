@@ -0,0 +1,147 @@
+#ifndef ROAD_STORE_H
+#define ROAD_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// One direction of a road: the neighbouring city index and the road budget in billions RWF
+struct Road {
+    int to;
+    double budget;
+};
+
+// Road as read from a file or built by a caller: both endpoints and the budget
+struct RoadEdge {
+    int city1;
+    int city2;
+    double budget;
+};
+
+// A road that differs between two stores (city1 < city2); a side without the road has no budget
+struct RoadChange {
+    int city1;
+    int city2;
+    std::optional<double> before;
+    std::optional<double> after;
+};
+
+// Sparse, symmetric edge store for the city-road network.
+// Roads live in a CSR (compressed sparse row) base: the neighbours of city i are
+// edges[offsets[i] .. offsets[i + 1]), sorted by neighbour index.
+// Rows changed after the base was built are copied into a small delta buffer and
+// edited there, so inserts never shift the whole edge array. When the delta grows
+// past a fraction of the cities it is folded back into a fresh base.
+// Memory and full scans are proportional to the number of roads, not cities squared.
+// The base can also be adopted from a memory-mapped snapshot and read in place.
+// Copies are O(1) and share structure: the base is immutable and shared, and the delta is a
+// shared directory of chunks of DELTA_CHUNK cities, each holding shared rows. All three levels
+// are copied on write, and only along the path to the row being written, so a copy kept as a
+// snapshot holds on to little more than what changed since. While a copy still shares the
+// base, the delta is folded later (at half the cities instead of an eighth), so that the
+// snapshot is not left as the only owner of a whole old base.
+// Thread safety: copy on write trusts use_count(), and a count of 1 is taken to mean that no
+// other copy can still read the directory, chunk or row, which is then written in place.
+// use_count() is only a hint and orders no memory, so this holds only if every copy sharing
+// structure with a store is destroyed on the thread that writes the store. Copies may be read
+// from other threads (NetworkVersions), but never released there.
+class RoadStore {
+public:
+    // Read-only view over the sorted neighbours of one city
+    struct RowView {
+        const Road* first;
+        const Road* last;
+        const Road* begin() const { return first; }
+        const Road* end() const { return last; }
+        size_t size() const { return static_cast<size_t>(last - first); }
+        bool empty() const { return first == last; }
+    };
+
+    // Rebuild the store for num_cities cities from a list of roads.
+    // Self-loops and roads with out-of-range endpoints are ignored; if a road appears
+    // twice, the later budget wins (same as assigning matrix cells in file order).
+    void build(size_t num_cities, const std::vector<RoadEdge>& edges);
+    // Use a CSR base owned by someone else (e.g., a mapped snapshot): num_cities + 1 offsets
+    // into edges, rows sorted by neighbour. The owner keeps the arrays alive; they are never written.
+    void adoptBase(size_t num_cities, const uint32_t* offsets, const Road* edges, size_t num_roads,
+                   std::shared_ptr<const void> owner);
+    // Grow the store to num_cities cities; new cities have no roads
+    void resize(size_t num_cities);
+    // Number of cities (rows) in the store
+    size_t cityCount() const { return num_cities; }
+    // Number of undirected roads in the store
+    size_t roadCount() const { return road_count; }
+
+    // Neighbours of a city, sorted by index
+    RowView row(int city) const;
+    // Immutable copy of a city's row as it is now; a rewritten row is shared, not copied
+    std::shared_ptr<const std::vector<Road>> sharedRow(int city) const;
+    // Put back rows taken with sharedRow. Both ends of every road that differs must be included,
+    // so the store stays symmetric.
+    void restoreRows(const std::vector<std::pair<int, std::shared_ptr<const std::vector<Road>>>>& rows);
+    // Find the road between two cities, returns nullptr if there is none
+    const Road* find(int city1, int city2) const;
+    // Check if a road exists between two cities
+    bool hasRoad(int city1, int city2) const { return find(city1, city2) != nullptr; }
+    // Add a road in both directions, returns false if it already exists
+    bool insert(int city1, int city2, double budget);
+    // Change the budget of an existing road in both directions, returns false if there is no road
+    bool setBudget(int city1, int city2, double budget);
+    // Remove a road in both directions, returns false if there is no road. Costs a binary search
+    // and a shift within the two rows, so O(degree).
+    bool erase(int city1, int city2);
+
+    // List the roads that differ from before to after, in row order. Delta chunks the two stores
+    // share are skipped, and so are rows neither rewrote when they share the base, so the cost
+    // follows what changed between them rather than the size of the network.
+    static void diff(const RoadStore& before, const RoadStore& after, std::vector<RoadChange>& changes);
+
+    // Visit every road once (city1 < city2) in row order: fn(city1, city2, budget)
+    template <typename Fn>
+    void forEachRoad(Fn fn) const {
+        for (size_t i = 0; i < num_cities; ++i) {
+            for (const Road& road : row(static_cast<int>(i))) {
+                if (road.to > static_cast<int>(i)) fn(static_cast<int>(i), road.to, road.budget);
+            }
+        }
+    }
+
+private:
+    static const size_t DELTA_CHUNK = 256;
+
+    // Rewritten rows of DELTA_CHUNK consecutive cities (null = not rewritten). Rows may be
+    // shared with copies of the chunk and are copied before a write while they are.
+    struct DeltaChunk {
+        std::shared_ptr<std::vector<Road>> rows[DELTA_CHUNK];
+    };
+    using ChunkDirectory = std::vector<std::shared_ptr<DeltaChunk>>;
+
+    // CSR base: row offsets (base_rows + 1 entries) and the neighbour array, never written once
+    // built. base_owner keeps them alive: a vector pair built here, or a mapped snapshot.
+    const uint32_t* offsets_data = nullptr;
+    const Road* edges_data = nullptr;
+    size_t base_rows = 0;
+    std::shared_ptr<const void> base_owner;
+    // Delta buffer: chunk c holds the rewritten rows of cities c * DELTA_CHUNK onwards (null = none)
+    std::shared_ptr<ChunkDirectory> delta_chunks = std::make_shared<ChunkDirectory>();
+    size_t delta_rows = 0;
+    size_t num_cities = 0;
+    size_t road_count = 0;
+
+    // Return a writable copy of a city's row, moving it into the delta buffer on first write
+    // and copying the directory, chunk and row first if another store still shares them
+    std::vector<Road>& mutableRow(int city);
+    // Chunk slot of a city's row, with the directory and chunk made private to this store
+    // (by use_count(), see the thread safety note above)
+    std::shared_ptr<std::vector<Road>>& mutableSlot(int city);
+    // Insert or overwrite one direction of a road in a writable row
+    static bool insertSorted(std::vector<Road>& row, int to, double budget);
+    // Fold the delta buffer back into the CSR base once it holds too many rows
+    void foldDeltaIfLarge();
+    // Make a freshly built offsets/edges pair the base and clear the delta
+    void useOwnedBase(std::vector<uint32_t> offsets, std::vector<Road> edges);
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "ScriptRunner.h"
+#include <charconv>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Strip spaces, tabs and a trailing '\r' from both ends
+static string_view trim(string_view text) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == string_view::npos) return string_view();
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+// Split the argument part of a command on commas (no arguments gives an empty list)
+static void splitArguments(string_view text, vector<string>& args) {
+    args.clear();
+    text = trim(text);
+    if (text.empty()) return;
+    size_t start = 0;
+    while (true) {
+        size_t comma = text.find(',', start);
+        args.emplace_back(trim(text.substr(start, comma == string_view::npos ? string_view::npos : comma - start)));
+        if (comma == string_view::npos) break;
+        start = comma + 1;
+    }
+}
+
+// Whole-field non-negative number, like the interactive prompts accept
+static bool parseNumber(const string& text, double& value) {
+    const char* first = text.data();
+    const char* last = first + text.size();
+    if (first != last && *first == '+') ++first;
+    auto result = from_chars(first, last, value);
+    return result.ec == errc() && result.ptr == last && value >= 0;
+}
+
+// Whole-field non-negative integer
+static bool parseIndex(const string& text, int& value) {
+    auto result = from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == errc() && result.ptr == text.data() + text.size() && value >= 0;
+}
+
+// Four whole-field non-negative integers: first row, last row, first column, last column
+static bool parseWindow(const vector<string>& args, int (&window)[4]) {
+    for (int i = 0; i < 4; ++i) {
+        if (!parseIndex(args[i], window[i])) return false;
+    }
+    return true;
+}
+
+// Read commands line by line and call the matching CityRoadSystem operation
+size_t runScript(CityRoadSystem& system, istream& script) {
+    system.setDeferredSync(true);
+    size_t errors = 0;
+    size_t line_number = 0;
+    string line;
+    vector<string> args;
+    double number;
+    double high;
+    int index;
+    int updates;
+    int page_size;
+    int window[4];
+    while (getline(script, line)) {
+        ++line_number;
+        string_view text = trim(line);
+        if (text.empty() || text[0] == '#') continue;
+        size_t space = text.find_first_of(" \t");
+        string command(text.substr(0, space));
+        splitArguments(space == string_view::npos ? string_view() : text.substr(space + 1), args);
+
+        bool ok = true;
+        if (command == "city" && args.size() == 1) {
+            system.addCity(args[0]);
+        } else if (command == "import-cities" && args.size() == 1) {
+            system.importCitiesFromFile(args[0]);
+        } else if (command == "road" && args.size() == 3 && parseNumber(args[2], number)) {
+            system.addRoad(args[0], args[1], number);
+        } else if (command == "budget" && args.size() == 3 && parseNumber(args[2], number)) {
+            system.updateBudget(args[0], args[1], number);
+        } else if (command == "delete-budget" && args.size() == 2) {
+            system.deleteBudget(args[0], args[1]);
+        } else if (command == "delete-road" && args.size() == 2) {
+            system.deleteRoad(args[0], args[1]);
+        } else if (command == "delete-city" && args.size() == 1 && parseIndex(args[0], index)) {
+            system.deleteCity(index);
+        } else if (command == "rename" && args.size() == 2 && parseIndex(args[0], index)) {
+            system.updateCityName(index, args[1]);
+        } else if (command == "read" && args.size() == 2) {
+            system.readBudget(args[0], args[1]);
+        } else if (command == "search" && args.size() == 1 && parseIndex(args[0], index)) {
+            system.searchCity(index);
+        } else if (command == "route" && args.size() == 2) {
+            system.findShortestPath(args[0], args[1]);
+        } else if (command == "nearest" && args.size() == 2 && parseIndex(args[1], index)) {
+            system.findNearestCities(args[0], index);
+        } else if (command == "routes" && args.size() == 2) {
+            system.answerRouteQueries(args[0], args[1]);
+        } else if (command == "plan") {
+            system.planMinimumNetwork(args);
+        } else if (command == "components") {
+            system.findConnectedComponents(args);
+        } else if (command == "within" && args.size() == 2 && parseIndex(args[1], index)) {
+            system.findCitiesWithinHops(args[0], index);
+        } else if (command == "common" && args.size() == 2) {
+            system.findCommonNeighbors(args[0], args[1]);
+        } else if (command == "summary" && args.empty()) {
+            system.displayNetworkSummary();
+        } else if (command == "city-totals" && args.size() == 1) {
+            system.displayCityTotals(args[0]);
+        } else if (command == "top-roads" && args.size() == 1 && parseIndex(args[0], index)) {
+            system.displayTopRoads(index);
+        } else if (command == "budget-range" && args.size() == 2 && parseNumber(args[0], number) &&
+                   parseNumber(args[1], high)) {
+            system.displayRoadsInBudgetRange(number, high);
+        } else if (command == "connected" && args.size() == 2) {
+            system.checkConnected({args[0]}, {args[1]});
+        } else if (command == "centrality" && !args.empty() && args.size() <= 3 &&
+                   (args.size() == 1 || parseIndex(args[1], index))) {
+            system.analyzeCentrality(args[0], args.size() == 1 ? 0 : index, args.size() == 3 ? args[2] : "");
+        } else if (command == "save-version" && args.size() == 1) {
+            system.saveVersion(args[0]);
+        } else if (command == "restore-version" && args.size() == 1) {
+            system.restoreVersion(args[0]);
+        } else if (command == "diff" && (args.size() == 1 || args.size() == 2)) {
+            system.diffVersions(args[0], args.size() == 2 ? args[1] : "current");
+        } else if (command == "delete-version" && args.size() == 1) {
+            system.deleteVersion(args[0]);
+        } else if (command == "versions" && args.empty()) {
+            system.listVersions();
+        } else if (command == "undo" && args.empty()) {
+            system.undoLastChange();
+        } else if (command == "cities" && args.empty()) {
+            system.displayCities();
+        } else if (command == "roads" && args.empty()) {
+            system.displayRoads();
+        } else if (command == "matrices" && args.empty()) {
+            system.displayAdjacencyMatrices();
+        } else if (command == "all" && args.empty()) {
+            system.displayAllData();
+        } else if (command == "cities-matrix" && args.empty()) {
+            system.displayCitiesAndRoadMatrix();
+        } else if (command == "roads-page" && args.size() == 2 && parseIndex(args[0], index) &&
+                   parseIndex(args[1], page_size)) {
+            system.displayRoadsPage(index, page_size);
+        } else if ((command == "matrix-window" || command == "budget-window" || command == "sparse-matrix") &&
+                   args.size() == 4 && parseWindow(args, window)) {
+            if (command == "sparse-matrix") {
+                system.displaySparseMatrix(window[0], window[1], window[2], window[3]);
+            } else {
+                system.displayMatrixWindow(window[0], window[1], window[2], window[3], command == "budget-window");
+            }
+        } else if ((command == "export-graphml" || command == "export-edges") && args.size() == 1) {
+            system.exportNetwork(args[0], command == "export-edges");
+        } else if (command == "shard" && args.size() <= 1 && (args.empty() || parseIndex(args[0], index))) {
+            system.buildRegionShards(args.empty() ? 0 : index);
+        } else if (command == "regions" && args.empty()) {
+            system.displayRegions();
+        } else if (command == "region" && args.size() == 1) {
+            system.displayRegion(args[0]);
+        } else if (command == "dot" && args.empty()) {
+            system.generateGraphImage();
+        } else if (command == "index" && args.empty()) {
+            system.buildRouteIndex();
+        } else if (command == "snapshot" && args.empty()) {
+            system.saveSnapshot();
+        } else if (command == "compact" && args.empty()) {
+            system.compactData();
+        } else if (command == "stress-readers" && args.size() == 2 && parseIndex(args[0], index) &&
+                   parseIndex(args[1], updates)) {
+            system.stressTestReaders(index, updates);
+        } else if (command == "stats" && args.empty()) {
+            system.displayOperationStats();
+        } else if (command == "checkpoint" && args.empty()) {
+            if (system.checkpoint()) {
+                cout << "Checkpoint: all changes saved.\n";
+            } else {
+                cout << "Line " << line_number << ": checkpoint failed, changes could not be saved.\n";
+                ++errors;
+            }
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            cout << "Line " << line_number << ": cannot run \"" << text << "\".\n";
+            ++errors;
+        }
+    }
+    if (!system.checkpoint()) {
+        cout << "Changes could not be saved.\n";
+        ++errors;
+    }
+    system.setDeferredSync(false);
+    return errors;
+}
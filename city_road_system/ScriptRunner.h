@@ -0,0 +1,66 @@
+#ifndef SCRIPT_RUNNER_H
+#define SCRIPT_RUNNER_H
+
+#include <cstddef>
+#include <istream>
+#include "CityRoadSystem.h"
+
+// Batch scripts: one command per line, "command arg1,arg2,...". Arguments are separated by
+// commas and trimmed, so city names may contain spaces. Blank lines and lines starting with
+// '#' are skipped.
+//
+//   city NAME                     add a city
+//   import-cities FILE            bulk import of a file with one city name per line
+//   road CITY1,CITY2,BUDGET       add a road
+//   budget CITY1,CITY2,BUDGET     update a road budget
+//   delete-budget CITY1,CITY2     delete a road budget
+//   delete-road CITY1,CITY2       delete a road
+//   delete-city INDEX             delete a city and its roads
+//   rename INDEX,NAME             rename a city
+//   read CITY1,CITY2              read a road budget
+//   search INDEX                  look up a city by index
+//   route CITY1,CITY2             cheapest route
+//   nearest CITY,K                K nearest cities by budget (0 = all)
+//   routes QUERY_FILE,OUTPUT_FILE answer a file of route queries
+//   plan [CITY,...]               minimum-cost network (all cities if none are given)
+//   components [CITY,...]         connected components (of the whole network if no cities are given)
+//   within CITY,HOPS              cities at most HOPS roads away
+//   common CITY1,CITY2            cities with a road to both cities
+//   summary                       road, budget, component and isolated-city totals
+//   city-totals CITY              roads and total budget at a city
+//   top-roads K                   the K most expensive roads
+//   budget-range LOW,HIGH         roads with LOW <= budget <= HIGH
+//   connected CITY1,CITY2         check if two cities are joined by roads
+//   centrality FILE[,SAMPLES[,ROAD_FILE]]   betweenness and closeness of every city as CSV
+//                                 (from SAMPLES random cities if given and not 0), road betweenness too
+//   save-version NAME             save the network as a named version
+//   restore-version NAME          go back to a named version
+//   diff FROM[,TO]                roads changed between versions ("current" = now, the default TO)
+//   delete-version NAME           forget a named version
+//   versions                      list the named versions
+//   undo                          undo the last change
+//   cities | roads | matrices | all | cities-matrix   displays
+//   roads-page PAGE,SIZE          one page of the road list (pages count from 1)
+//   matrix-window R1,R2,C1,C2     road matrix rows R1..R2, columns C1..C2 (city indices)
+//   budget-window R1,R2,C1,C2     the same window of the budget matrix
+//   sparse-matrix R1,R2,C1,C2     only the non-zero cells of a window
+//   export-graphml FILE           write the network as GraphML
+//   export-edges FILE             write the roads as a binary edge list
+//   shard [CITIES_PER_REGION]     write region shards, partitioning the network if a size is given
+//                                 (otherwise by the Region column of cities.txt)
+//   regions                       list the regions and which are loaded
+//   region NAME                   cities and roads of one region, loading only that region
+//   dot                           write city_roads.dot
+//   index                         build the routing index
+//   snapshot                      write the binary snapshot
+//   compact                       fold the journal into cities.txt/roads.txt
+//   checkpoint                    make all changes so far durable
+//   stress-readers THREADS,UPDATES   check concurrent readers against a private copy
+//   stats                         call counts, latency and bytes per operation
+//
+// Changes are synced at checkpoints and once at the end of the script, not after each command.
+// Returns the number of lines that could not be run (unknown command or bad arguments) plus the
+// number of failed checkpoints, including the one at the end.
+size_t runScript(CityRoadSystem& system, std::istream& script);
+
+#endif
@@ -0,0 +1,254 @@
+#include "Snapshot.h"
+#include "ContractionHierarchy.h"
+#include "Journal.h"
+#include "MappedFile.h"
+#include "Metrics.h"
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+using namespace std;
+
+static_assert(sizeof(Road) == 16 && offsetof(Road, budget) == 8, "snapshot stores Road as {int32 to, pad, double budget}");
+static_assert(sizeof(CityTable::NameRef) == 8, "snapshot stores NameRef as {uint32 offset, uint32 length}");
+
+static const char SNAPSHOT_MAGIC[8] = {'C', 'R', 'S', 'N', 'A', 'P', '\0', '\0'};
+
+// FNV-1a, continued from a previous value
+static uint64_t checksum(const void* data, size_t size, uint64_t h = 1469598103934665603ULL) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Writes sections after the header, keeping track of offsets, 8-byte padding and the payload checksum
+class SectionWriter {
+public:
+    explicit SectionWriter(ofstream& out) : out(out), offset(sizeof(SnapshotHeader)) {}
+
+    // Start a section on an 8-byte boundary and return its file offset
+    uint64_t beginSection() {
+        static const char zeros[8] = {};
+        write(zeros, (8 - offset % 8) % 8);
+        return offset;
+    }
+    void write(const void* data, size_t size) {
+        out.write(static_cast<const char*>(data), static_cast<streamsize>(size));
+        payload_checksum = checksum(data, size, payload_checksum);
+        offset += size;
+    }
+    uint64_t size() const { return offset; }
+    uint64_t checksumValue() const { return payload_checksum; }
+
+private:
+    ofstream& out;
+    uint64_t offset;
+    uint64_t payload_checksum = 1469598103934665603ULL;
+};
+
+// Write header placeholder, sections, then the finished header
+bool writeSnapshot(const string& path, const CityTable& cities, const RoadStore& roads, uint64_t source_stamp) {
+    string temp_path = path + ".tmp";
+    ofstream out(temp_path, ios::binary | ios::trunc);
+    if (!out.is_open()) return false;
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    SectionWriter writer(out);
+    CityTable::Layout layout = cities.layout();
+    size_t n = cities.size();
+
+    // Names are packed so dead arena bytes left by renames are not written
+    vector<CityTable::NameRef> refs(n);
+    header.arena_offset = writer.beginSection();
+    uint32_t arena_bytes = 0;
+    for (size_t i = 0; i < n; ++i) {
+        string_view name = cities[i];
+        refs[i] = {arena_bytes, static_cast<uint32_t>(name.size())};
+        writer.write(name.data(), name.size());
+        arena_bytes += static_cast<uint32_t>(name.size());
+    }
+    header.names_offset = writer.beginSection();
+    writer.write(refs.data(), n * sizeof(CityTable::NameRef));
+    header.hashes_offset = writer.beginSection();
+    writer.write(layout.hashes, n * sizeof(uint32_t));
+    header.slots_offset = writer.beginSection();
+    writer.write(layout.slots, layout.slot_count * sizeof(int32_t));
+
+    // CSR offsets, then every row in order with the Road padding zeroed
+    vector<uint32_t> row_offsets(n + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+        row_offsets[i + 1] = row_offsets[i] + static_cast<uint32_t>(roads.row(static_cast<int>(i)).size());
+    }
+    header.row_offsets_offset = writer.beginSection();
+    writer.write(row_offsets.data(), row_offsets.size() * sizeof(uint32_t));
+    header.edges_offset = writer.beginSection();
+    vector<unsigned char> block;
+    for (size_t i = 0; i < n; ++i) {
+        RoadStore::RowView row = roads.row(static_cast<int>(i));
+        block.assign(row.size() * sizeof(Road), 0);
+        unsigned char* cell = block.data();
+        for (const Road& road : row) {
+            memcpy(cell + offsetof(Road, to), &road.to, sizeof(road.to));
+            memcpy(cell + offsetof(Road, budget), &road.budget, sizeof(road.budget));
+            cell += sizeof(Road);
+        }
+        writer.write(block.data(), block.size());
+    }
+
+    // Summed in the order NetworkAggregates::rebuild uses, so the sums come back bit for bit
+    vector<double> budget_sums(n, 0.0);
+    double total_budget = 0.0;
+    roads.forEachRoad([&](int i, int j, double budget) {
+        budget_sums[i] += budget;
+        budget_sums[j] += budget;
+        total_budget += budget;
+    });
+    header.budget_sums_offset = writer.beginSection();
+    writer.write(budget_sums.data(), n * sizeof(double));
+
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.header_size = sizeof(SnapshotHeader);
+    header.source_stamp = source_stamp;
+    header.city_count = n;
+    header.arena_bytes = arena_bytes;
+    header.slot_count = layout.slot_count;
+    header.indexed_count = layout.indexed;
+    header.road_count = roads.roadCount();
+    header.edge_count = row_offsets[n];
+    header.roads_fingerprint = ContractionHierarchy::fingerprint(roads);
+    header.total_budget = total_budget;
+    header.file_size = writer.size();
+    header.payload_checksum = writer.checksumValue();
+    header.header_checksum = checksum(&header, offsetof(SnapshotHeader, header_checksum));
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+    recordBytesWritten(writer.size());
+    return !out.fail() && durableReplace(temp_path, path);
+}
+
+// Check that a section of count elements of elem_size bytes fits inside the file
+static bool sectionFits(uint64_t offset, uint64_t count, uint64_t elem_size, uint64_t file_size) {
+    return offset % 8 == 0 && offset <= file_size && count <= (file_size - offset) / elem_size;
+}
+
+// What the loaded structures rely on without checking it again: rows that stay inside the
+// neighbour array, neighbours and hash slots that name real cities, names inside the arena, and
+// a free hash slot to end every probe. One pass over the arrays, far cheaper than the checksum.
+static bool payloadConsistent(const SnapshotHeader& header, const char* base) {
+    uint64_t n = header.city_count;
+    const uint32_t* row_offsets = reinterpret_cast<const uint32_t*>(base + header.row_offsets_offset);
+    if (row_offsets[0] != 0 || row_offsets[n] != header.edge_count || header.edge_count != 2 * header.road_count) return false;
+    for (uint64_t i = 0; i < n; ++i) {
+        if (row_offsets[i] > row_offsets[i + 1]) return false;
+    }
+    const Road* edges = reinterpret_cast<const Road*>(base + header.edges_offset);
+    for (uint64_t e = 0; e < header.edge_count; ++e) {
+        if (edges[e].to < 0 || static_cast<uint64_t>(edges[e].to) >= n) return false;
+    }
+    const CityTable::NameRef* names = reinterpret_cast<const CityTable::NameRef*>(base + header.names_offset);
+    for (uint64_t i = 0; i < n; ++i) {
+        if (names[i].offset > header.arena_bytes || names[i].length > header.arena_bytes - names[i].offset) return false;
+    }
+    const int32_t* slots = reinterpret_cast<const int32_t*>(base + header.slots_offset);
+    uint64_t used = 0;
+    for (uint64_t s = 0; s < header.slot_count; ++s) {
+        if (slots[s] == -1) continue;
+        if (slots[s] < 0 || static_cast<uint64_t>(slots[s]) >= n) return false;
+        ++used;
+    }
+    return used == header.indexed_count && (header.slot_count == 0 || used < header.slot_count);
+}
+
+// Validate the header, the bounds and the payload invariants, then adopt the mapped arrays
+bool loadSnapshot(const string& path, uint64_t expected_stamp, bool verify_payload,
+                  CityTable& cities, RoadStore& roads, string& error, SnapshotSummary* summary) {
+    auto file = make_shared<MappedFile>();
+    if (!file->open(path)) {
+        error = "no snapshot file";
+        return false;
+    }
+    if (file->size() < sizeof(SnapshotHeader)) {
+        error = "file too small";
+        return false;
+    }
+    SnapshotHeader header;
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.header_checksum != checksum(&header, offsetof(SnapshotHeader, header_checksum))) {
+        error = "bad header";
+        return false;
+    }
+    if (header.version != SNAPSHOT_VERSION || header.header_size != sizeof(SnapshotHeader)) {
+        error = "unsupported version " + to_string(header.version);
+        return false;
+    }
+    if (header.source_stamp != expected_stamp) {
+        error = "written from different cities.txt/roads.txt";
+        return false;
+    }
+    uint64_t size = file->size();
+    uint64_t n = header.city_count;
+    if (header.file_size != size || (header.slot_count & (header.slot_count - 1)) != 0 ||
+        !sectionFits(header.arena_offset, header.arena_bytes, 1, size) ||
+        !sectionFits(header.names_offset, n, sizeof(CityTable::NameRef), size) ||
+        !sectionFits(header.hashes_offset, n, sizeof(uint32_t), size) ||
+        !sectionFits(header.slots_offset, header.slot_count, sizeof(int32_t), size) ||
+        !sectionFits(header.row_offsets_offset, n + 1, sizeof(uint32_t), size) ||
+        !sectionFits(header.edges_offset, header.edge_count, sizeof(Road), size) ||
+        !sectionFits(header.budget_sums_offset, n, sizeof(double), size)) {
+        error = "truncated or inconsistent file";
+        return false;
+    }
+    const char* base = file->data();
+    const uint32_t* row_offsets = reinterpret_cast<const uint32_t*>(base + header.row_offsets_offset);
+    if (!payloadConsistent(header, base)) {
+        error = "inconsistent payload";
+        return false;
+    }
+    if (verify_payload &&
+        header.payload_checksum != checksum(base + sizeof(SnapshotHeader), size - sizeof(SnapshotHeader))) {
+        error = "payload checksum mismatch";
+        return false;
+    }
+
+    CityTable::Layout layout;
+    layout.arena = base + header.arena_offset;
+    layout.arena_size = header.arena_bytes;
+    layout.names = reinterpret_cast<const CityTable::NameRef*>(base + header.names_offset);
+    layout.hashes = reinterpret_cast<const uint32_t*>(base + header.hashes_offset);
+    layout.count = n;
+    layout.slots = reinterpret_cast<const int32_t*>(base + header.slots_offset);
+    layout.slot_count = header.slot_count;
+    layout.indexed = header.indexed_count;
+    cities.adopt(layout, file);
+    roads.adoptBase(n, row_offsets, reinterpret_cast<const Road*>(base + header.edges_offset), header.road_count, file);
+    if (summary) {
+        summary->budget_sums = reinterpret_cast<const double*>(base + header.budget_sums_offset);
+        summary->total_budget = header.total_budget;
+        summary->roads_fingerprint = header.roads_fingerprint;
+    }
+    return true;
+}
+
+// Compare names by index, then every row
+bool sameNetwork(const CityTable& cities1, const RoadStore& roads1, const CityTable& cities2, const RoadStore& roads2) {
+    if (cities1.size() != cities2.size() || roads1.roadCount() != roads2.roadCount()) return false;
+    for (size_t i = 0; i < cities1.size(); ++i) {
+        if (cities1[i] != cities2[i] || cities1.find(cities1[i]) != cities2.find(cities2[i])) return false;
+        RoadStore::RowView row1 = roads1.row(static_cast<int>(i));
+        RoadStore::RowView row2 = roads2.row(static_cast<int>(i));
+        if (row1.size() != row2.size()) return false;
+        for (const Road *a = row1.begin(), *b = row2.begin(); a != row1.end(); ++a, ++b) {
+            if (a->to != b->to || a->budget != b->budget) return false;
+        }
+    }
+    return true;
+}
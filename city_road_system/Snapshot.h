@@ -0,0 +1,77 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include "CityTable.h"
+#include "RoadStore.h"
+
+// Versioned binary snapshot of the whole network, laid out exactly as CityTable and
+// RoadStore hold it in memory so that loading is mmap-and-go: the file is mapped and
+// both structures read their arrays straight from the mapping, with no parsing.
+//
+// Layout (native byte order, every section 8-byte aligned):
+//   SnapshotHeader
+//   city name arena (packed names)       char[arena_bytes]
+//   name refs                             CityTable::NameRef[city_count]
+//   name hashes                           uint32_t[city_count]
+//   hash index slots                      int32_t[slot_count]
+//   CSR row offsets                       uint32_t[city_count + 1]
+//   CSR neighbours                        Road[edge_count]   (both directions of every road)
+//   budget sums                           double[city_count] (total budget of the roads at each city)
+//
+// The header carries its own checksum, verified on every load, and a checksum of
+// everything after it, verified only on request since it means reading the whole file.
+// Every load does check that the arrays index each other within bounds, so a corrupt payload
+// is refused rather than read out of bounds.
+// source_stamp identifies the cities.txt/roads.txt pair the snapshot was written from.
+// The budget sums, the total budget and the routing index fingerprint of the roads are stored
+// so that a start from the snapshot does not have to read every road to recompute them.
+
+const uint32_t SNAPSHOT_VERSION = 2;
+
+struct SnapshotHeader {
+    char magic[8];            // "CRSNAP\0\0"
+    uint32_t version;         // SNAPSHOT_VERSION
+    uint32_t header_size;     // sizeof(SnapshotHeader)
+    uint64_t source_stamp;
+    uint64_t city_count;
+    uint64_t arena_bytes;
+    uint64_t slot_count;
+    uint64_t indexed_count;
+    uint64_t road_count;
+    uint64_t edge_count;
+    uint64_t arena_offset;
+    uint64_t names_offset;
+    uint64_t hashes_offset;
+    uint64_t slots_offset;
+    uint64_t row_offsets_offset;
+    uint64_t edges_offset;
+    uint64_t budget_sums_offset;
+    uint64_t roads_fingerprint; // ContractionHierarchy::fingerprint of the roads
+    double total_budget;
+    uint64_t file_size;
+    uint64_t payload_checksum; // FNV-1a of every byte after the header
+    uint64_t header_checksum;  // FNV-1a of the header up to this field
+};
+
+// Summaries read from a snapshot along with the network
+struct SnapshotSummary {
+    const double* budget_sums = nullptr; // Per city, inside the mapping the roads hold on to
+    double total_budget = 0.0;
+    uint64_t roads_fingerprint = 0;
+};
+
+// Write a snapshot of the cities and roads (via a temporary file and rename), returns false on error
+bool writeSnapshot(const std::string& path, const CityTable& cities, const RoadStore& roads, uint64_t source_stamp);
+// Map a snapshot and point cities and roads at it. Fails (leaving both untouched) if the file is
+// missing, corrupt (bad header, sections or cross references), of another version, or was written
+// from different CSV files (stamp mismatch).
+// With verify_payload the payload checksum is checked as well. error describes why loading failed.
+// If summary is given, it is filled in when loading succeeds.
+bool loadSnapshot(const std::string& path, uint64_t expected_stamp, bool verify_payload,
+                  CityTable& cities, RoadStore& roads, std::string& error, SnapshotSummary* summary = nullptr);
+// Check that two networks hold the same cities (by index) and the same roads and budgets
+bool sameNetwork(const CityTable& cities1, const RoadStore& roads1, const CityTable& cities2, const RoadStore& roads2);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef UNION_FIND_H
+#define UNION_FIND_H
+
+#include <cstddef>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+// Disjoint sets over 0..n-1 with union by size and path halving, so a sequence of
+// finds and unions costs close to O(1) each.
+class UnionFind {
+public:
+    explicit UnionFind(size_t n = 0) { reset(n); }
+
+    // Start over with n singleton sets
+    void reset(size_t n) {
+        parent.resize(n);
+        std::iota(parent.begin(), parent.end(), 0);
+        set_size.assign(n, 1);
+        sets = n;
+    }
+    // Add singleton sets until there are n elements
+    void grow(size_t n) {
+        for (size_t x = parent.size(); x < n; ++x) {
+            parent.push_back(static_cast<int>(x));
+            set_size.push_back(1);
+            ++sets;
+        }
+    }
+    // Representative of the set containing x (shortens the path on the way)
+    int find(int x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    }
+    // Representative without modifying anything, safe to call from several threads at once
+    int root(int x) const {
+        while (parent[x] != x) x = parent[x];
+        return x;
+    }
+    // Merge the sets of a and b, returns false if they were already the same set
+    bool unite(int a, int b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) return false;
+        if (set_size[a] < set_size[b]) std::swap(a, b);
+        parent[b] = a;
+        set_size[a] += set_size[b];
+        --sets;
+        return true;
+    }
+    // Number of elements in the set containing x
+    size_t size(int x) { return set_size[find(x)]; }
+    // Number of disjoint sets
+    size_t count() const { return sets; }
+
+private:
+    std::vector<int> parent;
+    std::vector<size_t> set_size;
+    size_t sets = 0;
+};
+
+#endif
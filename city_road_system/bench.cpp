@@ -0,0 +1,357 @@
+#include "CityRoadSystem.h"
+#include "MappedFile.h"
+#include "NetworkGenerator.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Benchmark settings, all set from the command line
+struct BenchOptions {
+    NetworkShape shape = NetworkShape::Grid;
+    size_t cities = 10000;
+    double degree = 4.0;
+    uint64_t seed = 1;
+    size_t repeat = 5;
+    size_t ops = 10000;            // Calls per run of the per-call benchmarks
+    size_t threads = max(1u, thread::hardware_concurrency()); // Threads for the parallel roads.txt parse
+    string dir = "bench_data";     // Working directory for the data files
+    string out;                    // JSON output file, stdout if empty
+    bool generate_only = false;    // Only write cities.txt/roads.txt into dir
+};
+
+// Timings of one benchmark over all repetitions
+struct BenchResult {
+    string name;
+    size_t ops;                    // Operations per repetition
+    vector<double> ns_per_op;      // One entry per repetition
+};
+
+// Stream buffer that drops everything, so the methods' console messages cost formatting but no I/O
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char*, streamsize n) override { return n; }
+};
+
+// Gives the benchmarks access to private helpers of CityRoadSystem
+class CityRoadSystemBench {
+public:
+    static int getCityIndex(const CityRoadSystem& system, string_view name) { return system.getCityIndex(name); }
+    static bool saveRoadsToFile(const CityRoadSystem& system) { return system.saveRoadsToFile(system.roads_file); }
+    static void generateDotFile(const CityRoadSystem& system) { system.generateDotFile(); }
+    static void parseRoadsText(const CityRoadSystem& system, string_view text, size_t threads,
+                               vector<RoadEdge>& edges, vector<RoadLineError>& errors) {
+        system.parseRoadsText(text, threads, edges, errors);
+    }
+};
+
+// Parse a whole-field number
+template <typename T>
+static bool parseValue(const char* text, T& value) {
+    const char* last = text + strlen(text);
+    auto result = from_chars(text, last, value);
+    return result.ec == errc() && result.ptr == last;
+}
+
+// Read "--name value" options, returns false (after printing usage) on anything unknown
+static bool parseOptions(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        string name = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = value != nullptr;
+        if (name == "--generate") {
+            options.generate_only = true;
+            continue;
+        } else if (name == "--shape" && ok) {
+            ok = parseNetworkShape(value, options.shape);
+        } else if (name == "--cities" && ok) {
+            ok = parseValue(value, options.cities) && options.cities >= 2;
+        } else if (name == "--degree" && ok) {
+            ok = parseValue(value, options.degree) && options.degree > 0;
+        } else if (name == "--seed" && ok) {
+            ok = parseValue(value, options.seed);
+        } else if (name == "--repeat" && ok) {
+            ok = parseValue(value, options.repeat) && options.repeat > 0;
+        } else if (name == "--ops" && ok) {
+            ok = parseValue(value, options.ops) && options.ops > 0;
+        } else if (name == "--threads" && ok) {
+            ok = parseValue(value, options.threads) && options.threads > 0;
+        } else if (name == "--dir" && ok) {
+            options.dir = value;
+        } else if (name == "--out" && ok) {
+            options.out = value;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            cerr << "Usage: " << argv[0] << " [--generate] [--shape grid|geometric|scale-free] [--cities N] [--degree D]\n"
+                 << "       [--seed S] [--repeat R] [--ops K] [--threads T] [--dir DIR] [--out FILE]\n";
+            return false;
+        }
+        ++i;
+    }
+    return true;
+}
+
+// Start from the generated CSV files only: no journal, snapshot, routing index, DOT or generation file
+static bool resetData(const GeneratedNetwork& network) {
+    for (const char* file : {"city_roads.journal", "city_roads.snap", "city_roads.ch", "city_roads.dot", "city_roads.gen"}) {
+        unlink(file);
+    }
+    return writeNetworkFiles(network, "cities.txt", "roads.txt");
+}
+
+// Parsing roads.txt on any number of threads must give exactly what one thread gives, and
+// skipped lines must keep their line numbers: a bad line is spliced in after every 997th line,
+// with every other one naming an unknown city, and each has to be reported at its own line
+static bool checkParallelParse(const CityRoadSystem& system, string_view text, size_t max_threads) {
+    string spliced;
+    spliced.reserve(text.size() + text.size() / 500);
+    vector<size_t> bad_lines;
+    size_t line_number = 0;
+    for (size_t pos = 0; pos < text.size();) {
+        size_t end = text.find('\n', pos);
+        end = end == string_view::npos ? text.size() : end + 1;
+        spliced.append(text.substr(pos, end - pos));
+        if (spliced.back() != '\n') spliced += '\n';
+        pos = end;
+        if (++line_number % 997 == 0) {
+            spliced += bad_lines.size() % 2 == 0 ? "not a road\n" : "Nowhere-Nothing,1\n";
+            bad_lines.push_back(++line_number);
+        }
+    }
+
+    vector<RoadEdge> serial_edges, edges;
+    vector<RoadLineError> serial_errors, errors;
+    CityRoadSystemBench::parseRoadsText(system, spliced, 1, serial_edges, serial_errors);
+    if (serial_errors.size() != bad_lines.size()) return false;
+    for (size_t i = 0; i < bad_lines.size(); ++i) {
+        if (serial_errors[i].line != bad_lines[i]) return false;
+    }
+    for (size_t threads = 2; threads <= max(max_threads, size_t(3)); ++threads) {
+        CityRoadSystemBench::parseRoadsText(system, spliced, threads, edges, errors);
+        if (edges.size() != serial_edges.size() || errors.size() != serial_errors.size()) return false;
+        for (size_t i = 0; i < edges.size(); ++i) {
+            if (edges[i].city1 != serial_edges[i].city1 || edges[i].city2 != serial_edges[i].city2 ||
+                memcmp(&edges[i].budget, &serial_edges[i].budget, sizeof(double)) != 0) return false;
+        }
+        for (size_t i = 0; i < errors.size(); ++i) {
+            if (errors[i].line != serial_errors[i].line || errors[i].message != serial_errors[i].message) return false;
+        }
+    }
+    return true;
+}
+
+// Run setup (untimed) then body (timed) once per repetition
+template <typename Setup, typename Body>
+static BenchResult measure(const string& name, size_t ops, size_t repeat, Setup setup, Body body) {
+    BenchResult result{name, ops, {}};
+    for (size_t r = 0; r < repeat; ++r) {
+        setup(r);
+        auto start = chrono::steady_clock::now();
+        body(r);
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+        result.ns_per_op.push_back(ns / static_cast<double>(ops));
+    }
+    return result;
+}
+
+// Results as JSON: the network and settings, then min/median/mean nanoseconds per operation
+static void writeJson(ostream& out, const BenchOptions& options, const GeneratedNetwork& network,
+                      const vector<BenchResult>& results) {
+    out << "{\n  \"network\": {\"shape\": \"" << networkShapeName(options.shape) << "\", \"cities\": "
+        << network.cities.size() << ", \"roads\": " << network.roads.size() << ", \"degree\": " << options.degree
+        << ", \"seed\": " << options.seed << "},\n";
+    out << fixed << setprecision(1);
+    out << "  \"repeat\": " << options.repeat << ",\n  \"threads\": " << options.threads
+        << ",\n  \"deferred_sync\": true,\n  \"benchmarks\": [\n";
+    for (size_t b = 0; b < results.size(); ++b) {
+        vector<double> sorted = results[b].ns_per_op;
+        sort(sorted.begin(), sorted.end());
+        double mean = 0.0;
+        for (double ns : sorted) mean += ns;
+        mean /= static_cast<double>(sorted.size());
+        out << "    {\"name\": \"" << results[b].name << "\", \"ops\": " << results[b].ops
+            << ", \"min_ns_per_op\": " << sorted.front() << ", \"median_ns_per_op\": " << sorted[sorted.size() / 2]
+            << ", \"mean_ns_per_op\": " << mean << "}" << (b + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// Benchmark suite: generate a seeded network into a scratch directory, time the main
+// CityRoadSystem operations on it, and report JSON for comparing versions. Changes run
+// with deferred journal sync (as in batch mode) so the numbers do not depend on fsync latency.
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) return 1;
+    GeneratedNetwork network = generateNetwork(options.shape, options.cities, options.degree, options.seed);
+    ofstream json_file; // Opened before changing directory, so a relative --out path means what the user meant
+    if (!options.out.empty()) {
+        json_file.open(options.out);
+        if (!json_file.is_open()) {
+            cerr << "Could not open " << options.out << ".\n";
+            return 1;
+        }
+    }
+    mkdir(options.dir.c_str(), 0755);
+    if (chdir(options.dir.c_str()) != 0 || !resetData(network)) {
+        cerr << "Could not write the network into " << options.dir << ".\n";
+        return 1;
+    }
+    if (network.roads.empty()) {
+        cerr << "The generated network has no roads; use more cities or a higher --degree.\n";
+        return 1;
+    }
+    if (options.generate_only) {
+        cerr << "Wrote " << network.cities.size() << " cities and " << network.roads.size() << " roads to "
+             << options.dir << "/cities.txt and roads.txt.\n";
+        return 0;
+    }
+
+    // Inputs drawn once, so every repetition does the same work
+    mt19937_64 rng(options.seed);
+    size_t ops = options.ops;
+    vector<string> lookups(ops);
+    for (string& name : lookups) name = network.cities[rng() % network.cities.size()];
+    unordered_set<uint64_t> connected;
+    auto key = [](int a, int b) { return (static_cast<uint64_t>(min(a, b)) << 32) | static_cast<uint32_t>(max(a, b)); };
+    for (const RoadEdge& road : network.roads) connected.insert(key(road.city1, road.city2));
+    vector<RoadEdge> new_roads;
+    size_t n = network.cities.size();
+    size_t missing = n * (n - 1) / 2 - connected.size(); // Pairs that could still get a road
+    while (new_roads.size() < min(ops, missing)) {
+        int a = static_cast<int>(rng() % network.cities.size());
+        int b = static_cast<int>(rng() % network.cities.size());
+        if (a != b && connected.insert(key(a, b)).second) new_roads.push_back({a, b, 1.0 + static_cast<double>(rng() % 9000) / 1000.0});
+    }
+    vector<RoadEdge> changes(ops);
+    for (RoadEdge& change : changes) {
+        change = network.roads[rng() % network.roads.size()];
+        change.budget = 1.0 + static_cast<double>(rng() % 9000) / 1000.0;
+    }
+
+    NullBuffer null_buffer;
+    streambuf* console = cout.rdbuf(&null_buffer);
+    streambuf* keyboard = cin.rdbuf();
+    unique_ptr<CityRoadSystem> system;
+    istringstream new_cities;
+    vector<BenchResult> results;
+    volatile long sink = 0;
+    auto fresh = [&](size_t) {
+        system.reset();
+        resetData(network);
+        system = make_unique<CityRoadSystem>();
+        system->setDeferredSync(true);
+    };
+    auto loaded = [&](size_t) {
+        if (!system) fresh(0);
+    };
+
+    results.push_back(measure("loadData", 1, options.repeat, [&](size_t) {
+        system.reset();
+        resetData(network);
+    }, [&](size_t) { system = make_unique<CityRoadSystem>(); }));
+    system->setDeferredSync(true);
+
+    // Parse roads.txt alone, on one thread and on --threads threads, after checking they agree
+    MappedFile road_file;
+    vector<RoadEdge> parsed_edges;
+    vector<RoadLineError> parse_errors;
+    if (!road_file.open("roads.txt") || !checkParallelParse(*system, road_file.view(), options.threads)) {
+        cout.rdbuf(console);
+        cerr << "Parsing roads.txt in parallel gave a different result from parsing it on one thread.\n";
+        return 1;
+    }
+    results.push_back(measure("parseRoads_serial", 1, options.repeat, loaded, [&](size_t) {
+        CityRoadSystemBench::parseRoadsText(*system, road_file.view(), 1, parsed_edges, parse_errors);
+    }));
+    results.push_back(measure("parseRoads_parallel", 1, options.repeat, loaded, [&](size_t) {
+        CityRoadSystemBench::parseRoadsText(*system, road_file.view(), options.threads, parsed_edges, parse_errors);
+    }));
+    road_file.close();
+
+    results.push_back(measure("getCityIndex", ops, options.repeat, loaded, [&](size_t) {
+        long sum = 0;
+        for (const string& name : lookups) sum += CityRoadSystemBench::getCityIndex(*system, name);
+        sink = sum; // Keeps the lookups from being optimized away
+    }));
+
+    results.push_back(measure("addCities", ops, options.repeat, [&](size_t r) {
+        fresh(r);
+        string names;
+        for (size_t i = 0; i < ops; ++i) names += "New" + to_string(r) + "_" + to_string(i) + "\n";
+        new_cities.clear();
+        new_cities.str(names);
+        cin.rdbuf(new_cities.rdbuf());
+    }, [&](size_t) { system->addCities(static_cast<int>(ops)); }));
+    cin.rdbuf(keyboard);
+
+    results.push_back(measure("addRoad", new_roads.size(), options.repeat, fresh, [&](size_t) {
+        for (const RoadEdge& road : new_roads) {
+            system->addRoad(network.cities[road.city1], network.cities[road.city2], road.budget);
+        }
+    }));
+
+    results.push_back(measure("updateBudget", ops, options.repeat, fresh, [&](size_t) {
+        for (const RoadEdge& change : changes) {
+            system->updateBudget(network.cities[change.city1], network.cities[change.city2], change.budget);
+        }
+    }));
+
+    results.push_back(measure("saveRoadsToFile", 1, options.repeat, fresh, [&](size_t) {
+        CityRoadSystemBench::saveRoadsToFile(*system);
+    }));
+
+    results.push_back(measure("displayRoads", 1, options.repeat, loaded, [&](size_t) { system->displayRoads(); }));
+
+    results.push_back(measure("generateDotFile", 1, options.repeat, loaded, [&](size_t) {
+        CityRoadSystemBench::generateDotFile(*system);
+    }));
+
+    // The first 1000 rows of the road matrix across every column (a full matrix of the default
+    // 10000 cities would be 300 MB of text)
+    results.push_back(measure("displayMatrixWindow", 1, options.repeat, loaded, [&](size_t) {
+        system->displayMatrixWindow(0, 999, 0, static_cast<int>(network.cities.size()), false);
+    }));
+
+    results.push_back(measure("exportGraphML", 1, options.repeat, loaded, [&](size_t) {
+        system->exportNetwork("bench_export.graphml", false);
+    }));
+
+    results.push_back(measure("exportEdgeList", 1, options.repeat, loaded, [&](size_t) {
+        system->exportNetwork("bench_export.edges", true);
+    }));
+    unlink("bench_export.graphml");
+    unlink("bench_export.edges");
+
+    // Sampled centrality from 256 sources, on one thread and on --threads threads
+    results.push_back(measure("centrality_serial", 1, options.repeat, loaded, [&](size_t) {
+        system->analyzeCentrality("bench_centrality.csv", 256, "", 1);
+    }));
+    results.push_back(measure("centrality_parallel", 1, options.repeat, loaded, [&](size_t) {
+        system->analyzeCentrality("bench_centrality.csv", 256, "", static_cast<unsigned>(options.threads));
+    }));
+    unlink("bench_centrality.csv");
+
+    system.reset();
+    cout.rdbuf(console);
+    if (options.out.empty()) {
+        writeJson(cout, options, network, results);
+        return 0;
+    }
+    writeJson(json_file, options, network, results);
+    return json_file.good() ? 0 : 1;
+}
@@ -1,4 +1,11 @@
 #include "CityRoadSystem.h"
+#include "LoadGenerator.h"
+#include "Metrics.h"
+#include "QueryServer.h"
+#include "ScriptRunner.h"
+#include <charconv>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <limits>
 
@@ -50,8 +57,134 @@ double getDoubleInput(const string& prompt) {
     }
 }
 
-// Main function: Entry point with menu-driven interface
-int main() {
+// Split a comma-separated list of city names, trimming spaces and dropping empty names
+vector<string> splitCityNames(const string& line) {
+    vector<string> city_names;
+    size_t start = 0;
+    while (start <= line.size()) {
+        size_t comma = line.find(',', start);
+        if (comma == string::npos) comma = line.size();
+        string name = line.substr(start, comma - start);
+        name.erase(0, name.find_first_not_of(' '));
+        name.erase(name.find_last_not_of(' ') + 1);
+        if (!name.empty()) city_names.push_back(name);
+        start = comma + 1;
+    }
+    return city_names;
+}
+
+// Batch mode: run a script file ("-" for stdin) with buffered output, exit status 1 if any line failed
+int runBatch(const string& script_file) {
+    ios::sync_with_stdio(false); // Let cout buffer instead of writing through to stdio
+    cin.tie(nullptr);            // Reading a line must not flush cout
+    ifstream file;
+    if (script_file != "-") {
+        file.open(script_file);
+        if (!file.is_open()) {
+            cout << "Could not open script " << script_file << ".\n";
+            return 1;
+        }
+    }
+    CityRoadSystem system;
+    size_t errors = runScript(system, script_file == "-" ? cin : file);
+    if (errors > 0) cout << errors << " script lines or checkpoints failed.\n";
+    cout.flush();
+    return errors > 0 ? 1 : 0;
+}
+
+// Optional positive count argument: argv[index] if present, otherwise the default
+bool countArgument(int argc, char* argv[], int index, size_t default_value, size_t& value) {
+    value = default_value;
+    if (index >= argc) return true;
+    const char* last = argv[index] + strlen(argv[index]);
+    auto result = from_chars(argv[index], last, value);
+    return result.ec == errc() && result.ptr == last && value > 0;
+}
+
+// Server mode: load once, then answer queries over a socket until Ctrl+C
+int runServer(int argc, char* argv[]) {
+    ServerAddress address;
+    size_t workers;
+    if (argc < 3 || !parseServerAddress(argv[2], address) || !countArgument(argc, argv, 3, thread::hardware_concurrency(), workers)) {
+        cout << "Usage: " << argv[0] << " --serve unix:PATH|tcp:PORT [WORKERS]\n";
+        return 1;
+    }
+    CityRoadSystem system;
+    system.enableConcurrentReaders();
+    QueryServer server(system, static_cast<unsigned>(workers));
+    if (!server.listen(address)) return 1;
+    server.run();
+    return 0;
+}
+
+// Load generator mode: replay a request file against a running server and report latency
+int runLoadTest(int argc, char* argv[]) {
+    ServerAddress address;
+    size_t connections, depth, requests;
+    if (argc < 4 || !parseServerAddress(argv[2], address) || !countArgument(argc, argv, 4, 4, connections) ||
+        !countArgument(argc, argv, 5, 16, depth) || !countArgument(argc, argv, 6, 100000, requests)) {
+        cout << "Usage: " << argv[0] << " --load-test unix:PATH|tcp:PORT REQUEST_FILE [CONNECTIONS [DEPTH [REQUESTS]]]\n";
+        return 1;
+    }
+    return runLoadGenerator(address, argv[3], static_cast<unsigned>(connections), static_cast<unsigned>(depth), requests) ? 0 : 1;
+}
+
+// Take "--metrics-file FILE", "--metrics-interval SECONDS", "--load-threads N" and
+// "--region-memory MB" out of the arguments (they may come before or after the mode), apply the
+// thread count and region memory limit and start the periodic metrics dump if a file was given
+bool commonArguments(int& argc, char* argv[]) {
+    string metrics_file;
+    size_t interval = 10;
+    size_t threads = 0;
+    size_t region_megabytes = 0;
+    int kept = 1;
+    for (int i = 1; i < argc; ++i) {
+        string name = argv[i];
+        if (name == "--metrics-file" && i + 1 < argc) {
+            metrics_file = argv[++i];
+        } else if (name == "--metrics-interval" && i + 1 < argc) {
+            if (!countArgument(argc, argv, ++i, 10, interval)) {
+                cout << "Usage: " << argv[0] << " [--metrics-file FILE [--metrics-interval SECONDS]] ...\n";
+                return false;
+            }
+        } else if (name == "--load-threads" && i + 1 < argc) {
+            if (!countArgument(argc, argv, ++i, 0, threads)) {
+                cout << "Usage: " << argv[0] << " [--load-threads N] ...\n";
+                return false;
+            }
+        } else if (name == "--region-memory" && i + 1 < argc) {
+            if (!countArgument(argc, argv, ++i, 0, region_megabytes)) {
+                cout << "Usage: " << argv[0] << " [--region-memory MB] ...\n";
+                return false;
+            }
+        } else {
+            argv[kept++] = argv[i];
+        }
+    }
+    argc = kept;
+    argv[argc] = nullptr;
+    CityRoadSystem::setLoadThreads(threads);
+    CityRoadSystem::setRegionMemoryLimit(region_megabytes << 20);
+    if (!metrics_file.empty()) startMetricsDump(metrics_file, static_cast<unsigned>(interval));
+    return true;
+}
+
+// Main function: Entry point with menu-driven interface, batch mode with --script FILE,
+// server mode with --serve ADDRESS, or the server load generator with --load-test ADDRESS FILE.
+// Any mode can also dump operation metrics to a file with --metrics-file FILE and set the
+// number of threads that parse roads.txt with --load-threads N, and cap the memory of loaded
+// region shards with --region-memory MB.
+int main(int argc, char* argv[]) {
+    if (!commonArguments(argc, argv)) return 1;
+    if (argc >= 2 && string(argv[1]) == "--script") {
+        return runBatch(argc >= 3 ? argv[2] : "-");
+    }
+    if (argc >= 2 && string(argv[1]) == "--serve") {
+        return runServer(argc, argv);
+    }
+    if (argc >= 2 && string(argv[1]) == "--load-test") {
+        return runLoadTest(argc, argv);
+    }
     CityRoadSystem system; // Create an instance of the system
     cout << "Welcome to the City and Road Management System!\n";
     cout << "Current Date and Time: 11:49 AM CAT, Friday, May 23, 2025\n";
@@ -73,7 +206,39 @@ int main() {
         cout << "12. Display Cities and Road Matrix\n";
         cout << "13. Generate Graph Image\n";
         cout << "14. Exit\n";
-        cout << "Enter choice (1-14): ";
+        cout << "15. Compact Data Files\n";
+        cout << "16. Save Binary Snapshot\n";
+        cout << "17. Find Cheapest Route Between Cities\n";
+        cout << "18. Find Nearest Cities (by Budget)\n";
+        cout << "19. Answer Route Queries From File\n";
+        cout << "20. Build Routing Index\n";
+        cout << "21. Plan Minimum-Cost Road Network\n";
+        cout << "22. Stress Test Concurrent Readers\n";
+        cout << "23. Show Operation Statistics\n";
+        cout << "24. Import Cities From File\n";
+        cout << "25. Find Connected Components\n";
+        cout << "26. Find Cities Within K Roads\n";
+        cout << "27. Find Common Neighbours of Two Cities\n";
+        cout << "28. Show Network Summary\n";
+        cout << "29. Show Road Totals for a City\n";
+        cout << "30. Show Most Expensive Roads\n";
+        cout << "31. Find Roads in a Budget Range\n";
+        cout << "32. Check if Two Regions Are Connected\n";
+        cout << "33. Delete Road\n";
+        cout << "34. Delete City (by Index)\n";
+        cout << "35. Save Named Version\n";
+        cout << "36. Restore Named Version\n";
+        cout << "37. Compare Versions\n";
+        cout << "38. List and Delete Versions\n";
+        cout << "39. Undo Last Change\n";
+        cout << "40. Display Roads Page by Page\n";
+        cout << "41. Display Part of the Matrices\n";
+        cout << "42. Export Network (GraphML or Binary Edge List)\n";
+        cout << "43. Build Region Shards\n";
+        cout << "44. Display Regions\n";
+        cout << "45. Display One Region\n";
+        cout << "46. Centrality Analysis (Critical Cities and Roads)\n";
+        cout << "Enter choice (1-46): ";
         string choice;
         getline(cin, choice);
 
@@ -141,6 +306,157 @@ int main() {
             // Exit the program
             cout << "Exiting program.\n";
             break;
+        } else if (choice == "15") {
+            // Fold the change journal into cities.txt and roads.txt
+            system.compactData();
+        } else if (choice == "16") {
+            // Convert the data to the binary snapshot used for fast startup
+            system.saveSnapshot();
+        } else if (choice == "17") {
+            // Cheapest route between two cities
+            system.displayCities(); // Show cities to help user choose
+            string city1 = getStringInput("Enter first city: ");
+            string city2 = getStringInput("Enter second city: ");
+            system.findShortestPath(city1, city2);
+        } else if (choice == "18") {
+            // Nearest cities by total budget
+            system.displayCities(); // Show cities to help user choose
+            string city = getStringInput("Enter city: ");
+            int k = getIntInput("Enter how many cities to list (0 for all): ");
+            system.findNearestCities(city, k);
+        } else if (choice == "19") {
+            // Batch route queries
+            string query_file = getStringInput("Enter query file (From,To per line): ");
+            string output_file = getStringInput("Enter output file: ");
+            system.answerRouteQueries(query_file, output_file);
+        } else if (choice == "20") {
+            // Contraction hierarchy for faster route queries
+            system.buildRouteIndex();
+        } else if (choice == "21") {
+            // Cheapest set of roads keeping all (or some) cities connected
+            string line = getStringInput("Enter cities to connect, separated by commas (leave empty for all cities): ");
+            system.planMinimumNetwork(splitCityNames(line));
+        } else if (choice == "22") {
+            // Readers on other threads checking snapshot isolation while a writer publishes changes
+            int reader_threads = getIntInput("Enter number of reader threads: ");
+            int updates = getIntInput("Enter number of budget updates to publish: ");
+            system.stressTestReaders(reader_threads, updates);
+        } else if (choice == "23") {
+            // Call counts, latency and bytes read/written per operation
+            system.displayOperationStats();
+        } else if (choice == "24") {
+            // Bulk import: one city name per line, duplicates and existing cities are skipped
+            string file_name = getStringInput("Enter city file (one name per line): ");
+            system.importCitiesFromFile(file_name);
+        } else if (choice == "25") {
+            // Connected components over the bit-packed adjacency, optionally of a region only
+            string line = getStringInput("Enter the cities of a region, separated by commas (leave empty for all cities): ");
+            system.findConnectedComponents(splitCityNames(line));
+        } else if (choice == "26") {
+            // Cities reachable within a number of roads
+            string city = getStringInput("Enter city: ");
+            int hops = getIntInput("Enter the number of roads: ");
+            system.findCitiesWithinHops(city, hops);
+        } else if (choice == "27") {
+            // Cities with a road to both cities
+            string city1 = getStringInput("Enter first city: ");
+            string city2 = getStringInput("Enter second city: ");
+            system.findCommonNeighbors(city1, city2);
+        } else if (choice == "28") {
+            // Totals kept up to date on every change
+            system.displayNetworkSummary();
+        } else if (choice == "29") {
+            // Roads and total budget at one city
+            string city = getStringInput("Enter city: ");
+            system.displayCityTotals(city);
+        } else if (choice == "30") {
+            // Top-k roads from the budget index
+            int k = getIntInput("Enter how many roads to list: ");
+            system.displayTopRoads(k);
+        } else if (choice == "31") {
+            // Roads whose budget falls in a range
+            double low = getDoubleInput("Enter lowest budget (billions RWF): ");
+            double high = getDoubleInput("Enter highest budget (billions RWF): ");
+            system.displayRoadsInBudgetRange(low, high);
+        } else if (choice == "32") {
+            // Connectivity between two groups of cities (a single city is a region of one)
+            string first = getStringInput("Enter the cities of the first region, separated by commas: ");
+            string second = getStringInput("Enter the cities of the second region, separated by commas: ");
+            system.checkConnected(splitCityNames(first), splitCityNames(second));
+        } else if (choice == "33") {
+            // Delete a road
+            system.displayRoads(); // Show roads to help user choose
+            string city1 = getStringInput("Enter first city: ");
+            string city2 = getStringInput("Enter second city: ");
+            system.deleteRoad(city1, city2);
+        } else if (choice == "34") {
+            // Delete a city and its roads by index
+            system.displayCities(); // Show cities to help user choose index
+            int index = getIntInput("Enter city index to delete: ");
+            system.deleteCity(index);
+        } else if (choice == "35") {
+            // Keep the network as it is now under a name
+            system.saveVersion(getStringInput("Enter version name: "));
+        } else if (choice == "36") {
+            // Go back to a named version
+            system.listVersions();
+            system.restoreVersion(getStringInput("Enter version name: "));
+        } else if (choice == "37") {
+            // Roads changed between two versions
+            system.listVersions();
+            string from = getStringInput("Enter first version (or current): ");
+            string to = getStringInput("Enter second version (or current): ");
+            system.diffVersions(from, to);
+        } else if (choice == "38") {
+            // List the versions, then optionally drop one
+            system.listVersions();
+            string name = getStringInput("Enter a version to delete (or leave empty): ");
+            if (!name.empty()) system.deleteVersion(name);
+        } else if (choice == "39") {
+            // Undo the last change
+            system.undoLastChange();
+        } else if (choice == "40") {
+            // Page through the road list
+            int page_size = getIntInput("Enter roads per page: ");
+            int page = 1;
+            while (system.displayRoadsPage(page, page_size) &&
+                   getStringInput("Press Enter for the next page, or q to stop: ") != "q") {
+                ++page;
+            }
+        } else if (choice == "41") {
+            // A window of the matrices, or only its non-zero cells
+            int first_row = getIntInput("Enter first row (city index): ");
+            int last_row = getIntInput("Enter last row (city index): ");
+            int first_column = getIntInput("Enter first column (city index): ");
+            int last_column = getIntInput("Enter last column (city index): ");
+            string kind = getStringInput("Show (r)oads, (b)udgets or (s)parse list of roads: ");
+            if (kind == "s") {
+                system.displaySparseMatrix(first_row, last_row, first_column, last_column);
+            } else {
+                system.displayMatrixWindow(first_row, last_row, first_column, last_column, kind == "b");
+            }
+        } else if (choice == "42") {
+            // Stream the network to a file for other graph tools
+            string file_name = getStringInput("Enter output file: ");
+            string format = getStringInput("Format, (g)raphml or (e)dge list: ");
+            system.exportNetwork(file_name, format == "e");
+        } else if (choice == "43") {
+            // Split the network into regions stored apart, loaded only when used
+            int cities_per_region = getIntInput("Enter cities per region (0 = use the Region column of cities.txt): ");
+            system.buildRegionShards(cities_per_region);
+        } else if (choice == "44") {
+            // Regions and which of them are in memory
+            system.displayRegions();
+        } else if (choice == "45") {
+            // One region, without loading the others
+            system.displayRegions();
+            system.displayRegion(getStringInput("Enter region name: "));
+        } else if (choice == "46") {
+            // Betweenness and closeness of every city and road, written as CSV
+            string city_file = getStringInput("Enter output file for cities: ");
+            string road_file = getStringInput("Enter output file for roads (or leave empty): ");
+            int samples = getIntInput("Enter number of sampled source cities (0 = exact, every city): ");
+            system.analyzeCentrality(city_file, samples, road_file);
         } else {
             cout << "Invalid choice.\n";
         }